@@ -0,0 +1,166 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "factory.hxx"
+#include "nodes.hxx"
+#include "package.hxx"
+#include "storage_types.hxx"
+#include "topology_generator.hxx"
+
+static void BM_QueuePushPop(benchmark::State& state) {
+    PackageQueue q(static_cast<PackageQueueType>(state.range(0)));
+    const auto depth = state.range(1);
+    for (auto _ : state) {
+        for (int64_t i = 0; i < depth; ++i) {
+            q.push(Package(static_cast<ElementID>(i + 1)));
+        }
+        for (int64_t i = 0; i < depth; ++i) {
+            benchmark::DoNotOptimize(q.pop());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+}
+BENCHMARK(BM_QueuePushPop)
+    ->ArgNames({"lifo", "depth"})
+    ->ArgsProduct({{0, 1}, {16, 1024, 65536}});
+
+// Ta sama praca co BM_QueuePushPop, ale wprost na BasicQueue (bez wywolan wirtualnych).
+template <class Queue>
+static void BM_BasicQueuePushPop(benchmark::State& state) {
+    Queue q;
+    const auto depth = state.range(0);
+    for (auto _ : state) {
+        for (int64_t i = 0; i < depth; ++i) {
+            q.push(Package(static_cast<ElementID>(i + 1)));
+        }
+        for (int64_t i = 0; i < depth; ++i) {
+            benchmark::DoNotOptimize(q.pop());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+}
+BENCHMARK_TEMPLATE(BM_BasicQueuePushPop, FifoQueue)->ArgName("depth")->Arg(16)->Arg(1024)->Arg(65536);
+BENCHMARK_TEMPLATE(BM_BasicQueuePushPop, LifoQueue)->ArgName("depth")->Arg(16)->Arg(1024)->Arg(65536);
+BENCHMARK_TEMPLATE(BM_BasicQueuePushPop, AgePriorityQueue)->ArgName("depth")->Arg(16)->Arg(1024)->Arg(65536);
+
+static void BM_ChooseReceiver(benchmark::State& state) {
+    std::vector<Storehouse> stores;
+    stores.reserve(static_cast<std::size_t>(state.range(0)));
+    ReceiverPreferences prefs;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        stores.emplace_back(static_cast<ElementID>(i + 1));
+    }
+    for (auto& s : stores) {
+        prefs.add_receiver(&s);
+    }
+    // counter=1: generator licznikowy, jedno losowanie na ture.
+    bool counter = state.range(1) != 0;
+    if (counter) {
+        prefs.set_counter_rng(CounterRng(42), 7);
+    }
+    Time t = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(counter ? prefs.choose_receiver(++t) : prefs.choose_receiver());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ChooseReceiver)
+    ->ArgNames({"receivers", "counter"})
+    ->ArgsProduct({benchmark::CreateRange(1, 4096, 8), {0, 1}});
+
+// 256 polproduktow na iteracje: pojedynczo (batch=1) albo jedna partia.
+static void BM_RampTransfer(benchmark::State& state) {
+    constexpr std::size_t packages = 256;
+    const auto batch = static_cast<std::size_t>(state.range(0));
+    Ramp ramp(1, 1, batch);
+    std::vector<Worker> workers;
+    workers.reserve(16);
+    for (ElementID id = 1; id <= 16; ++id) {
+        workers.emplace_back(id, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO));
+    }
+    for (auto& w : workers) {
+        ramp.receiver_preferences_.add_receiver(&w);
+    }
+    Time t = 0;
+    for (auto _ : state) {
+        for (std::size_t n = 0; n < packages; n += batch) {
+            ramp.deliver_goods(1);
+            if (batch > 1) {
+                ramp.send_batch(++t);
+            } else {
+                ramp.send_package(++t);
+            }
+        }
+        for (auto& w : workers) {
+            while (w.get_queue()->pop()) {}
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(packages));
+}
+BENCHMARK(BM_RampTransfer)->ArgName("batch")->Arg(1)->Arg(16)->Arg(256);
+
+static void BM_PackageLifetime(benchmark::State& state) {
+    for (auto _ : state) {
+        Package p;
+        benchmark::DoNotOptimize(p.get_id());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PackageLifetime);
+
+namespace {
+
+std::string structure_text(std::size_t workers) {
+    std::ostringstream os;
+    save_factory_structure(generate_topology({TopologyShape::LAYERED, workers, 16}), os);
+    return os.str();
+}
+
+}
+
+static void BM_LoadStructureStream(benchmark::State& state) {
+    const std::string text = structure_text(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::istringstream is(text);
+        benchmark::DoNotOptimize(load_factory_structure(is));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_LoadStructureStream)->ArgName("workers")->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMicrosecond);
+
+static void BM_LoadStructureView(benchmark::State& state) {
+    const std::string text = structure_text(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(load_factory_structure(std::string_view(text)));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_LoadStructureView)->ArgName("workers")->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMicrosecond);
+
+static void BM_LoadStructureFile(benchmark::State& state) {
+    const std::string text = structure_text(static_cast<std::size_t>(state.range(0)));
+    const std::string path = "netsim_bench_structure.txt";
+    std::ofstream(path) << text;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(load_factory_structure_file(path));
+    }
+    std::remove(path.c_str());
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_LoadStructureFile)->ArgName("workers")->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMicrosecond);
+
+// Budowa i zniszczenie fabryki: z wlasna arena (0) i bezposrednio na stercie (1).
+static void BM_FactoryLifetime(benchmark::State& state) {
+    std::pmr::memory_resource* resource = state.range(1) ? std::pmr::new_delete_resource() : nullptr;
+    for (auto _ : state) {
+        Factory f = generate_topology({TopologyShape::LAYERED, static_cast<std::size_t>(state.range(0)), 16}, resource);
+        benchmark::DoNotOptimize(f);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FactoryLifetime)
+    ->ArgNames({"workers", "heap"})
+    ->ArgsProduct({{1000, 100000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
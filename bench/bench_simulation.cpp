@@ -0,0 +1,121 @@
+#include <benchmark/benchmark.h>
+#include "factory.hxx"
+#include "flat_factory.hxx"
+#include "layout.hxx"
+#include "simulation.hxx"
+#include "topology_generator.hxx"
+
+namespace {
+
+constexpr TimeOffset turns_per_iteration = 10;
+
+// Fabryka jest budowana raz, a kolejne iteracje kontynuuja symulacje od
+// nastepnej tury - mierzony jest stan ustalony, nie rozbieg.
+template <typename Engine>
+void run_engine(benchmark::State& state, Factory& f, Engine engine, TimeOffset turns = turns_per_iteration) {
+    std::size_t workers = f.worker_collection().size();
+    Time t = 1;
+    for (auto _ : state) {
+        engine(f, t + turns - 1, t);
+        t += turns;
+    }
+    state.counters["workers"] = static_cast<double>(workers);
+    state.counters["node_turns"] = benchmark::Counter(
+        static_cast<double>(workers) * static_cast<double>(state.iterations() * turns),
+        benchmark::Counter::kIsRate);
+}
+
+void run_simulation(benchmark::State& state, Factory& f) {
+    run_engine(state, f, [](Factory& factory, Time last, Time first) {
+        simulate(factory, last, [](Factory&, Time) {}, first);
+    });
+}
+
+void run_simulation(benchmark::State& state, TopologyShape shape, std::size_t width) {
+    Factory f = generate_topology({shape, static_cast<std::size_t>(state.range(0)), width, 1, 2});
+    run_simulation(state, f);
+}
+
+}
+
+static void BM_SimulateChain(benchmark::State& state) { run_simulation(state, TopologyShape::CHAIN, 1); }
+static void BM_SimulateFanOut(benchmark::State& state) { run_simulation(state, TopologyShape::FAN_OUT, 16); }
+static void BM_SimulateLayered(benchmark::State& state) { run_simulation(state, TopologyShape::LAYERED, 64); }
+
+BENCHMARK(BM_SimulateChain)->ArgName("workers")->RangeMultiplier(100)->Range(10, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SimulateFanOut)->ArgName("workers")->RangeMultiplier(100)->Range(10, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SimulateLayered)->ArgName("workers")->RangeMultiplier(100)->Range(10, 1000000)->Unit(benchmark::kMillisecond);
+
+// Ta sama siec co BM_SimulateLayered w silniku plaskim. Kazda iteracja to
+// osobne wywolanie simulate_flat() na `turns` tur, wiec obejmuje tez budowe
+// tablic i zapis stanu z powrotem do fabryki; node_turns porownuje sie
+// z BM_SimulateLayered.
+static void BM_SimulateFlat(benchmark::State& state) {
+    Factory f = generate_topology({TopologyShape::LAYERED, static_cast<std::size_t>(state.range(0)), 64, 1, 2});
+    run_engine(state, f, [](Factory& factory, Time last, Time first) {
+        simulate_flat(factory, last, [](Factory&, Time) {}, [](Time) { return false; }, first);
+    }, static_cast<TimeOffset>(state.range(1)));
+}
+BENCHMARK(BM_SimulateFlat)
+    ->ArgNames({"workers", "turns"})
+    ->ArgsProduct({{10000, 100000, 1000000}, {10, 100}})
+    ->Unit(benchmark::kMillisecond);
+
+// simulate_parallel() na 100k robotnikow wg liczby watkow; drugi argument
+// wlacza generator licznikowy, bez ktorego losowanie odbiorcow zostaje sekwencyjne.
+static void BM_SimulateParallel(benchmark::State& state) {
+    Factory f = generate_topology({TopologyShape::LAYERED, 100000, 64, 1, 2});
+    if (state.range(1)) {
+        f.enable_counter_rng(1);
+    }
+    auto threads = static_cast<std::size_t>(state.range(0));
+    run_engine(state, f, [threads](Factory& factory, Time last, Time first) {
+        simulate_parallel(factory, last, [](Factory&, Time) {}, threads, first);
+    });
+}
+BENCHMARK(BM_SimulateParallel)
+    ->ArgNames({"threads", "counter_rng"})
+    ->ArgsProduct({{1, 2, 4, 8, 16}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Robotnicy zadeklarowani w losowej kolejnosci, bez i z optimize_layout().
+// Z biblioteka zbudowana z libpfm chybienia widac bezposrednio:
+// --benchmark_perf_counters=CACHE-MISSES.
+static void BM_SimulateShuffledLayout(benchmark::State& state) {
+    Factory f = generate_topology({TopologyShape::LAYERED, static_cast<std::size_t>(state.range(0)), 64, 1, 2, 42});
+    if (state.range(1)) {
+        optimize_layout(f);
+    }
+    run_simulation(state, f);
+}
+BENCHMARK(BM_SimulateShuffledLayout)
+    ->ArgNames({"workers", "optimized"})
+    ->ArgsProduct({{10000, 1000000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// Sama faza pracy skompilowanej fabryki; argument to wariant petli zakonczen.
+static void BM_FlatWorkPhase(benchmark::State& state) {
+    auto kernel = static_cast<FlatFactory::CompletionKernel>(state.range(1));
+    if (!FlatFactory::kernel_supported(kernel)) {
+        state.SkipWithError("kernel not supported");
+        return;
+    }
+    Factory f = generate_topology({TopologyShape::LAYERED, static_cast<std::size_t>(state.range(0)), 256, 1, 3});
+    FlatFactory flat(f);
+    flat.set_kernel(kernel);
+    Time t = 1;
+    for (; t <= 50; ++t) {
+        flat.do_deliveries(t);
+        flat.do_package_passing(t);
+        flat.do_work(t);
+    }
+    for (auto _ : state) {
+        flat.do_work(t++);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FlatWorkPhase)
+    ->ArgNames({"workers", "kernel"})
+    ->ArgsProduct({{100000}, {0, 1, 2}})
+    ->Unit(benchmark::kMicrosecond);
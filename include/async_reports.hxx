@@ -0,0 +1,63 @@
+#ifndef ASYNC_REPORTS_HXX_
+#define ASYNC_REPORTS_HXX_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "factory.hxx"
+#include "reports.hxx"
+
+// Raporty tur pisane w osobnym watku. Watek symulacji jedynie kopiuje stan
+// (TurnState; z magazynow tylko przyrost od poprzedniego raportu) do wolnego
+// slotu z puli o stalym rozmiarze; formatowanie i zapis odbywaja sie w tle.
+// Gdy wszystkie sloty czekaja na zapis, submit() blokuje (backpressure), wiec
+// zuzycie pamieci jest ograniczone.
+class AsyncTurnReporter {
+public:
+    explicit AsyncTurnReporter(std::ostream& os, ReportFormat format = ReportFormat::TEXT, bool delta = false,
+                               std::size_t queue_depth = 2);
+    ~AsyncTurnReporter();
+
+    AsyncTurnReporter(const AsyncTurnReporter&) = delete;
+    AsyncTurnReporter& operator=(const AsyncTurnReporter&) = delete;
+
+    void submit(const Factory& f, Time t);
+    // Czeka, az wszystkie zgloszone raporty zostana zapisane.
+    void flush();
+
+    // Callback dla simulate(), raportujacy w turach wskazanych przez notifier.
+    template <typename Notifier>
+    std::function<void(Factory&, Time)> callback(Notifier& notifier) {
+        return [this, &notifier](Factory& f, Time t) {
+            if (notifier.should_generate_report(t)) {
+                submit(f, t);
+            }
+        };
+    }
+
+private:
+    void run();
+    void rethrow_error();
+
+    TurnReportWriter writer_;
+    std::vector<TurnState> slots_;
+    StockCursor cursor_;  // tylko watek symulacji
+    std::vector<std::size_t> free_slots_;
+    std::deque<std::size_t> ready_;
+    bool writing_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+
+    std::mutex mutex_;
+    std::condition_variable slot_free_cv_;
+    std::condition_variable ready_cv_;
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef CHANGE_SET_HXX_
+#define CHANGE_SET_HXX_
+
+#include <utility>
+#include <vector>
+#include "nodes.hxx"
+#include "topology.hxx"
+#include "types.hxx"
+
+// Co dzieje sie z polproduktami usuwanego nadawcy (rampy lub robotnika).
+// Zapas usuwanego magazynu jest zawsze porzucany.
+enum class DrainPolicy {
+    DISCARD,    // polprodukty sa porzucane (ID wracaja do puli)
+    REROUTE     // polprodukty trafiaja do pozostalych odbiorcow usuwanego wezla
+};
+
+struct NodeRef {
+    NodeKind kind;
+    ElementID id;
+};
+
+// Zestaw zmian struktury stosowany w calosci przez Factory::apply_changes()
+// albo - w trakcie symulacji - na poczatku tury po Factory::submit_changes().
+// Kolejnosc zastosowania: nowe wezly, polaczenia (dodanie lub zmiana wagi),
+// usuniecia polaczen, usuniecia wezlow.
+class ChangeSet {
+public:
+    struct Link {
+        NodeRef src;
+        NodeRef dest;
+        double weight;
+    };
+
+    ChangeSet& add_ramp(Ramp&& ramp) { ramps_.push_back(std::move(ramp)); return *this; }
+    ChangeSet& add_worker(Worker&& worker) { workers_.push_back(std::move(worker)); return *this; }
+    ChangeSet& add_storehouse(Storehouse&& storehouse) { storehouses_.push_back(std::move(storehouse)); return *this; }
+    // Istniejace polaczenie dostaje nowa wage.
+    ChangeSet& link(NodeRef src, NodeRef dest, double weight = 1.0) { links_.push_back({src, dest, weight}); return *this; }
+    ChangeSet& unlink(NodeRef src, NodeRef dest) { unlinks_.push_back({src, dest, 0.0}); return *this; }
+    ChangeSet& remove(NodeRef node) { removals_.push_back(node); return *this; }
+    ChangeSet& set_drain_policy(DrainPolicy policy) { drain_ = policy; return *this; }
+
+    bool empty() const {
+        return ramps_.empty() && workers_.empty() && storehouses_.empty() && links_.empty() && unlinks_.empty() &&
+               removals_.empty();
+    }
+
+private:
+    friend class Factory;
+
+    std::vector<Ramp> ramps_;
+    std::vector<Worker> workers_;
+    std::vector<Storehouse> storehouses_;
+    std::vector<Link> links_;
+    std::vector<Link> unlinks_;
+    std::vector<NodeRef> removals_;
+    DrainPolicy drain_ = DrainPolicy::DISCARD;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef COUNTER_RNG_HXX_
+#define COUNTER_RNG_HXX_
+
+#include <array>
+#include <cstdint>
+
+// Generator licznikowy Philox4x32-10 (Salmon i in., "Parallel Random Numbers:
+// As Easy as 1, 2, 3"). Wynik jest czysta funkcja klucza (ziarna) i licznika,
+// wiec losowanie nie zalezy od kolejnosci ani od tego, co losowali inni.
+class CounterRng {
+public:
+    using block_t = std::array<std::uint32_t, 4>;
+
+    explicit CounterRng(std::uint64_t seed = 0)
+        : key0_(static_cast<std::uint32_t>(seed)), key1_(static_cast<std::uint32_t>(seed >> 32)) {}
+
+    std::uint64_t seed() const { return std::uint64_t{key1_} << 32 | key0_; }
+
+    block_t block(const block_t& counter) const {
+        std::uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        std::uint32_t k0 = key0_;
+        std::uint32_t k1 = key1_;
+        for (int round = 0; round < 10; ++round) {
+            std::uint64_t p0 = std::uint64_t{0xD2511F53} * c0;
+            std::uint64_t p1 = std::uint64_t{0xCD9E8D57} * c2;
+            c0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ k0;
+            c1 = static_cast<std::uint32_t>(p1);
+            c2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ k1;
+            c3 = static_cast<std::uint32_t>(p0);
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+        return {c0, c1, c2, c3};
+    }
+
+    // Liczba z przedzialu [0, 1) dla losowania `draw` strumienia `stream` w turze `turn`.
+    double canonical(std::uint64_t turn, std::uint64_t stream, std::uint32_t draw) const {
+        block_t r = block({static_cast<std::uint32_t>(turn), draw, static_cast<std::uint32_t>(stream),
+                           static_cast<std::uint32_t>(stream >> 32) ^ static_cast<std::uint32_t>(turn >> 32)});
+        std::uint64_t bits = (std::uint64_t{r[0]} << 32 | r[1]) >> 11;
+        return static_cast<double>(bits) * 0x1.0p-53;
+    }
+
+private:
+    std::uint32_t key0_;
+    std::uint32_t key1_;
+};
+
+#endif
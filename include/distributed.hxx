@@ -0,0 +1,29 @@
+#ifndef DISTRIBUTED_HXX_
+#define DISTRIBUTED_HXX_
+
+#include <cstddef>
+#include <functional>
+#include "factory.hxx"
+#include "types.hxx"
+
+// Symulacja rozdzielona na `shards` procesow potomnych (fork). Rampy, robotnicy
+// i magazyny sa dzielone przez partition_factory(); kazda czesc trzyma stan
+// swoich wezlow, sama losuje odbiorcow swoich nadawcow (wymaga generatora
+// licznikowego - Factory::enable_counter_rng()) i raz na ture wymienia z
+// pozostalymi czesciami paczki polproduktow dla ich odbiorcow, bezposrednio
+// przez gniazda Unix (socketpair). Odbiorca przyjmuje polprodukty w kolejnosci
+// nadawcow z simulate(), wiec wynik jest identyczny jak w simulate().
+//
+// Proces wywolujacy nadaje tylko ID polproduktom z ramp (jedna pula, jak w
+// simulate()) i przyjmuje ID zwolnione w magazynach; jego odpowiedz do
+// wszystkich czesci jest bariera konczaca ture. W turach raportu (oraz po
+// ostatniej) czesci odsylaja pelny stan swoich wezlow, ktory trafia do `f`
+// przed wywolaniem rf. Procesy potomne zapisuja tylko pamiec swoich wezlow,
+// a reszte kopii fabryki wspoldziela z rodzicem.
+//
+// Liczniki metryk wezlow (NETSIM_METRICS) zostaja w procesach potomnych
+// i nie sa przenoszone. Rampy z partiami nie sa obslugiwane.
+void simulate_distributed(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf,
+                          std::size_t shards, std::function<bool(Time)> report_turns = {});
+
+#endif
@@ -4,51 +4,358 @@
 #include <vector>
 #include <string>
 #include <algorithm>
-#include <list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
 #include <istream>
+#include <stdexcept>
+#include <string_view>
+#include "change_set.hxx"
 #include "nodes.hxx"
+#include "topology.hxx"
 
+// Wezly trzymane sa w stalych porcjach (chunkach), wiec ich adresy nie zmieniaja
+// sie przy dodawaniu/usuwaniu innych wezlow (ReceiverPreferences trzyma wskazniki).
+// Iteracja odpowiada kolejnosci dodawania. Zwolniony slot jest ponownie
+// uzywany przez kolejny dodany wezel, wiec przy wielokrotnym dodawaniu
+// i usuwaniu liczba slotow nie przekracza najwiekszej liczby wezlow naraz.
+// Dopoki zaden slot nie zostal uzyty ponownie, kolejnosc dodawania to po
+// prostu kolejnosc slotow; potem jest trzymana osobno (order_).
+// Porcje, indeks i wewnetrzne tablice dodanych wezlow pochodza z podanego
+// memory_resource, ktory musi zyc dluzej niz kolekcja.
+//
+// relayout() uklada wezly w nowych porcjach w zadanej kolejnosci (zmienia sie
+// wtedy kolejnosc slotow, a wiec iteracji); kolejnosc deklaracji - dla raportow -
+// jest pamietana osobno i dostepna przez declared_begin()/declared_end().
 template <class Node>
 class NodeCollection {
+    static constexpr std::size_t chunk_shift = 8;
+    static constexpr std::size_t chunk_size = std::size_t{1} << chunk_shift;
+    static constexpr std::size_t no_slot = SIZE_MAX;
+
+    using slot_t = std::optional<Node>;
+
+    // Sloty w zadanej kolejnosci z indeksem pozycji (slot -> pozycja). Usuniety
+    // wezel zostawia no_slot, a tablica jest scalana, gdy takich wpisow jest
+    // wiecej niz zywych, wiec usuniecie kosztuje zamortyzowane O(1).
+    class SlotOrder {
+    public:
+        explicit SlotOrder(std::pmr::memory_resource* resource) : slots_(resource), pos_(resource) {}
+
+        bool empty() const { return slots_.empty(); }
+        std::size_t size() const { return slots_.size(); }
+        std::size_t operator[](std::size_t k) const { return slots_[k]; }
+        std::size_t position(std::size_t s) const { return pos_[s]; }
+
+        void push(std::size_t s) {
+            if (s >= pos_.size()) {
+                pos_.resize(s + 1, no_slot);
+            }
+            pos_[s] = slots_.size();
+            slots_.push_back(s);
+        }
+
+        void erase(std::size_t s) {
+            slots_[pos_[s]] = no_slot;
+            pos_[s] = no_slot;
+            if (++dead_ * 2 > slots_.size()) {
+                compact();
+            }
+        }
+
+        // Po relayout(): slot s staje sie new_slot[s], a nowe sloty sa ciagle.
+        void remap(const std::vector<std::size_t>& new_slot) {
+            compact();
+            for (std::size_t& s : slots_) {
+                s = new_slot[s];
+            }
+            pos_.assign(slots_.size(), no_slot);
+            for (std::size_t k = 0; k < slots_.size(); ++k) {
+                pos_[slots_[k]] = k;
+            }
+        }
+
+        void clear() {
+            slots_.clear();
+            pos_.clear();
+            dead_ = 0;
+        }
+
+    private:
+        void compact() {
+            std::size_t k = 0;
+            for (std::size_t s : slots_) {
+                if (s != no_slot) {
+                    pos_[s] = k;
+                    slots_[k++] = s;
+                }
+            }
+            slots_.resize(k);
+            dead_ = 0;
+        }
+
+        std::pmr::vector<std::size_t> slots_;
+        std::pmr::vector<std::size_t> pos_;
+        std::size_t dead_ = 0;
+    };
+
+    // Declared: kolejnosc deklaracji zamiast kolejnosci iteracji.
+    template <bool Const, bool Declared>
+    class basic_iterator {
+        using collection_ptr = std::conditional_t<Const, const NodeCollection*, NodeCollection*>;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Node;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const Node*, Node*>;
+        using reference = std::conditional_t<Const, const Node&, Node&>;
+
+        basic_iterator() = default;
+        basic_iterator(collection_ptr c, std::size_t pos) : c_(c), pos_(pos) { skip_empty(); }
+
+        template <bool C = Const, typename = std::enable_if_t<C>>
+        basic_iterator(const basic_iterator<false, Declared>& other) : c_(other.c_), pos_(other.pos_) {}
+
+        reference operator*() const { return *c_->slot(at()); }
+        pointer operator->() const { return &**this; }
+
+        basic_iterator& operator++() { ++pos_; skip_empty(); return *this; }
+        basic_iterator operator++(int) { auto tmp = *this; ++*this; return tmp; }
+
+        friend bool operator==(const basic_iterator& a, const basic_iterator& b) { return a.pos_ == b.pos_; }
+        friend bool operator!=(const basic_iterator& a, const basic_iterator& b) { return a.pos_ != b.pos_; }
+
+    private:
+        friend class NodeCollection;
+        template <bool, bool> friend class basic_iterator;
+
+        std::size_t at() const { return Declared ? c_->declared_slot(pos_) : c_->order_slot(pos_); }
+        std::size_t count() const { return Declared ? c_->declared_count() : c_->order_count(); }
+
+        void skip_empty() {
+            while (pos_ < count() && !c_->occupied(at())) ++pos_;
+        }
+
+        collection_ptr c_ = nullptr;
+        std::size_t pos_ = 0;
+    };
+
 public:
-    using container_t = std::list<Node>;
-    using iterator = typename container_t::iterator;
-    using const_iterator = typename container_t::const_iterator;
+    using iterator = basic_iterator<false, false>;
+    using const_iterator = basic_iterator<true, false>;
+    using declared_iterator = basic_iterator<false, true>;
+    using const_declared_iterator = basic_iterator<true, true>;
+
+    explicit NodeCollection(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : resource_(resource), index_(resource), free_(resource), order_(resource), declared_(resource) {}
+
+    NodeCollection(NodeCollection&& other) noexcept
+        : resource_(other.resource_), chunks_(std::move(other.chunks_)),
+          slot_count_(std::exchange(other.slot_count_, 0)), size_(std::exchange(other.size_, 0)),
+          index_(std::move(other.index_)), free_(std::move(other.free_)),
+          order_(std::move(other.order_)), declared_(std::move(other.declared_)) {}
+
+    NodeCollection& operator=(NodeCollection&&) = delete;
+
+    ~NodeCollection() {
+        for (slot_t* chunk : chunks_) {
+            std::destroy_n(chunk, chunk_size);
+            resource_->deallocate(chunk, chunk_size * sizeof(slot_t), alignof(slot_t));
+        }
+    }
+
+    // std::invalid_argument, gdy wezel o tym ID juz istnieje.
+    Node& add(Node&& node) {
+        if (index_.count(node.get_id())) {
+            throw std::invalid_argument("Duplicate node ID " + std::to_string(node.get_id()) + ".");
+        }
+        std::size_t s = take_free_slot();
+        if (s != no_slot) {
+            // Slot w srodku - od teraz kolejnosc slotow nie jest kolejnoscia dodawania.
+            if (order_.empty()) {
+                for (std::size_t k = 0; k < slot_count_; ++k) {
+                    if (slot(k)) order_.push(k);
+                }
+            }
+            order_.push(s);
+        } else {
+            if (slot_count_ == chunks_.size() * chunk_size) {
+                auto* chunk = static_cast<slot_t*>(resource_->allocate(chunk_size * sizeof(slot_t), alignof(slot_t)));
+                std::uninitialized_default_construct_n(chunk, chunk_size);
+                chunks_.push_back(chunk);
+            }
+            s = slot_count_++;
+            if (!order_.empty()) {
+                order_.push(s);
+            }
+        }
+        slot(s).emplace(std::move(node));
+        slot(s)->set_memory_resource(resource_);
+        index_.emplace(slot(s)->get_id(), s);
+        if (!declared_.empty()) {
+            declared_.push(s);
+        }
+        ++size_;
+        return *slot(s);
+    }
 
-    void add(Node&& node) { nodes_.emplace_back(std::move(node)); }
-    
     void remove_by_id(ElementID id) {
-        auto it = find_by_id(id);
-        if (it != nodes_.end()) {
-            nodes_.erase(it);
+        auto it = index_.find(id);
+        if (it != index_.end()) {
+            std::size_t s = it->second;
+            slot(s).reset();
+            if (!order_.empty()) {
+                order_.erase(s);
+            }
+            if (!declared_.empty()) {
+                declared_.erase(s);
+            }
+            index_.erase(it);
+            --size_;
+            free_.push_back(s);
+            while (slot_count_ > 0 && !slot(slot_count_ - 1)) {
+                --slot_count_;
+            }
+        }
+    }
+
+    // `ids` musi byc permutacja ID wszystkich wezlow. Nowe wezly budowane sa
+    // konstruktorem T(T&, memory_resource*) (tylko Worker), a stare niszczone
+    // dopiero na koncu. moved(stary, nowy) jest wolane dla kazdego wezla.
+    template <typename Moved>
+    void relayout(const std::vector<ElementID>& ids, Moved moved) {
+        if (ids.size() != size_) {
+            throw std::invalid_argument("Layout must list every node exactly once.");
+        }
+        std::vector<std::size_t> new_slot(slot_count_, no_slot);
+        for (std::size_t k = 0; k < ids.size(); ++k) {
+            auto it = index_.find(ids[k]);
+            if (it == index_.end() || new_slot[it->second] != no_slot) {
+                throw std::invalid_argument("Layout must list every node exactly once.");
+            }
+            new_slot[it->second] = k;
+        }
+
+        if (declared_.empty()) {
+            for (auto it = cbegin(); it != cend(); ++it) {
+                declared_.push(it.at());
+            }
         }
+        std::vector<slot_t*> chunks;
+        for (std::size_t k = 0; k < ids.size(); k += chunk_size) {
+            auto* chunk = static_cast<slot_t*>(resource_->allocate(chunk_size * sizeof(slot_t), alignof(slot_t)));
+            std::uninitialized_default_construct_n(chunk, chunk_size);
+            chunks.push_back(chunk);
+        }
+        for (std::size_t k = 0; k < ids.size(); ++k) {
+            std::size_t s = index_[ids[k]];
+            slot_t& target = chunks[k >> chunk_shift][k & (chunk_size - 1)];
+            target.emplace(*slot(s), resource_);
+            moved(*slot(s), *target);
+            index_[ids[k]] = k;
+        }
+        declared_.remap(new_slot);
+        order_.clear();
+        free_.clear();
+
+        for (slot_t* chunk : chunks_) {
+            std::destroy_n(chunk, chunk_size);
+            resource_->deallocate(chunk, chunk_size * sizeof(slot_t), alignof(slot_t));
+        }
+        chunks_ = std::move(chunks);
+        slot_count_ = ids.size();
     }
 
     iterator find_by_id(ElementID id) {
-        return std::find_if(nodes_.begin(), nodes_.end(), 
-            [id](const Node& node){ return node.get_id() == id; });
+        auto it = index_.find(id);
+        return it != index_.end() ? iterator(this, order_position(it->second)) : end();
     }
 
     const_iterator find_by_id(ElementID id) const {
-        return std::find_if(nodes_.begin(), nodes_.end(), 
-            [id](const Node& node){ return node.get_id() == id; });
+        auto it = index_.find(id);
+        return it != index_.end() ? const_iterator(this, order_position(it->second)) : end();
     }
 
-    iterator begin() { return nodes_.begin(); }
-    iterator end() { return nodes_.end(); }
-    const_iterator cbegin() const { return nodes_.cbegin(); }
-    const_iterator cend() const { return nodes_.cend(); }
-    const_iterator begin() const { return nodes_.begin(); }
-    const_iterator end() const { return nodes_.end(); }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // Liczba slotow (zajetych i wolnych) - nie wieksza niz najwieksze size() w historii.
+    std::size_t slot_count() const { return slot_count_; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, order_count()); }
+    const_iterator cbegin() const { return const_iterator(this, 0); }
+    const_iterator cend() const { return const_iterator(this, order_count()); }
+    const_iterator begin() const { return cbegin(); }
+    const_iterator end() const { return cend(); }
+
+    declared_iterator declared_begin() { return declared_iterator(this, 0); }
+    declared_iterator declared_end() { return declared_iterator(this, declared_count()); }
+    const_declared_iterator declared_begin() const { return const_declared_iterator(this, 0); }
+    const_declared_iterator declared_end() const { return const_declared_iterator(this, declared_count()); }
 
 private:
-    container_t nodes_;
+    slot_t& slot(std::size_t s) { return chunks_[s >> chunk_shift][s & (chunk_size - 1)]; }
+    const slot_t& slot(std::size_t s) const { return chunks_[s >> chunk_shift][s & (chunk_size - 1)]; }
+    bool occupied(std::size_t s) const { return s < slot_count_ && slot(s).has_value(); }
+
+    // Kolejnosc iteracji: order_, a gdy pusty - kolejnosc slotow.
+    std::size_t order_count() const { return order_.empty() ? slot_count_ : order_.size(); }
+    std::size_t order_slot(std::size_t pos) const { return order_.empty() ? pos : order_[pos]; }
+    std::size_t order_position(std::size_t s) const { return order_.empty() ? s : order_.position(s); }
+    // Kolejnosc deklaracji: declared_, a gdy pusty - kolejnosc iteracji.
+    std::size_t declared_count() const { return declared_.empty() ? order_count() : declared_.size(); }
+    std::size_t declared_slot(std::size_t pos) const { return declared_.empty() ? order_slot(pos) : declared_[pos]; }
+
+    // Wpisy free_ moga byc nieaktualne (slot obciety z konca albo zajety po
+    // dopisaniu na koniec) - sa wtedy pomijane.
+    std::size_t take_free_slot() {
+        while (!free_.empty()) {
+            std::size_t s = free_.back();
+            free_.pop_back();
+            if (s < slot_count_ && !slot(s)) {
+                return s;
+            }
+        }
+        return no_slot;
+    }
+
+    std::pmr::memory_resource* resource_;
+    std::vector<slot_t*> chunks_;
+    std::size_t slot_count_ = 0;
+    std::size_t size_ = 0;
+    std::pmr::unordered_map<ElementID, std::size_t> index_;
+    std::pmr::vector<std::size_t> free_;
+    // Sloty w kolejnosci dodawania; pusty, dopoki jest ona rowna kolejnosci slotow.
+    SlotOrder order_;
+    // Sloty w kolejnosci deklaracji; pusty, dopoki jest ona rowna kolejnosci iteracji.
+    SlotOrder declared_;
 };
 
+// Fabryka ma wlasna arene (pule pamieci), z ktorej korzystaja jej wezly,
+// kolejki, preferencje odbiorcow i indeks topologii; zniszczenie fabryki zwalnia
+// ja w calosci. Arena nie jest synchronizowana - fabryka moze alokowac tylko z
+// jednego watku naraz. Zamiast areny mozna podac zewnetrzne zrodlo pamieci, ktore musi
+// wtedy zyc dluzej niz fabryka. Fabryki nie mozna przypisywac (tylko przenosic
+// przy konstrukcji), bo wezly pozostaja zwiazane ze swoim zrodlem pamieci.
 class Factory {
 public:
-    void add_ramp(Ramp&& ramp) { ramps_.add(std::move(ramp)); }
-    void remove_ramp(ElementID id) { ramps_.remove_by_id(id); }
+    Factory() : Factory(nullptr) {}
+    explicit Factory(std::pmr::memory_resource* resource)
+        : arena_(resource ? nullptr : std::make_unique<std::pmr::unsynchronized_pool_resource>()),
+          resource_(resource ? resource : arena_.get()),
+          topology_(std::make_unique<TopologyIndex>(resource_)),
+          ramps_(resource_), workers_(resource_), storehouses_(resource_) {}
+
+    Factory(Factory&&) = default;
+    Factory& operator=(Factory&&) = delete;
+
+    std::pmr::memory_resource* memory_resource() const { return resource_; }
+
+    void add_ramp(Ramp&& ramp);
+    void remove_ramp(ElementID id);
     NodeCollection<Ramp>& ramp_collection() { return ramps_; } 
 
     NodeCollection<Ramp>::iterator ramp_begin() { return ramps_.begin(); }
@@ -58,7 +365,7 @@ public:
     NodeCollection<Ramp>::const_iterator ramp_begin() const { return ramps_.begin(); }
     NodeCollection<Ramp>::const_iterator ramp_end() const { return ramps_.end(); }
 
-    void add_worker(Worker&& worker) { workers_.add(std::move(worker)); }
+    void add_worker(Worker&& worker);
     void remove_worker(ElementID id);
     NodeCollection<Worker>& worker_collection() { return workers_; }
 
@@ -68,8 +375,18 @@ public:
     NodeCollection<Worker>::const_iterator worker_cend() const { return workers_.cend(); }
     NodeCollection<Worker>::const_iterator worker_begin() const { return workers_.begin(); }
     NodeCollection<Worker>::const_iterator worker_end() const { return workers_.end(); }
+    // Kolejnosc z pliku struktury (raporty, zapis, wysylka), niezalezna od relayout_workers().
+    NodeCollection<Worker>::declared_iterator worker_declared_begin() { return workers_.declared_begin(); }
+    NodeCollection<Worker>::declared_iterator worker_declared_end() { return workers_.declared_end(); }
+    NodeCollection<Worker>::const_declared_iterator worker_declared_begin() const { return workers_.declared_begin(); }
+    NodeCollection<Worker>::const_declared_iterator worker_declared_end() const { return workers_.declared_end(); }
+    // Uklada robotnikow w pamieci w podanej kolejnosci, ktora staje sie tez
+    // kolejnoscia przetwarzania w do_work(). Wysylka (losowania i kolejnosc
+    // przyjec u odbiorcow) idzie dalej w kolejnosci deklaracji, wiec wyniki
+    // symulacji sie nie zmieniaja. Wskazniki do robotnikow sprzed wywolania traca waznosc.
+    void relayout_workers(const std::vector<ElementID>& order);
 
-    void add_storehouse(Storehouse&& storehouse) { storehouses_.add(std::move(storehouse)); }
+    void add_storehouse(Storehouse&& storehouse) { topology_->add_storehouse(storehouses_.add(std::move(storehouse))); }
     void remove_storehouse(ElementID id);
     NodeCollection<Storehouse>& storehouse_collection() { return storehouses_; }
 
@@ -88,21 +405,81 @@ public:
     NodeCollection<Worker>::const_iterator find_worker_by_id(ElementID id) const { return workers_.find_by_id(id); }
     NodeCollection<Storehouse>::const_iterator find_storehouse_by_id(ElementID id) const { return storehouses_.find_by_id(id); }
 
-    bool is_consistent();
+    bool is_consistent() { return topology_->is_consistent(); }
+    // Opis wezla, przez ktory siec jest niespojna (pusty dla spojnej sieci).
+    std::string describe_inconsistency() { return topology_->describe_inconsistency(); }
+    const TopologyIndex& topology() const { return *topology_; }
+
+    FactoryMetrics& metrics() { return metrics_; }
+    const FactoryMetrics& metrics() const { return metrics_; }
+
+    // Przelacza losowanie odbiorcow wszystkich nadawcow (takze dodanych pozniej)
+    // na generator licznikowy; strumien nadawcy wynika z jego rodzaju i ID, wiec
+    // wynik nie zalezy od kolejnosci wezlow ani liczby watkow.
+    void enable_counter_rng(std::uint64_t seed);
+    const std::optional<CounterRng>& counter_rng() const { return counter_rng_; }
+
     void do_deliveries(Time t);
     void do_package_passing(Time t);
     void do_work(Time t);
+    // Dostawa jednej rampy (z metrykami) - dla silnikow obslugujacych pojedyncze wezly.
+    void do_delivery(Ramp& ramp, Time t);
+
+    // Stosuje zestaw zmian w calosci: najpierw sprawdza wszystkie odwolania
+    // (std::invalid_argument bez zadnej zmiany, gdy ktores jest bledne), potem
+    // aktualizuje tylko preferencje nadawcow, ktorych zmiany dotycza (odbiorcy
+    // usuwanych wezlow przez indeks topologii). t to tura, z ktora wiazane sa
+    // losowania przy REROUTE i przyjecia polproduktow.
+    void apply_changes(ChangeSet&& changes, Time t);
+    // Zestawy zgloszone w trakcie symulacji (np. z rf) silniki stosuja na poczatku
+    // nastepnej tury, w kolejnosci zgloszenia.
+    void submit_changes(ChangeSet&& changes) { pending_changes_.push_back(std::move(changes)); }
+    bool has_pending_changes() const { return !pending_changes_.empty(); }
+    // Zwraca true, gdy byly jakies zmiany. Gdy ktorys zestaw jest bledny, wczesniejsze
+    // zostaja zastosowane, bledny jest porzucany (wyjatek z apply_changes()), a
+    // kolejne czekaja na nastepne wywolanie.
+    bool apply_pending_changes(Time t);
+    // Polprodukty porzucone przy usuwaniu nadawcow (DISCARD, brak odbiorcy albo
+    // pelny odbiorca przy REROUTE).
+    std::uint64_t get_discarded_packages() const { return discarded_packages_; }
 
 private:
+    IPackageSender* find_sender(const NodeRef& node);
+    IPackageReceiver* find_receiver(const NodeRef& node);
+    void validate(const ChangeSet& changes);
+    void drain(const NodeRef& node, DrainPolicy policy, Time t);
+    void remove_receiver_links(IPackageReceiver* receiver);
+    void attach_counter_rng(Ramp& ramp) const;
+    void attach_counter_rng(Worker& worker) const;
+
+    std::unique_ptr<std::pmr::memory_resource> arena_;
+    std::pmr::memory_resource* resource_;
+    std::unique_ptr<TopologyIndex> topology_;
     NodeCollection<Ramp> ramps_;
     NodeCollection<Worker> workers_;
     NodeCollection<Storehouse> storehouses_;
-    
-    template <typename Sender>
-    void remove_receiver_links(NodeCollection<Sender>& collection, IPackageReceiver* receiver);
+    FactoryMetrics metrics_;
+    std::optional<CounterRng> counter_rng_;
+    std::vector<ChangeSet> pending_changes_;
+    std::uint64_t discarded_packages_ = 0;
+};
+
+// Blad formatu pliku struktury; line/column wskazuja miejsce bledu (od 1).
+class StructureParseError : public std::runtime_error {
+public:
+    StructureParseError(std::size_t line, std::size_t column, const std::string& message);
+
+    std::size_t line() const { return line_; }
+    std::size_t column() const { return column_; }
+
+private:
+    std::size_t line_;
+    std::size_t column_;
 };
 
 Factory load_factory_structure(std::istream& is);
+Factory load_factory_structure(std::string_view text);
+Factory load_factory_structure_file(const std::string& path);
 void save_factory_structure(const Factory& factory, std::ostream& os);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef FLAT_FACTORY_HXX_
+#define FLAT_FACTORY_HXX_
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+#include "factory.hxx"
+#include "ring_buffer.hxx"
+#include "types.hxx"
+
+// Skompilowana ("plaska") postac fabryki: stan wezlow w osobnych tablicach
+// (structure of arrays), indeksy zamiast wskaznikow i polaczenia w formacie CSR.
+// Tura przebiega tak samo jak Factory::do_*, ale bez wywolan wirtualnych.
+//
+// Konstruktor przejmuje polprodukty ramp i robotnikow, sync_to_factory() zapisuje
+// biezacy stan z powrotem (np. na potrzeby raportow). Magazyny przyjmuja
+// polprodukty bezposrednio (z ich trybem przechowywania i statystykami). Fabryka musi zyc dluzej niz
+// FlatFactory, bo generatory prawdopodobienstwa nadawcow sa wywolywane w miejscu.
+// Z NETSIM_METRICS metryki ramp, robotnikow i polaczen sa liczone w tablicach
+// i zapisywane przez sync_to_factory(); opoznienia i last_turn trafiaja do
+// metryk fabryki od razu.
+class FlatFactory {
+public:
+    static constexpr ElementID no_package = -1;
+
+    // Wariant petli wyznaczajacej robotnikow konczacych przetwarzanie w danej turze.
+    // Domyslny to najlepszy dostepny na biezacym procesorze.
+    enum class CompletionKernel {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+    static CompletionKernel best_kernel();
+    static bool kernel_supported(CompletionKernel kernel);
+
+    explicit FlatFactory(Factory& f);
+
+    void do_deliveries(Time t);
+    void do_package_passing(Time t);
+    void do_work(Time t);
+
+    void sync_to_factory() const;
+
+    std::size_t ramp_count() const { return ramp_di_.size(); }
+    std::size_t worker_count() const { return worker_pd_.size(); }
+    std::size_t storehouse_count() const { return storehouses_.size(); }
+
+    CompletionKernel kernel() const { return kernel_; }
+    void set_kernel(CompletionKernel kernel);
+
+private:
+    using mask_function = std::uint64_t (*)(const Time* due, std::size_t n, Time t);
+
+    // false, gdy wylosowany odbiorca jest pelny (polprodukt zostaje u nadawcy).
+    bool send(std::size_t sender, ElementID package, Time t);
+
+    FactoryMetrics& metrics_;
+    std::vector<Ramp*> ramps_;
+    std::vector<Worker*> workers_;
+    std::vector<Storehouse*> storehouses_;
+    // Puste bez NETSIM_METRICS.
+    std::vector<RampMetrics> ramp_metrics_;
+    std::vector<WorkerMetrics> worker_metrics_;
+    std::vector<std::uint64_t> link_traffic_;
+
+    std::vector<TimeOffset> ramp_di_;
+    std::vector<ElementID> ramp_buffer_;
+
+    // Robotnicy sa przetwarzani blokami po 64: worker_due_ to tura zakonczenia
+    // biezacego przetwarzania (idle_due dla wolnego robotnika), a bit w
+    // worker_waiting_ oznacza niepusta kolejke. Porownanie worker_due_ z tura
+    // daje maske bitowa zakonczen dla calego bloku.
+    static constexpr Time idle_due = std::numeric_limits<Time>::max();
+
+    CompletionKernel kernel_;
+    mask_function due_mask_;
+
+    std::vector<TimeOffset> worker_pd_;
+    std::vector<Time> worker_start_;
+    std::vector<Time> worker_due_;
+    std::vector<std::uint64_t> worker_waiting_;
+    std::vector<ElementID> worker_processing_;
+    std::vector<ElementID> worker_sending_;
+    std::vector<PackageQueueType> worker_queue_type_;
+    std::vector<RingBuffer<ElementID>> worker_queue_;
+    std::vector<std::size_t> worker_capacity_;
+    // Tura powstania polproduktu wg jego ID.
+    std::vector<Time> package_created_;
+
+
+    // Nadawcy: rampy [0, R), robotnicy [R, R + W).
+    // Odbiorcy: robotnicy [0, W), magazyny [W, W + S).
+    std::vector<std::uint32_t> link_offset_;
+    std::vector<std::uint32_t> link_target_;
+    std::vector<double> link_cumulative_;
+    std::vector<const ProbabilityGenerator*> sender_pg_;
+    std::vector<const CounterRng*> sender_rng_;  // nullptr - losowanie przez sender_pg_
+    std::vector<std::uint64_t> sender_stream_;
+    std::vector<std::uint64_t> sender_blocked_;
+};
+
+void simulate_flat(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf,
+                   std::function<bool(Time)> report_turns = {}, Time first_turn = 1);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef LAYOUT_HXX_
+#define LAYOUT_HXX_
+
+#include <vector>
+#include "factory.hxx"
+#include "types.hxx"
+
+// Kolejnosc robotnikow zgodna z przeplywem polproduktow: BFS po polaczeniach
+// od ramp (w kolejnosci ramp i ich preferencji), a po nim robotnicy
+// nieosiagalni z ramp w kolejnosci deklaracji. Sasiedzi w sieci trafiaja
+// blisko siebie, wiec wysylka do odbiorcy dotyka pamieci, ktora i tak jest
+// w pamieci podrecznej.
+std::vector<ElementID> locality_order(const Factory& f);
+
+// f.relayout_workers(locality_order(f)). Zmienia kolejnosc przetwarzania
+// robotnikow w do_work(), ale nie kolejnosc wysylki (losowan i przyjec
+// w kolejkach), raportow ani zapisu struktury - wyniki symulacji sa te same.
+void optimize_layout(Factory& f);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef MAPPED_FILE_HXX_
+#define MAPPED_FILE_HXX_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Plik zmapowany do pamieci tylko do odczytu.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return {data_, size_}; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+#endif
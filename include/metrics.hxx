@@ -0,0 +1,81 @@
+#ifndef METRICS_HXX_
+#define METRICS_HXX_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "types.hxx"
+
+// Metryki sa zbierane tylko w kompilacji z NETSIM_METRICS (opcja CMake o tej
+// samej nazwie); bez niej wszystkie aktualizacje znikaja w czasie kompilacji.
+#ifdef NETSIM_METRICS
+constexpr bool metrics_enabled = true;
+#else
+constexpr bool metrics_enabled = false;
+#endif
+
+// Histogram w stylu HDR: przedzialy potegowe podzielone na 16 rownych czesci,
+// wiec blad wzgledny kwantyla nie przekracza ok. 6%.
+class LatencyHistogram {
+public:
+    void record(std::uint64_t value);
+
+    std::uint64_t count() const { return count_; }
+    std::uint64_t sum() const { return sum_; }
+    std::uint64_t min() const { return count_ ? min_ : 0; }
+    std::uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+    std::uint64_t percentile(double q) const;
+
+    std::size_t bucket_count() const { return counts_.size(); }
+    std::uint64_t bucket_value(std::size_t i) const { return counts_[i]; }
+    static std::uint64_t bucket_upper_bound(std::size_t i);
+
+private:
+    static std::size_t bucket_of(std::uint64_t value);
+
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t min_ = UINT64_MAX;
+    std::uint64_t max_ = 0;
+};
+
+struct RampMetrics {
+    std::uint64_t delivered = 0;
+};
+
+struct WorkerMetrics {
+    std::uint64_t processed = 0;
+    std::uint64_t busy_turns = 0;
+    std::size_t queue_high_water = 0;
+};
+
+struct StorehouseMetrics {
+    std::uint64_t received = 0;
+    std::size_t stock_high_water = 0;
+};
+
+// Metryki calej fabryki: opoznienie rampa -> magazyn (w turach) liczone z tury
+// narodzin polproduktu zapamietanej pod jego ID. Wpis znika, gdy polprodukt
+// trafi do magazynu albo zostanie porzucony, wiec mapa obejmuje tylko zywe ID.
+struct FactoryMetrics {
+    Time last_turn = 0;
+    LatencyHistogram latency;
+    std::unordered_map<ElementID, Time> birth_turn;
+
+    void package_created(ElementID id, Time t) { birth_turn[id] = t; }
+
+    void package_stored(ElementID id, Time t) {
+        auto it = birth_turn.find(id);
+        if (it != birth_turn.end()) {
+            latency.record(static_cast<std::uint64_t>(t - it->second));
+            birth_turn.erase(it);
+        }
+    }
+
+    void package_dropped(ElementID id) { birth_turn.erase(id); }
+};
+
+#endif
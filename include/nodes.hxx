@@ -2,12 +2,19 @@
 #define NODES_HXX_
 
 #include <memory>
-#include <map>
+#include <functional>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+#include <utility>
 #include <optional>
+#include <variant>
 #include "types.hxx"
 #include "package.hxx"
 #include "storage_types.hxx"
 #include "helpers.hxx"
+#include "metrics.hxx"
+#include "counter_rng.hxx"
 
 enum class ReceiverType {
     WORKER,
@@ -17,8 +24,20 @@ enum class ReceiverType {
 class IPackageReceiver {
 public:
     virtual void receive_package(Package&& p) = 0;
+    // Wariant z numerem tury, w ktorej polprodukt dotarl (przekazuja go silniki symulacji).
+    virtual void receive_package(Package&& p, Time) { receive_package(std::move(p)); }
     virtual ElementID get_id() const = 0;
     virtual ReceiverType get_receiver_type() const = 0;
+    // false, gdy odbiorca ma pelne skladowisko - nadawca zatrzymuje wtedy polprodukt.
+    virtual bool can_receive_package() const { return true; }
+    // Ile polproduktow odbiorca przyjmie jeszcze w tej turze.
+    virtual std::size_t free_capacity() const { return can_receive_package() ? unbounded_capacity : 0; }
+    // Przyjmuje `count` polproduktow z `packages` naraz (partia z rampy).
+    virtual void receive_packages(Package* packages, std::size_t count, Time t) {
+        for (std::size_t k = 0; k < count; ++k) {
+            receive_package(std::move(packages[k]), t);
+        }
+    }
     
     using const_iterator = IPackageStockpile::const_iterator;
     virtual const_iterator cbegin() const = 0;
@@ -29,13 +48,45 @@ public:
     virtual ~IPackageReceiver() = default;
 };
 
+// Co magazyn zachowuje z przyjetych polproduktow: wszystkie, tylko ostatnie
+// window_size (starsze wracaja do puli ID) albo zaden - zostaja wtedy same
+// statystyki, a pamiec nie rosnie z czasem symulacji.
+enum class StorehouseRetention {
+    FULL,
+    WINDOW,
+    COUNT
+};
+
+// Statystyki przyjec, prowadzone w kazdym trybie.
+struct StorehouseStats {
+    std::uint64_t received = 0;
+    Time first_arrival = 0;  // 0 - brak przyjec ze znana tura
+    Time last_arrival = 0;
+    std::uint64_t arrival_turns = 0;  // liczba tur z co najmniej jednym przyjeciem
+};
+
 class Storehouse : public IPackageReceiver {
 public:
     Storehouse(ElementID id, std::unique_ptr<IPackageStockpile> d = std::make_unique<PackageQueue>(PackageQueueType::FIFO));
     
     void receive_package(Package&& p) override;
+    void receive_package(Package&& p, Time t) override;
     ElementID get_id() const override { return id_; }
     ReceiverType get_receiver_type() const override { return ReceiverType::STOREHOUSE; }
+    bool can_receive_package() const override { return !d_->full(); }
+    std::size_t free_capacity() const override { return d_->full() ? 0 : d_->capacity() - d_->size(); }
+
+    IPackageStockpile* get_queue() const { return d_.get(); }
+    void set_memory_resource(std::pmr::memory_resource* resource) { d_->set_memory_resource(resource); }
+    const StorehouseMetrics& get_metrics() const { return metrics_; }
+
+    // Okno liczone jest w kolejnosci przyjec (skladowisko FIFO); zmiana trybu
+    // od razu przycina obecny zapas.
+    void set_retention(StorehouseRetention retention, std::size_t window_size = 0);
+    StorehouseRetention get_retention() const { return retention_; }
+    std::size_t get_window_size() const { return window_size_; }
+    const StorehouseStats& get_stats() const { return stats_; }
+    void set_stats(const StorehouseStats& stats) { stats_ = stats; }
 
     const_iterator cbegin() const override { return d_->cbegin(); }
     const_iterator cend() const override { return d_->cend(); }
@@ -43,30 +94,123 @@ public:
     const_iterator end() const override { return d_->end(); }
 
 private:
+    void trim();
+
     ElementID id_;
     std::unique_ptr<IPackageStockpile> d_;
+    StorehouseRetention retention_ = StorehouseRetention::FULL;
+    std::size_t window_size_ = 0;
+    StorehouseStats stats_;
+    StorehouseMetrics metrics_;
+};
+
+class IPackageSender;
+
+// Powiadamiany o dodaniu/usunieciu polaczenia nadawca -> odbiorca.
+class ILinkObserver {
+public:
+    virtual void on_link_added(IPackageSender* sender, IPackageReceiver* receiver) = 0;
+    virtual void on_link_removed(IPackageSender* sender, IPackageReceiver* receiver) = 0;
+    virtual ~ILinkObserver() = default;
 };
 
+// Tablica skumulowanych prawdopodobienstw jest przeliczana leniwie, dopiero
+// przy pierwszym losowaniu po zmianie polaczen.
+// Odbiorcy sa trzymani w kolejnosci dodania (dawniej std::map - w kolejnosci
+// adresow), wiec przy tym samym ziarnie losowania moga wskazac innych odbiorcow
+// niz przed ta zmiana; za to nie zaleza od rozkladu pamieci.
 class ReceiverPreferences {
 public:
-    using preferences_t = std::map<IPackageReceiver*, double>;
+    using preferences_t = std::pmr::vector<std::pair<IPackageReceiver*, double>>;
     using const_iterator = preferences_t::const_iterator;
 
     ReceiverPreferences(ProbabilityGenerator pg = default_probability_generator);
+    // Kopia z tablicami w pamieci z `resource` (bez obserwatora).
+    ReceiverPreferences(const ReceiverPreferences& other, std::pmr::memory_resource* resource);
     
-    void add_receiver(IPackageReceiver* receiver);
+    void add_receiver(IPackageReceiver* receiver, double weight = 1.0);
     void remove_receiver(IPackageReceiver* receiver);
+    // Podmienia wskazniki przeniesionych w pamieci odbiorcow; obserwator nie
+    // jest powiadamiany (polaczenia logicznie sie nie zmieniaja).
+    void replace_receivers(const std::unordered_map<const IPackageReceiver*, IPackageReceiver*>& moved);
     IPackageReceiver* choose_receiver();
-    const preferences_t& get_preferences() const { return preferences_; }
+    // Z generatorem licznikowym losowanie zalezy tylko od (ziarna, tury,
+    // strumienia nadawcy, numeru losowania w turze); bez niego - jak choose_receiver().
+    IPackageReceiver* choose_receiver(Time t);
+    // Rozdziela `n` polproduktow miedzy odbiorcow (rozklad wielomianowy):
+    // counts[i] to liczba trafien i-tego odbiorcy z get_preferences(). Zuzywa
+    // najwyzej jedno losowanie na odbiorce (na kazde 512 polproduktow).
+    void choose_receivers(std::size_t n, Time t, std::vector<std::size_t>& counts);
+    const preferences_t& get_preferences() const;
+    const ProbabilityGenerator& get_probability_generator() const { return pg_; }
+    void set_probability_generator(ProbabilityGenerator pg) { pg_ = std::move(pg); }
+    void set_counter_rng(const CounterRng& rng, std::uint64_t stream) {
+        counter_rng_ = rng;
+        stream_ = stream;
+    }
+    const std::optional<CounterRng>& get_counter_rng() const { return counter_rng_; }
+    std::uint64_t get_stream() const { return stream_; }
+    // Przenosi wewnetrzne tablice do pamieci z podanego zrodla (areny fabryki).
+    void set_memory_resource(std::pmr::memory_resource* resource);
+    double get_weight(const IPackageReceiver* receiver) const;
+    // Liczba polproduktow wyslanych do odbiorcy (tylko z NETSIM_METRICS).
+    std::uint64_t get_traffic(const IPackageReceiver* receiver) const;
+    // Ruch liczony jest dopiero po przyjeciu polproduktu przez odbiorce, a nie
+    // przy losowaniu - zablokowany nadawca losuje co ture od nowa. Wersja bez
+    // indeksu dotyczy odbiorcy z ostatniego choose_receiver().
+    void count_delivered() {
+        if constexpr (metrics_enabled) {
+            ++traffic_[last_pick_];
+        }
+    }
+    void count_delivered(std::size_t index, std::size_t n) {
+        if constexpr (metrics_enabled) {
+            traffic_[index] += n;
+        }
+    }
+    // Ruch do i-tego odbiorcy z get_preferences() (silnik plaski liczy go u siebie).
+    std::uint64_t get_traffic(std::size_t index) const { return traffic_[index]; }
+    void set_traffic(std::size_t index, std::uint64_t n) { traffic_[index] = n; }
+
+    // Obserwator nie jest kopiowany razem z preferencjami.
+    void set_observer(ILinkObserver* observer, IPackageSender* owner) {
+        observer_.observer = observer;
+        observer_.owner = owner;
+    }
 
-    const_iterator begin() const { return preferences_.begin(); }
-    const_iterator end() const { return preferences_.end(); }
-    const_iterator cbegin() const { return preferences_.cbegin(); }
-    const_iterator cend() const { return preferences_.cend(); }
+    const_iterator begin() const { return get_preferences().begin(); }
+    const_iterator end() const { return get_preferences().end(); }
+    const_iterator cbegin() const { return get_preferences().cbegin(); }
+    const_iterator cend() const { return get_preferences().cend(); }
 
 private:
+    void rebuild() const;
+    double draw(Time t);
+    IPackageReceiver* pick(double p);
+
+    struct ObserverSlot {
+        ILinkObserver* observer = nullptr;
+        IPackageSender* owner = nullptr;
+
+        ObserverSlot() = default;
+        ObserverSlot(const ObserverSlot&) {}
+        ObserverSlot& operator=(const ObserverSlot&) { return *this; }
+    };
+
     ProbabilityGenerator pg_;
-    preferences_t preferences_;
+    std::optional<CounterRng> counter_rng_;
+    std::uint64_t stream_ = 0;
+    Time draw_turn_ = 0;
+    std::uint32_t draw_index_ = 0;
+    std::size_t last_pick_ = 0;
+    std::pmr::vector<IPackageReceiver*> receivers_;
+    std::pmr::vector<double> weights_;
+    std::pmr::vector<std::uint64_t> traffic_;
+
+    mutable preferences_t preferences_;
+    mutable std::pmr::vector<double> cumulative_;
+    mutable bool dirty_ = false;
+    ObserverSlot observer_;
 };
 
 class IPackageSender {
@@ -74,51 +218,121 @@ public:
     IPackageSender(ReceiverPreferences preferences = ReceiverPreferences()) 
         : receiver_preferences_(std::move(preferences)) {}
 
-    void send_package();
+    // Zwraca odbiorce, do ktorego trafil polprodukt (nullptr, gdy nic nie wyslano).
+    // Jesli wylosowany odbiorca jest pelny, polprodukt zostaje w buforze, a tura
+    // liczy sie jako zablokowana; w nastepnej turze odbiorca jest losowany od nowa.
+    IPackageReceiver* send_package();
+    // Jak wyzej, ale odbiorca losowany jest przez choose_receiver(t).
+    IPackageReceiver* send_package(Time t);
     virtual std::optional<Package>& get_sending_buffer() = 0;
+    virtual void set_memory_resource(std::pmr::memory_resource* resource) { receiver_preferences_.set_memory_resource(resource); }
     
     ReceiverPreferences receiver_preferences_; 
+
+    std::uint64_t get_blocked_turns() const { return blocked_turns_; }
+    void set_blocked_turns(std::uint64_t turns) { blocked_turns_ = turns; }
+    void count_blocked_turn() { ++blocked_turns_; }
     
     virtual ~IPackageSender() = default;
-protected:
-    void push_package(Package&& package);
+
+private:
+    // t == 0: tura nieznana (send_package() bez argumentu).
+    IPackageReceiver* pass_to(IPackageReceiver* receiver, Time t);
+
+    std::uint64_t blocked_turns_ = 0;
 };
 
 class Ramp : public IPackageSender {
 public:
-    Ramp(ElementID id, TimeOffset di);
+    // batch_size > 1: rampa dostarcza cala partie naraz i wysyla ja przez send_batch().
+    Ramp(ElementID id, TimeOffset di, std::size_t batch_size = 1);
     
     void deliver_goods(Time t);
     TimeOffset get_delivery_interval() const { return di_; }
+    std::size_t get_batch_size() const { return batch_size_; }
+    std::pmr::vector<Package>& get_batch() { return batch_; }
+    const std::pmr::vector<Package>& get_batch() const { return batch_; }
+
+    using Delivered = std::function<void(IPackageReceiver*, const Package*, std::size_t)>;
+    // Dzieli partie miedzy odbiorcow i przekazuje kazdemu jego czesc jednym
+    // receive_packages(). Czesc, ktora nie zmiescila sie u odbiorcy, zostaje
+    // w partii, a tura liczy sie jako zablokowana. on_delivered jest wolane
+    // przed przekazaniem polproduktow.
+    void send_batch(Time t, const Delivered& on_delivered = {});
+    // Jak send_batch(), ale czesc partii trafia do `sink(odbiorca, polprodukty, n)`,
+    // ktory przejmuje pierwsze k <= n polproduktow i zwraca k (silnik rownolegly
+    // kieruje je do skrzynek odbiorcow zamiast wprost do kolejek).
+    template <typename Sink>
+    void offer_batch(Time t, Sink&& sink);
     ElementID get_id() const { return id_; }
+    const RampMetrics& get_metrics() const { return metrics_; }
+    void set_metrics(const RampMetrics& metrics) { metrics_ = metrics; }
     
     std::optional<Package>& get_sending_buffer() override { return buffer_; }
+    void set_memory_resource(std::pmr::memory_resource* resource) override;
 
 private:
     ElementID id_;
     TimeOffset di_;
+    std::size_t batch_size_;
     std::optional<Package> buffer_;
+    std::pmr::vector<Package> batch_;
+    std::vector<std::size_t> counts_;
+    RampMetrics metrics_;
 };
 
+template <typename Sink>
+void Ramp::offer_batch(Time t, Sink&& sink) {
+    if (batch_.empty()) {
+        return;
+    }
+    receiver_preferences_.choose_receivers(batch_.size(), t, counts_);
+    const auto& prefs = receiver_preferences_.get_preferences();
+    std::size_t sent = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+        if (counts_[i] > 0) {
+            std::size_t k = sink(prefs[i].first, batch_.data() + sent, counts_[i]);
+            receiver_preferences_.count_delivered(i, k);
+            sent += k;
+        }
+    }
+    batch_.erase(batch_.begin(), batch_.begin() + static_cast<std::ptrdiff_t>(sent));
+    if (!batch_.empty()) {
+        count_blocked_turn();
+    }
+}
+
 class Worker : public IPackageReceiver, public IPackageSender {
 public:
     Worker(ElementID id, TimeOffset pd, std::unique_ptr<IPackageStockpile> q);
+    // Przenosi robotnika do swiezej pamieci z `resource`. Stary obiekt zachowuje
+    // swoje bufory do zniszczenia, wiec nowe nie trafiaja w wlasnie zwolnione bloki.
+    Worker(Worker& other, std::pmr::memory_resource* resource);
     
     const std::optional<Package>& get_processing_buffer() const { return processing_buffer_; }
+    std::optional<Package>& get_processing_buffer() { return processing_buffer_; }
     
+    using IPackageReceiver::receive_package;
     void receive_package(Package&& p) override;
     ElementID get_id() const override { return id_; }
     ReceiverType get_receiver_type() const override { return ReceiverType::WORKER; }
+    bool can_receive_package() const override;
+    std::size_t free_capacity() const override;
+    void receive_packages(Package* packages, std::size_t count, Time t) override;
 
     void do_work(Time t);
     
     TimeOffset get_processing_duration() const { return pd_; }
     Time get_package_processing_start_time() const { return t_; }
+    void set_package_processing_start_time(Time t) { t_ = t; }
     
     // Metoda wymagana przez testy
     IPackageStockpile* get_queue() const { return q_.get(); }
+    const WorkerMetrics& get_metrics() const { return metrics_; }
+    void set_metrics(const WorkerMetrics& metrics) { metrics_ = metrics; }
 
     std::optional<Package>& get_sending_buffer() override { return sending_buffer_; }
+    void set_memory_resource(std::pmr::memory_resource* resource) override;
 
     const_iterator cbegin() const override { return q_->cbegin(); }
     const_iterator cend() const override { return q_->cend(); }
@@ -126,13 +340,29 @@ public:
     const_iterator end() const override { return q_->end(); }
 
 private:
+    // Goraca sciezka: dla PackageQueue wywolanie trafia wprost do konkretnej
+    // BasicQueue (std::visit), dla innych skladowisk - przez interfejs.
+    template <typename F>
+    decltype(auto) with_queue(F&& f) const {
+        if (queues_) {
+            return std::visit(std::forward<F>(f), *queues_);
+        }
+        return f(*q_);
+    }
+    static PackageQueue::queues_t* queues_of(IPackageStockpile* q) {
+        auto* pq = dynamic_cast<PackageQueue*>(q);
+        return pq ? &pq->queues() : nullptr;
+    }
+
     ElementID id_;
     TimeOffset pd_; 
     Time t_ = 0;    
     
     std::unique_ptr<IPackageStockpile> q_;
+    PackageQueue::queues_t* queues_;
     std::optional<Package> processing_buffer_;
     std::optional<Package> sending_buffer_;
+    WorkerMetrics metrics_;
 };
 
 #endif
\ No newline at end of file
@@ -2,18 +2,26 @@
 #define PACKAGE_HXX_
 
 #include "types.hxx"
-#include <set>
 #include <utility>
 
+class PackageIdAllocator;
+
+// Polprodukt oddaje ID tej puli, z ktorej je otrzymal - takze gdy ginie poza
+// PackageIdAllocator::Scope, w ktorym powstal (np. w innym watku).
 class Package {
 public:
     Package();
-    explicit Package(ElementID id);
+    explicit Package(ElementID id, Time created = 0);
     
     Package(Package&& other) noexcept;
     Package& operator=(Package&& other) noexcept;
 
     ElementID get_id() const { return id_; }
+    // Tura dostarczenia przez rampe; wg niej kolejka AGE wybiera najstarszy polprodukt.
+    Time get_creation_time() const { return created_; }
+    void set_creation_time(Time t) { created_ = t; }
+    // Oddaje ID bez zwracania go do puli (przejecie przez inna reprezentacje stanu).
+    ElementID release() noexcept { return std::exchange(id_, -1); }
 
     ~Package();
 
@@ -22,8 +30,11 @@ public:
 
 private:
     ElementID id_;
-    static std::set<ElementID> freed_ids_;
-    static ElementID assigned_ids_;
+    Time created_ = 0;
+    PackageIdAllocator* owner_;
 };
 
-#endif
\ No newline at end of file
+// ID, tura utworzenia i pula: 16 bajtow na polprodukt w kolejce (wczesniej 4).
+static_assert(sizeof(Package) <= 2 * sizeof(void*), "Package should stay two words wide");
+
+#endif
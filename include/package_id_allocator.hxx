@@ -0,0 +1,82 @@
+#ifndef PACKAGE_ID_ALLOCATOR_HXX_
+#define PACKAGE_ID_ALLOCATOR_HXX_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "types.hxx"
+
+enum class IdAllocationMode {
+    SMALLEST_FREE, // najmniejsze wolne ID (dotychczasowa semantyka raportow)
+    MONOTONIC,     // kolejne ID bez ponownego uzycia, bez blokad
+    POOLED         // ponowne uzycie przez lokalne bufory watkow, bez gwarancji kolejnosci
+};
+
+// Przydzial ID polproduktow. Zwolnione ID trafiaja do bitmapy, z ktorej tryb
+// SMALLEST_FREE zawsze wybiera najmniejsze, a tryb POOLED pobiera je porcjami
+// do bufora biezacego watku.
+class PackageIdAllocator {
+public:
+    explicit PackageIdAllocator(IdAllocationMode mode = IdAllocationMode::SMALLEST_FREE);
+
+    ElementID allocate();
+    void release(ElementID id);
+    // ID nadane recznie (Package(ElementID)) nie moze zostac pozniej wydane z licznika.
+    void reserve(ElementID id);
+
+    // Stan puli (np. do zapisu migawki symulacji).
+    struct State {
+        IdAllocationMode mode = IdAllocationMode::SMALLEST_FREE;
+        ElementID next = 1;
+        std::vector<ElementID> free_ids;
+    };
+    State save_state();
+    void restore_state(const State& state);
+    // Przenosi do `out` wszystkie zwolnione ID i oproznia z nich pule (np. zeby
+    // oddac je puli w innym procesie).
+    void take_free(std::vector<ElementID>& out);
+
+    IdAllocationMode get_mode() const { return mode_; }
+    // Zmiana trybu powinna nastepowac miedzy symulacjami.
+    void set_mode(IdAllocationMode mode);
+
+    static PackageIdAllocator& global();
+    static PackageIdAllocator& current();
+
+    // Na czas zycia obiektu current() w biezacym watku zwraca podana pule
+    // (np. osobna przestrzen ID dla kazdej replikacji symulacji).
+    class Scope {
+    public:
+        explicit Scope(PackageIdAllocator& allocator);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        PackageIdAllocator* previous_;
+    };
+
+private:
+    struct Pool {
+        std::mutex mutex;
+        std::vector<std::uint64_t> free_bits;
+        std::size_t first_word = 0;
+        std::size_t free_count = 0;
+        std::atomic<ElementID> next{1};
+
+        bool take_smallest(ElementID& id);
+        void put(ElementID id);
+    };
+
+    struct ThreadCache;
+    ThreadCache& thread_cache();
+
+    IdAllocationMode mode_;
+    std::uint64_t instance_;
+    std::shared_ptr<Pool> pool_;
+};
+
+#endif
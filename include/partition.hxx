@@ -0,0 +1,27 @@
+#ifndef PARTITION_HXX_
+#define PARTITION_HXX_
+
+#include <cstddef>
+#include <vector>
+#include "factory.hxx"
+
+// Podzial odbiorcow fabryki (robotnicy, potem magazyny - w kolejnosci kolekcji)
+// na k czesci o zblizonej liczbie wezlow, z mozliwie malo polaczeniami LINK
+// miedzy czesciami. Rampa trafia do czesci, w ktorej jest najwiecej jej
+// odbiorcow (nie wlicza sie do rownowagi).
+//
+// Heurystyka: poczatkowy podzial na rowne odcinki kolejnosci BFS od ramp
+// (sasiedzi trafiaja zwykle do tej samej czesci), a potem kilka przebiegow
+// zachlannego przenoszenia wezlow brzegowych, o ile zmniejsza to przekroj i nie
+// narusza rownowagi (+-10%).
+struct FactoryPartition {
+    std::size_t parts = 1;
+    std::vector<std::size_t> worker_part;
+    std::vector<std::size_t> storehouse_part;
+    std::vector<std::size_t> ramp_part;
+    std::size_t cut = 0;  // liczba polaczen miedzy roznymi czesciami
+};
+
+FactoryPartition partition_factory(const Factory& f, std::size_t parts);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef REPLICATION_HXX_
+#define REPLICATION_HXX_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "factory.hxx"
+#include "types.hxx"
+
+// Wiele niezaleznych przebiegow (replikacji) tej samej sieci w jednym procesie.
+// Kazda replikacja dostaje wlasna kopie fabryki (wczytana ze struktury, czyli z
+// pustymi kolejkami), wlasny generator mt19937 i wlasna pule ID polproduktow,
+// wiec replikacje moga biec rownolegle, a wynik zalezy tylko od ziarna. Gdy
+// zrodlo losuje generatorem licznikowym, replikacje tez (z ziarnem replikacji).
+struct ReplicationOptions {
+    std::size_t replicas = 100;
+    TimeOffset rounds = 100;
+    std::uint64_t base_seed = 1;
+    std::size_t threads = 0;
+};
+
+struct ReplicaResult {
+    std::uint64_t seed = 0;
+    std::size_t stored = 0;          // polprodukty przyjete przez magazyny (w kazdym trybie retencji)
+    double throughput = 0.0;         // stored / rounds
+    double mean_queue_length = 0.0;  // srednia po turach i robotnikach
+    std::size_t max_queue_length = 0;
+};
+
+// Srednia z 95% przedzialem ufnosci (rozklad t-Studenta).
+struct Estimate {
+    double mean = 0.0;
+    double stddev = 0.0;
+    double ci_low = 0.0;
+    double ci_high = 0.0;
+};
+
+struct ReplicationSummary {
+    std::vector<ReplicaResult> replicas;
+    Estimate throughput;
+    Estimate mean_queue_length;
+    Estimate max_queue_length;
+};
+
+// Ziarno replikacji i; to samo niezaleznie od liczby watkow.
+std::uint64_t replica_seed(std::uint64_t base_seed, std::size_t i);
+
+Estimate estimate_mean(const std::vector<double>& samples);
+
+ReplicationSummary run_replications(const Factory& f, const ReplicationOptions& options);
+
+#endif
@@ -3,8 +3,11 @@
 
 #include "factory.hxx"
 #include "types.hxx"
+#include <cstddef>
+#include <cstdint>
 #include <set>
 #include <iostream>
+#include <vector>
 
 class SpecificTurnsReportNotifier {
 public:
@@ -26,4 +29,126 @@ void generate_structure_report(const Factory& f, std::ostream& os);
 
 void generate_simulation_turn_report(const Factory& f, std::ostream& os, Time t);
 
+// Rozmiar i licznik przyjec kazdego magazynu z poprzedniego ujecia; pozwala
+// kolejnemu ujeciu zapisac tylko przyrost zapasu.
+class StockCursor {
+private:
+    friend struct TurnState;
+
+    struct Entry {
+        const Storehouse* store;
+        ElementID id;
+        std::uint64_t received;
+        std::size_t size;
+    };
+    std::vector<Entry> entries_;
+};
+
+// Stan fabryki potrzebny do raportu tury, w plaskich tablicach. Ponowne
+// capture() korzysta z juz zaalokowanej pamieci.
+struct TurnState {
+    static constexpr ElementID no_package = -1;
+
+    struct WorkerState {
+        ElementID id;
+        ElementID processing;
+        Time pt;
+        std::size_t queue_begin;
+        std::size_t queue_end;
+    };
+
+    // Caly zapas (complete) albo przyrost od poprzedniego ujecia: z poczatku
+    // ubylo `dropped` polproduktow, a na koniec doszly [stock_begin, stock_end).
+    struct StorehouseState {
+        ElementID id;
+        std::size_t stock_begin;
+        std::size_t stock_end;
+        std::size_t dropped = 0;
+        bool complete = true;
+    };
+
+    Time turn = 0;
+    std::vector<WorkerState> workers;
+    std::vector<StorehouseState> storehouses;
+    std::vector<ElementID> packages;
+
+    void capture(const Factory& f, Time t);
+    // Magazyny jako przyrosty wzgledem poprzedniego ujecia z tym samym kursorem
+    // (pelny zapas, gdy przyrostu nie da sie wyznaczyc). Takie ujecia trzeba
+    // przekazywac do jednego TurnReportWriter w kolejnosci ujec.
+    void capture(const Factory& f, Time t, StockCursor& cursor);
+
+private:
+    void capture_workers(const Factory& f, Time t);
+};
+
+enum class ReportFormat {
+    TEXT,   // jak generate_simulation_turn_report
+    CSV,    // turn,kind,id,pbuffer,pt,packages - wiersz na wezel
+    BINARY  // rekordy o stalej szerokosci pol (int32/uint32)
+};
+
+// Pisze raporty tur przez wlasny bufor (std::to_chars zamiast operator<<).
+// W trybie delta wypisywane sa tylko wezly zmienione od poprzedniego raportu;
+// magazyn, do ktorego jedynie dolozono polprodukty, wypisuje tylko nowe.
+class TurnReportWriter {
+public:
+    explicit TurnReportWriter(std::ostream& os, ReportFormat format = ReportFormat::TEXT, bool delta = false);
+    ~TurnReportWriter();
+
+    TurnReportWriter(const TurnReportWriter&) = delete;
+    TurnReportWriter& operator=(const TurnReportWriter&) = delete;
+
+    void write(const Factory& f, Time t);
+    void write(const TurnState& state);
+    void flush();
+
+private:
+    void write_text(const TurnState& state, const TurnState* previous);
+    void write_csv(const TurnState& state, const TurnState* previous);
+    void write_binary(const TurnState& state, const TurnState* previous);
+
+    // false, gdy n bajtow nie zmiesci sie nawet w pustym buforze.
+    bool reserve(std::size_t n);
+    void put(std::string_view s);
+    void put(long long value);
+    template <typename T>
+    void put_raw(T value);
+
+    std::ostream& os_;
+    ReportFormat format_;
+    bool delta_;
+    bool header_written_ = false;
+    bool has_previous_ = false;
+    std::vector<char> buffer_;
+    std::size_t used_ = 0;
+    TurnState current_;
+    TurnState previous_;
+    StockCursor cursor_;
+
+    // Biezacy zapas magazynow odtworzony z kolejnych ujec.
+    struct Stock {
+        ElementID id = TurnState::no_package;
+        std::vector<ElementID> ids;
+    };
+    // Co wypisac z magazynu: changed - zapas rozni sie od poprzedniego raportu,
+    // from - pierwszy polprodukt do wypisania (za poprzednim zapasem, gdy tylko dolozono).
+    struct StockChange {
+        bool changed;
+        std::size_t from;
+    };
+    void update_stocks(const TurnState& state, bool has_previous);
+    std::vector<Stock> stocks_;
+    std::vector<StockChange> stock_changes_;
+    std::vector<ElementID> scratch_;
+};
+
+enum class MetricsFormat {
+    JSON,
+    PROMETHEUS  // format tekstowy ekspozycji Prometheusa
+};
+
+// Zrzut metryk zebranych od poczatku symulacji (puste liczniki bez NETSIM_METRICS).
+void generate_metrics_report(const Factory& f, std::ostream& os, MetricsFormat format = MetricsFormat::JSON);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+#ifndef RING_BUFFER_HXX_
+#define RING_BUFFER_HXX_
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+// Rosnacy bufor cykliczny (deque) bez alokacji na element. Pojemnosc jest
+// zawsze potega dwojki, wiec pozycje fizyczna wyznacza maska. Pamiec pochodzi
+// z podanego memory_resource (domyslnie z globalnego).
+template <class T>
+class RingBuffer {
+public:
+    RingBuffer() = default;
+    explicit RingBuffer(std::pmr::memory_resource* resource) : resource_(resource) {}
+    ~RingBuffer() { release(); }
+
+    RingBuffer(RingBuffer&& other) noexcept
+        : resource_(other.resource_), buf_(std::exchange(other.buf_, nullptr)), cap_(std::exchange(other.cap_, 0)),
+          head_(std::exchange(other.head_, 0)), size_(std::exchange(other.size_, 0)) {}
+
+    RingBuffer& operator=(RingBuffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            resource_ = other.resource_;
+            buf_ = std::exchange(other.buf_, nullptr);
+            cap_ = std::exchange(other.cap_, 0);
+            head_ = std::exchange(other.head_, 0);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    void push_back(T&& value) {
+        if (size_ == cap_) {
+            grow();
+        }
+        ::new (static_cast<void*>(buf_ + ((head_ + size_) & (cap_ - 1)))) T(std::move(value));
+        ++size_;
+    }
+
+    // Po wywolaniu push_back nie alokuje, dopoki rozmiar nie przekroczy n.
+    void reserve(std::size_t n) {
+        if (n > cap_) {
+            std::size_t new_cap = cap_ ? cap_ : 8;
+            while (new_cap < n) {
+                new_cap *= 2;
+            }
+            reallocate(new_cap, *this);
+        }
+    }
+
+    T pop_front() {
+        T& slot = buf_[head_];
+        T value(std::move(slot));
+        slot.~T();
+        head_ = (head_ + 1) & (cap_ - 1);
+        --size_;
+        return value;
+    }
+
+    T pop_back() {
+        T& slot = buf_[(head_ + size_ - 1) & (cap_ - 1)];
+        T value(std::move(slot));
+        slot.~T();
+        --size_;
+        return value;
+    }
+
+    void clear() {
+        for (std::size_t i = 0; i < size_; ++i) {
+            (*this)[i].~T();
+        }
+        head_ = 0;
+        size_ = 0;
+    }
+
+    T& operator[](std::size_t i) { return buf_[(head_ + i) & (cap_ - 1)]; }
+    const T& operator[](std::size_t i) const { return buf_[(head_ + i) & (cap_ - 1)]; }
+
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return cap_; }
+
+    std::pmr::memory_resource* memory_resource() const { return resource_; }
+
+    // Przenosi zawartosc do pamieci z innego zrodla.
+    void set_memory_resource(std::pmr::memory_resource* resource) {
+        if (resource == resource_) {
+            return;
+        }
+        RingBuffer other(resource);
+        if (size_) {
+            other.reallocate(cap_, *this);
+        }
+        *this = std::move(other);
+    }
+
+    const T* data() const { return buf_; }
+    std::size_t mask() const { return cap_ ? cap_ - 1 : 0; }
+    std::size_t head() const { return head_; }
+
+private:
+    void grow() {
+        reallocate(cap_ ? cap_ * 2 : 8, *this);
+    }
+
+    // Nowy bufor o pojemnosci new_cap z elementami przeniesionymi z source.
+    void reallocate(std::size_t new_cap, RingBuffer& source) {
+        T* new_buf = static_cast<T*>(resource_->allocate(new_cap * sizeof(T), alignof(T)));
+        std::size_t n = source.size_;
+        for (std::size_t i = 0; i < n; ++i) {
+            T& slot = source[i];
+            ::new (static_cast<void*>(new_buf + i)) T(std::move(slot));
+            slot.~T();
+        }
+        source.head_ = 0;
+        source.size_ = 0;
+        if (buf_) {
+            resource_->deallocate(buf_, cap_ * sizeof(T), alignof(T));
+        }
+        buf_ = new_buf;
+        cap_ = new_cap;
+        head_ = 0;
+        size_ = n;
+    }
+
+    void release() {
+        clear();
+        if (buf_) {
+            resource_->deallocate(buf_, cap_ * sizeof(T), alignof(T));
+            buf_ = nullptr;
+            cap_ = 0;
+        }
+    }
+
+    std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+    T* buf_ = nullptr;
+    std::size_t cap_ = 0;
+    std::size_t head_ = 0;
+    std::size_t size_ = 0;
+};
+
+#endif
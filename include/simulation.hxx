@@ -3,8 +3,23 @@
 
 #include "factory.hxx"
 #include "types.hxx"
+#include <cstddef>
 #include <functional>
 
-void simulate(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf);
+// Symuluje tury first_turn..rounds (first_turn > 1 pozwala wznowic symulacje z migawki).
+void simulate(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf, Time first_turn = 1);
 
-#endif
\ No newline at end of file
+// Wielowatkowy wariant simulate(); dla tego samego ziarna daje identyczny wynik.
+// threads == 0 oznacza liczbe rdzeni maszyny.
+void simulate_parallel(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf, std::size_t threads = 0,
+                       Time first_turn = 1);
+
+// Wariant zdarzeniowy: w turze obslugiwane sa tylko wezly, ktore maja cos do
+// zrobienia (dostawa, wysylka, pobranie z kolejki, koniec przetwarzania), a
+// tury bez takich wezlow sa pomijane. rf jest wolane tylko w turach,
+// dla ktorych report_turns zwraca true (pusty predykat - w kazdej turze).
+// Zwraca liczbe tur, w ktorych silnik obslugiwal wezly.
+std::size_t simulate_event_driven(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf,
+                                  std::function<bool(Time)> report_turns = {});
+
+#endif
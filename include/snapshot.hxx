@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_HXX_
+#define SNAPSHOT_HXX_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include "factory.hxx"
+#include "types.hxx"
+
+// Binarna migawka symulacji: struktura fabryki, pelny stan wezlow (kolejki,
+// bufory, czasy rozpoczecia przetwarzania), stan puli ID polproduktow oraz
+// stan globalnego generatora rng. Wczytanie migawki przywraca takze pule ID
+// biezacego watku i rng, wiec symulacje mozna wznowic od tury turn + 1.
+// Wersja 5 zapisuje przy kazdym polprodukcie ture jego powstania, a wersja 6
+// takze ziarno generatora licznikowego (Factory::enable_counter_rng).
+constexpr std::uint32_t snapshot_version = 6;
+
+struct Snapshot {
+    Factory factory;
+    Time turn = 0;
+};
+
+void save_snapshot(const Factory& f, Time turn, std::ostream& os);
+void save_snapshot_file(const Factory& f, Time turn, const std::string& path);
+
+Snapshot load_snapshot(std::string_view data);
+Snapshot load_snapshot_file(const std::string& path);
+
+#endif
@@ -1,24 +1,89 @@
 #ifndef STORAGE_TYPES_HXX_
 #define STORAGE_TYPES_HXX_
 
-#include <list>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <utility>
+#include <variant>
 #include "package.hxx"
+#include "ring_buffer.hxx"
 
 enum class PackageQueueType {
     FIFO,
-    LIFO
+    LIFO,
+    AGE     // najpierw najstarszy polprodukt (najwczesniejsza tura powstania)
 };
 
+// Iterator po polproduktach skladowiska. Opisuje zarowno bufor cykliczny
+// (maska = pojemnosc - 1), jak i ciagla tablice (maska z samych jedynek).
+class StockpileIterator {
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = Package;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Package*;
+    using reference = const Package&;
+
+    StockpileIterator() = default;
+    StockpileIterator(const Package* buf, std::size_t mask, std::size_t pos) : buf_(buf), mask_(mask), pos_(pos) {}
+
+    reference operator*() const { return buf_[pos_ & mask_]; }
+    pointer operator->() const { return &buf_[pos_ & mask_]; }
+    reference operator[](difference_type n) const { return buf_[(pos_ + n) & mask_]; }
+
+    StockpileIterator& operator++() { ++pos_; return *this; }
+    StockpileIterator operator++(int) { auto tmp = *this; ++pos_; return tmp; }
+    StockpileIterator& operator--() { --pos_; return *this; }
+    StockpileIterator operator--(int) { auto tmp = *this; --pos_; return tmp; }
+    StockpileIterator& operator+=(difference_type n) { pos_ += n; return *this; }
+    StockpileIterator& operator-=(difference_type n) { pos_ -= n; return *this; }
+
+    friend StockpileIterator operator+(StockpileIterator it, difference_type n) { return it += n; }
+    friend StockpileIterator operator+(difference_type n, StockpileIterator it) { return it += n; }
+    friend StockpileIterator operator-(StockpileIterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const StockpileIterator& a, const StockpileIterator& b) {
+        return static_cast<difference_type>(a.pos_ - b.pos_);
+    }
+
+    friend bool operator==(const StockpileIterator& a, const StockpileIterator& b) { return a.pos_ == b.pos_; }
+    friend bool operator!=(const StockpileIterator& a, const StockpileIterator& b) { return a.pos_ != b.pos_; }
+    friend bool operator<(const StockpileIterator& a, const StockpileIterator& b) { return a.pos_ < b.pos_; }
+    friend bool operator>(const StockpileIterator& a, const StockpileIterator& b) { return a.pos_ > b.pos_; }
+    friend bool operator<=(const StockpileIterator& a, const StockpileIterator& b) { return a.pos_ <= b.pos_; }
+    friend bool operator>=(const StockpileIterator& a, const StockpileIterator& b) { return a.pos_ >= b.pos_; }
+
+private:
+    const Package* buf_ = nullptr;
+    std::size_t mask_ = 0;
+    std::size_t pos_ = 0;
+};
+
+// Pojemnosc skladowiska bez limitu.
+constexpr std::size_t unbounded_capacity = SIZE_MAX;
+
 class IPackageStockpile {
 public:
-    using const_iterator = std::list<Package>::const_iterator;
+    using const_iterator = StockpileIterator;
 
     virtual void push(Package&& package) = 0;
     virtual bool empty() const = 0;
     virtual std::size_t size() const = 0;
     virtual std::optional<Package> pop() = 0; 
     virtual PackageQueueType get_queue_type() const = 0;
+    // Limit sprawdzaja nadawcy przed wyslaniem; push() go nie egzekwuje.
+    virtual std::size_t capacity() const { return unbounded_capacity; }
+    bool full() const { return size() >= capacity(); }
+    // Skladowisko moze przeniesc swoja pamiec do areny fabryki i zarezerwowac
+    // miejsce z wyprzedzeniem; domyslnie obie operacje nic nie robia.
+    virtual void set_memory_resource(std::pmr::memory_resource*) {}
+    virtual void reserve(std::size_t) {}
+    // Tworzy rownowazne skladowisko w swiezej pamieci z `resource`, zabierajac
+    // polprodukty; stara pamiec zwalnia dopiero destruktor tego obiektu.
+    virtual std::unique_ptr<IPackageStockpile> relocate(std::pmr::memory_resource* resource) = 0;
     virtual ~IPackageStockpile() = default;
     
     virtual const_iterator cbegin() const = 0;
@@ -29,25 +94,111 @@ public:
 
 using IPackageQueue = IPackageStockpile;
 
+// Polityki kolejki dla BasicQueue. Dzialaja na buforze polproduktow albo
+// samych ID (FlatFactory), wiec push/pop sa szablonami.
+struct FifoPolicy {
+    static constexpr PackageQueueType type = PackageQueueType::FIFO;
+    template <class T> static void push(RingBuffer<T>& q, T&& value) { q.push_back(std::move(value)); }
+    template <class T> static T pop(RingBuffer<T>& q) { return q.pop_front(); }
+};
+
+struct LifoPolicy {
+    static constexpr PackageQueueType type = PackageQueueType::LIFO;
+    template <class T> static void push(RingBuffer<T>& q, T&& value) { q.push_back(std::move(value)); }
+    template <class T> static T pop(RingBuffer<T>& q) { return q.pop_back(); }
+};
+
+// Bufor jest posortowany wg tury powstania polproduktu, a przy rownych turach
+// wg kolejnosci przybycia. Nowe polprodukty sa zwykle najmlodsze, wiec
+// wstawianie przez przesuwanie od konca konczy sie od razu.
+struct AgePriorityPolicy {
+    static constexpr PackageQueueType type = PackageQueueType::AGE;
+    static void push(RingBuffer<Package>& q, Package&& value) {
+        push(q, std::move(value), [](const Package& p) { return p.get_creation_time(); });
+    }
+    // Kolejka samych ID (FlatFactory) podaje ture powstania przez `created(id)`.
+    template <class T, class Created> static void push(RingBuffer<T>& q, T&& value, Created&& created) {
+        q.push_back(std::move(value));
+        for (std::size_t i = q.size() - 1; i > 0 && created(q[i - 1]) > created(q[i]); --i) {
+            std::swap(q[i - 1], q[i]);
+        }
+    }
+    template <class T> static T pop(RingBuffer<T>& q) { return q.pop_front(); }
+};
+
+// Kolejka bez metod wirtualnych; polityka wybierana jest w czasie kompilacji.
+template <class Policy>
+class BasicQueue {
+public:
+    using const_iterator = StockpileIterator;
+
+    explicit BasicQueue(std::size_t capacity = unbounded_capacity) : capacity_(capacity) {}
+
+    void push(Package&& package) { Policy::push(queue_, std::move(package)); }
+    std::optional<Package> pop() {
+        if (queue_.empty()) {
+            return std::nullopt;
+        }
+        return Policy::pop(queue_);
+    }
+    bool empty() const { return queue_.empty(); }
+    std::size_t size() const { return queue_.size(); }
+    std::size_t capacity() const { return capacity_; }
+    bool full() const { return size() >= capacity_; }
+    static constexpr PackageQueueType get_queue_type() { return Policy::type; }
+
+    void set_memory_resource(std::pmr::memory_resource* resource) { queue_.set_memory_resource(resource); }
+    void reserve(std::size_t n) { queue_.reserve(n); }
+    // Przejmuje polprodukty z `other` w tej samej kolejnosci.
+    void take_all(BasicQueue& other) {
+        while (!other.queue_.empty()) {
+            queue_.push_back(other.queue_.pop_front());
+        }
+    }
+
+    const_iterator cbegin() const { return const_iterator(queue_.data(), queue_.mask(), queue_.head()); }
+    const_iterator cend() const { return const_iterator(queue_.data(), queue_.mask(), queue_.head() + queue_.size()); }
+    const_iterator begin() const { return cbegin(); }
+    const_iterator end() const { return cend(); }
+
+private:
+    RingBuffer<Package> queue_;
+    std::size_t capacity_;
+};
+
+using FifoQueue = BasicQueue<FifoPolicy>;
+using LifoQueue = BasicQueue<LifoPolicy>;
+using AgePriorityQueue = BasicQueue<AgePriorityPolicy>;
+
+// Adapter rodziny BasicQueue do IPackageStockpile; rodzaj kolejki wybierany
+// jest przy tworzeniu. Robotnik siega po queues() i odwiedza wariant
+// bezposrednio, bez wywolan wirtualnych.
 class PackageQueue : public IPackageStockpile {
 public:
-    explicit PackageQueue(PackageQueueType type) : queue_type_(type) {}
+    using queues_t = std::variant<FifoQueue, LifoQueue, AgePriorityQueue>;
+
+    explicit PackageQueue(PackageQueueType type, std::size_t capacity = unbounded_capacity);
 
     void push(Package&& package) override;
     bool empty() const override;
     std::size_t size() const override;
     std::optional<Package> pop() override;
     
-    PackageQueueType get_queue_type() const override { return queue_type_; }
+    PackageQueueType get_queue_type() const override;
+    std::size_t capacity() const override;
+    void set_memory_resource(std::pmr::memory_resource* resource) override;
+    void reserve(std::size_t n) override;
+    std::unique_ptr<IPackageStockpile> relocate(std::pmr::memory_resource* resource) override;
+
+    queues_t& queues() { return queues_; }
 
-    const_iterator cbegin() const override { return queue_.cbegin(); }
-    const_iterator cend() const override { return queue_.cend(); }
-    const_iterator begin() const override { return queue_.begin(); }
-    const_iterator end() const override { return queue_.end(); }
+    const_iterator cbegin() const override;
+    const_iterator cend() const override;
+    const_iterator begin() const override { return cbegin(); }
+    const_iterator end() const override { return cend(); }
 
 private:
-    std::list<Package> queue_;
-    PackageQueueType queue_type_;
+    queues_t queues_;
 };
 
-#endif
\ No newline at end of file
+#endif
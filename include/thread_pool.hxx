@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_HXX_
+#define THREAD_POOL_HXX_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pula watkow dla petli "parallel for". Kazdy uczestnik (takze watek wywolujacy)
+// dostaje wlasny zakres indeksow, a po jego wyczerpaniu podkrada porcje z
+// zakresow pozostalych uczestnikow.
+class ThreadPool {
+public:
+    using range_function = std::function<void(std::size_t, std::size_t)>;
+
+    explicit ThreadPool(std::size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const { return workers_.size() + 1; }
+
+    void parallel_for(std::size_t n, std::size_t grain, const range_function& f);
+
+private:
+    struct alignas(64) Range {
+        std::atomic<std::size_t> next{0};
+        std::size_t end = 0;
+    };
+
+    void worker_loop(std::size_t participant);
+    void run_participant(std::size_t participant);
+
+    std::vector<std::thread> workers_;
+    std::unique_ptr<Range[]> ranges_;
+
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    std::size_t generation_ = 0;
+    std::size_t pending_ = 0;
+    bool stop_ = false;
+
+    const range_function* job_ = nullptr;
+    std::size_t grain_ = 1;
+    std::exception_ptr error_;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef TOPOLOGY_HXX_
+#define TOPOLOGY_HXX_
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "nodes.hxx"
+
+enum class NodeKind {
+    RAMP,
+    WORKER,
+    STOREHOUSE
+};
+
+// Graf polaczen fabryki z lista sasiedztwa w obie strony oraz flagami
+// osiagalnosci: "osiagalny z rampy" i "prowadzi do magazynu". Dodanie wezla lub
+// polaczenia aktualizuje flagi przyrostowo (tylko dla wezlow, ktorych dotyczy
+// zmiana); usuniecie oznacza je do przeliczenia iteracyjnym BFS przy
+// najblizszym sprawdzeniu spojnosci.
+class TopologyIndex : public ILinkObserver {
+public:
+    explicit TopologyIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : resource_(resource), sender_index_(resource), receiver_index_(resource) {}
+
+    void add_ramp(Ramp& ramp);
+    void add_worker(Worker& worker);
+    void add_storehouse(Storehouse& storehouse);
+    void remove_node(const IPackageSender* sender, const IPackageReceiver* receiver);
+
+    void on_link_added(IPackageSender* sender, IPackageReceiver* receiver) override;
+    void on_link_removed(IPackageSender* sender, IPackageReceiver* receiver) override;
+
+    // Nadawcy majacy polaczenie do danego odbiorcy.
+    std::vector<IPackageSender*> senders_of(const IPackageReceiver* receiver) const;
+
+    bool is_consistent();
+    // Opis wezla naruszajacego spojnosc; pusty, gdy siec jest spojna.
+    std::string describe_inconsistency();
+
+private:
+    static constexpr std::uint32_t npos = UINT32_MAX;
+
+    struct Node {
+        explicit Node(std::pmr::memory_resource* resource) : out(resource), in(resource) {}
+
+        NodeKind kind = NodeKind::WORKER;
+        ElementID id = 0;
+        IPackageSender* sender = nullptr;
+        IPackageReceiver* receiver = nullptr;
+        std::pmr::vector<std::uint32_t> out;
+        std::pmr::vector<std::uint32_t> in;
+        bool alive = false;
+        bool from_ramp = false;
+        bool reaches_store = false;
+    };
+
+    std::uint32_t add_node(NodeKind kind, ElementID id, IPackageSender* sender, IPackageReceiver* receiver);
+    std::uint32_t node_of(IPackageReceiver* receiver);
+    bool is_bad(const Node& n) const { return n.alive && n.from_ramp && !n.reaches_store; }
+    void mark_reaches_store(std::uint32_t start);
+    void mark_from_ramp(std::uint32_t start);
+    void recompute();
+
+    std::pmr::memory_resource* resource_;
+    std::vector<Node> nodes_;
+    std::vector<std::uint32_t> free_nodes_;
+    std::pmr::unordered_map<const IPackageSender*, std::uint32_t> sender_index_;
+    std::pmr::unordered_map<const IPackageReceiver*, std::uint32_t> receiver_index_;
+    std::size_t bad_count_ = 0;
+    bool dirty_ = false;
+};
+
+#endif
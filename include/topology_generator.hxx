@@ -0,0 +1,32 @@
+#ifndef TOPOLOGY_GENERATOR_HXX_
+#define TOPOLOGY_GENERATOR_HXX_
+
+#include <cstddef>
+#include <cstdint>
+#include "factory.hxx"
+#include "types.hxx"
+
+enum class TopologyShape {
+    CHAIN,    // rampa -> W1 -> W2 -> ... -> Wn -> magazyn
+    FAN_OUT,  // drzewo: kazdy robotnik rozsyla do `width` nastepnych, liscie do magazynu
+    LAYERED   // warstwy po `width` robotnikow, kazdy laczy sie z dwoma w nastepnej
+};
+
+// Parametry syntetycznej sieci; `workers` to liczba robotnikow (ramp i
+// magazynow jest niewiele i nie wliczaja sie do niej).
+struct TopologySpec {
+    TopologyShape shape = TopologyShape::CHAIN;
+    std::size_t workers = 10;
+    std::size_t width = 4;
+    TimeOffset delivery_interval = 1;
+    TimeOffset processing_time = 1;
+    // Rozne od 0: robotnicy sa deklarowani (i ukladani w pamieci) w losowej
+    // kolejnosci, jak w recznie pisanym pliku struktury; polaczenia sie nie zmieniaja.
+    std::uint64_t shuffle_seed = 0;
+};
+
+// Zbudowana siec jest zawsze spojna. ID robotnikow to 1..workers.
+// resource jak w konstruktorze Factory (nullptr - wlasna arena fabryki).
+Factory generate_topology(const TopologySpec& spec, std::pmr::memory_resource* resource = nullptr);
+
+#endif
@@ -0,0 +1,85 @@
+#include "async_reports.hxx"
+#include <algorithm>
+
+AsyncTurnReporter::AsyncTurnReporter(std::ostream& os, ReportFormat format, bool delta, std::size_t queue_depth)
+    : writer_(os, format, delta), slots_(std::max<std::size_t>(queue_depth, 1)) {
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+        free_slots_.push_back(i);
+    }
+    thread_ = std::thread(&AsyncTurnReporter::run, this);
+}
+
+AsyncTurnReporter::~AsyncTurnReporter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    ready_cv_.notify_one();
+    thread_.join();
+}
+
+void AsyncTurnReporter::rethrow_error() {
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+void AsyncTurnReporter::submit(const Factory& f, Time t) {
+    std::size_t slot;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slot_free_cv_.wait(lock, [this] { return !free_slots_.empty() || error_; });
+        rethrow_error();
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+
+    // Slot nalezy teraz wylacznie do watku symulacji - kopiowanie bez blokady.
+    slots_[slot].capture(f, t, cursor_);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(slot);
+    }
+    ready_cv_.notify_one();
+}
+
+void AsyncTurnReporter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slot_free_cv_.wait(lock, [this] { return (ready_.empty() && !writing_) || error_; });
+    rethrow_error();
+}
+
+void AsyncTurnReporter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        ready_cv_.wait(lock, [this] { return stop_ || !ready_.empty(); });
+        if (ready_.empty()) {
+            break;
+        }
+        std::size_t slot = ready_.front();
+        ready_.pop_front();
+        writing_ = true;
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            writer_.write(slots_[slot]);
+            writer_.flush();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        writing_ = false;
+        if (error && !error_) {
+            error_ = error;
+        }
+        free_slots_.push_back(slot);
+        slot_free_cv_.notify_all();
+    }
+    try {
+        writer_.flush();
+    } catch (...) {
+    }
+}
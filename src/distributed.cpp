@@ -0,0 +1,719 @@
+#include "distributed.hxx"
+#include "package_id_allocator.hxx"
+#include "partition.hxx"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr ElementID no_package = -1;
+
+enum class MessageType : std::uint8_t {
+    TURN = 1,
+    STOP = 2
+};
+
+class Message {
+public:
+    template <typename T>
+    void put(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        data_.insert(data_.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (data_.size() - pos_ < sizeof(T)) {
+            throw std::runtime_error("Distributed simulation: truncated message");
+        }
+        T value;
+        std::memcpy(&value, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    void clear() {
+        data_.clear();
+        pos_ = 0;
+    }
+
+    std::size_t remaining() const { return data_.size() - pos_; }
+
+    std::vector<char>& data() { return data_; }
+
+private:
+    std::vector<char> data_;
+    std::size_t pos_ = 0;
+};
+
+// Ramkowanie: dlugosc (uint64) i tresc.
+class Channel {
+public:
+    explicit Channel(int fd) : fd_(fd) {}
+    ~Channel() { close(); }
+
+    Channel(Channel&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+    Channel& operator=(Channel&&) = delete;
+
+    int fd() const { return fd_; }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    void send(Message& m) {
+        auto size = static_cast<std::uint64_t>(m.data().size());
+        write_all(&size, sizeof(size));
+        write_all(m.data().data(), m.data().size());
+    }
+
+    // false, gdy druga strona zamknela polaczenie przed poczatkiem komunikatu.
+    bool receive(Message& m) {
+        std::uint64_t size = 0;
+        if (!read_all(&size, sizeof(size), true)) {
+            return false;
+        }
+        m.clear();
+        m.data().resize(static_cast<std::size_t>(size));
+        read_all(m.data().data(), m.data().size(), false);
+        return true;
+    }
+
+private:
+    void write_all(const void* buf, std::size_t n) {
+        const char* p = static_cast<const char*>(buf);
+        while (n > 0) {
+            ssize_t k = ::send(fd_, p, n, MSG_NOSIGNAL);
+            if (k < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("Distributed simulation: send failed: ") + std::strerror(errno));
+            }
+            p += k;
+            n -= static_cast<std::size_t>(k);
+        }
+    }
+
+    bool read_all(void* buf, std::size_t n, bool eof_allowed) {
+        char* p = static_cast<char*>(buf);
+        std::size_t done = 0;
+        while (done < n) {
+            ssize_t k = ::recv(fd_, p + done, n - done, 0);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) {
+                if (k == 0 && done == 0 && eof_allowed) return false;
+                throw std::runtime_error("Distributed simulation: connection to shard lost");
+            }
+            done += static_cast<std::size_t>(k);
+        }
+        return true;
+    }
+
+    int fd_;
+};
+
+// Nadawanie i odbior ze wszystkimi sasiadami sa przeplatane (poll), wiec duze
+// paczki wysylane jednoczesnie w obie strony nie blokuja sie wzajemnie.
+void exchange(std::vector<Channel>& peers, std::vector<Message>& out, std::vector<Message>& in) {
+    struct Progress {
+        std::uint64_t out_size = 0;
+        std::size_t sent = 0;
+        std::uint64_t in_size = 0;
+        std::size_t received = 0;
+    };
+    constexpr std::size_t header = sizeof(std::uint64_t);
+    std::vector<Progress> progress(peers.size());
+    for (std::size_t p = 0; p < peers.size(); ++p) {
+        progress[p].out_size = out[p].data().size();
+        in[p].clear();
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<std::size_t> peer_of;
+    while (true) {
+        fds.clear();
+        peer_of.clear();
+        for (std::size_t p = 0; p < peers.size(); ++p) {
+            short events = 0;
+            if (progress[p].sent < header + progress[p].out_size) events |= POLLOUT;
+            if (progress[p].received < header + progress[p].in_size) events |= POLLIN;
+            if (events) {
+                fds.push_back({peers[p].fd(), events, 0});
+                peer_of.push_back(p);
+            }
+        }
+        if (fds.empty()) {
+            return;
+        }
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Distributed simulation: poll failed: ") + std::strerror(errno));
+        }
+        for (std::size_t i = 0; i < fds.size(); ++i) {
+            Progress& pr = progress[peer_of[i]];
+            int fd = fds[i].fd;
+            if (fds[i].revents & POLLOUT) {
+                const char* from = pr.sent < header ? reinterpret_cast<const char*>(&pr.out_size) + pr.sent
+                                                     : out[peer_of[i]].data().data() + (pr.sent - header);
+                std::size_t n = pr.sent < header ? header - pr.sent : header + pr.out_size - pr.sent;
+                ssize_t k = ::send(fd, from, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (k < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    throw std::runtime_error(std::string("Distributed simulation: send failed: ") + std::strerror(errno));
+                }
+                pr.sent += k > 0 ? static_cast<std::size_t>(k) : 0;
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && pr.received < header + pr.in_size) {
+                Message& m = in[peer_of[i]];
+                char* to = pr.received < header ? reinterpret_cast<char*>(&pr.in_size) + pr.received
+                                                : m.data().data() + (pr.received - header);
+                std::size_t n = pr.received < header ? header - pr.received : header + pr.in_size - pr.received;
+                ssize_t k = ::recv(fd, to, n, MSG_DONTWAIT);
+                if (k == 0 || (k < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    throw std::runtime_error("Distributed simulation: connection to shard lost");
+                }
+                if (k > 0) {
+                    pr.received += static_cast<std::size_t>(k);
+                    if (pr.received == header) {
+                        m.data().resize(static_cast<std::size_t>(pr.in_size));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Polprodukt przesylany jest jako ID i tura powstania.
+void put_buffer(std::optional<Package>& buffer, Message& m) {
+    auto id = m.get<ElementID>();
+    auto created = m.get<Time>();
+    if (buffer) {
+        buffer->release();
+    }
+    buffer.reset();
+    if (id != no_package) {
+        buffer.emplace(id, created);
+    }
+}
+
+void write_buffer(const std::optional<Package>& buffer, Message& m) {
+    m.put<ElementID>(buffer ? buffer->get_id() : no_package);
+    m.put<Time>(buffer ? buffer->get_creation_time() : 0);
+}
+
+void put_stockpile(IPackageStockpile& stockpile, Message& m) {
+    while (auto p = stockpile.pop()) {
+        p->release();
+    }
+    for (auto n = m.get<std::uint64_t>(); n > 0; --n) {
+        auto id = m.get<ElementID>();
+        stockpile.push(Package(id, m.get<Time>()));
+    }
+}
+
+void write_stockpile(const IPackageStockpile& stockpile, Message& m) {
+    m.put<std::uint64_t>(stockpile.size());
+    for (const auto& p : stockpile) {
+        m.put<ElementID>(p.get_id());
+        m.put<Time>(p.get_creation_time());
+    }
+}
+
+// Polprodukty odziedziczone po fork() sa tworzone od nowa w puli ID czesci,
+// zeby ID zwalniane przez magazyny trafialy do jednej puli.
+void adopt(std::optional<Package>& buffer) {
+    if (buffer) {
+        Time created = buffer->get_creation_time();
+        ElementID id = buffer->release();
+        buffer.emplace(id, created);
+    }
+}
+
+void adopt(IPackageStockpile& stockpile) {
+    std::vector<std::pair<ElementID, Time>> packages;
+    for (const auto& p : stockpile) {
+        packages.emplace_back(p.get_id(), p.get_creation_time());
+    }
+    while (auto p = stockpile.pop()) {
+        p->release();
+    }
+    for (const auto& [id, created] : packages) {
+        stockpile.push(Package(id, created));
+    }
+}
+
+// Wezly fabryki w kolejnosci kolekcji. Nadawca s to rampa s (s < R) albo
+// robotnik s - R; odbiorca r to robotnik r (r < W) albo magazyn r - W.
+struct Nodes {
+    std::vector<Ramp*> ramps;
+    std::vector<Worker*> workers;
+    std::vector<Storehouse*> stores;
+    std::vector<IPackageSender*> senders;
+    std::vector<IPackageReceiver*> receivers;
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> receiver_index;
+
+    explicit Nodes(Factory& f) {
+        for (auto& ramp : f.ramp_collection()) ramps.push_back(&ramp);
+        for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) workers.push_back(&*it);
+        for (auto& store : f.storehouse_collection()) stores.push_back(&store);
+        senders.assign(ramps.begin(), ramps.end());
+        senders.insert(senders.end(), workers.begin(), workers.end());
+        receivers.assign(workers.begin(), workers.end());
+        receivers.insert(receivers.end(), stores.begin(), stores.end());
+        for (std::size_t r = 0; r < receivers.size(); ++r) {
+            receiver_index.emplace(receivers[r], static_cast<std::uint32_t>(r));
+        }
+    }
+};
+
+// Przydzial wezlow do czesci (z partition_factory()).
+struct Ownership {
+    std::vector<std::size_t> sender_part;
+    std::vector<std::size_t> receiver_part;
+    std::vector<std::vector<std::size_t>> ramps, workers, stores;  // wezly czesci, rosnaco
+
+    Ownership(const FactoryPartition& partition, std::size_t shards)
+        : ramps(shards), workers(shards), stores(shards) {
+        for (std::size_t i = 0; i < partition.ramp_part.size(); ++i) {
+            sender_part.push_back(partition.ramp_part[i]);
+            ramps[partition.ramp_part[i]].push_back(i);
+        }
+        for (std::size_t i = 0; i < partition.worker_part.size(); ++i) {
+            sender_part.push_back(partition.worker_part[i]);
+            receiver_part.push_back(partition.worker_part[i]);
+            workers[partition.worker_part[i]].push_back(i);
+        }
+        for (std::size_t i = 0; i < partition.storehouse_part.size(); ++i) {
+            receiver_part.push_back(partition.storehouse_part[i]);
+            stores[partition.storehouse_part[i]].push_back(i);
+        }
+    }
+};
+
+// Polprodukt wyslany przez nadawce do odbiorcy z innej czesci.
+struct Offer {
+    std::uint32_t sender;
+    std::uint32_t receiver;
+    ElementID id;
+    Time created;
+};
+
+// Proces potomny: trzyma stan swoich ramp, robotnikow i magazynow (z kopii
+// fabryki odziedziczonej po fork()), sam losuje odbiorcow swoich nadawcow i
+// wymienia polprodukty bezposrednio z pozostalymi czesciami. Nie korzysta z
+// zadnej blokady odziedziczonej po rodzicu (wlasna pula ID, generator
+// licznikowy zamiast globalnego rng).
+class Shard {
+public:
+    Shard(Factory& f, const Ownership& own, std::size_t self, Channel& parent, std::vector<Channel>& peers,
+          bool bounded)
+        : nodes_(f), own_(own), self_(self), parent_(parent), peers_(peers), bounded_(bounded),
+          out_(peers.size()), in_(peers.size()), rejected_out_(peers.size()) {
+        for (std::size_t r : own_.ramps[self_]) {
+            own_senders_.push_back(r);
+            adopt(nodes_.ramps[r]->get_sending_buffer());
+        }
+        for (std::size_t w : own_.workers[self_]) {
+            own_senders_.push_back(nodes_.ramps.size() + w);
+            Worker& worker = *nodes_.workers[w];
+            adopt(worker.get_processing_buffer());
+            adopt(worker.get_sending_buffer());
+            adopt(*worker.get_queue());
+        }
+        for (std::size_t s : own_.stores[self_]) {
+            adopt(*nodes_.stores[s]->get_queue());
+        }
+    }
+
+    void run() {
+        while (parent_.receive(in_turn_)) {
+            if (in_turn_.get<MessageType>() == MessageType::STOP) {
+                return;
+            }
+            auto t = in_turn_.get<Time>();
+            bool sync = in_turn_.get<std::uint8_t>() != 0;
+            for (auto n = in_turn_.get<std::uint64_t>(); n > 0; --n) {
+                auto r = in_turn_.get<std::uint32_t>();
+                nodes_.ramps[r]->get_sending_buffer().emplace(in_turn_.get<ElementID>(), t);
+            }
+            route(t);
+            resolve(t);
+            for (std::size_t w : own_.workers[self_]) {
+                nodes_.workers[w]->do_work(t);
+            }
+            reply(sync);
+        }
+    }
+
+private:
+    std::size_t peer_slot(std::size_t part) const { return part < self_ ? part : part - 1; }
+
+    void route(Time t) {
+        for (auto& m : out_) {
+            m.clear();
+        }
+        local_.clear();
+        offered_.clear();
+        for (std::size_t s : own_senders_) {
+            IPackageSender& sender = *nodes_.senders[s];
+            auto& buffer = sender.get_sending_buffer();
+            if (!buffer) continue;
+            IPackageReceiver* receiver = sender.receiver_preferences_.choose_receiver(t);
+            if (!receiver) {
+                buffer.reset();
+                continue;
+            }
+            Offer offer{static_cast<std::uint32_t>(s), nodes_.receiver_index.at(receiver), buffer->get_id(),
+                        buffer->get_creation_time()};
+            std::size_t part = own_.receiver_part[offer.receiver];
+            if (part == self_) {
+                local_.push_back(offer);
+            } else {
+                Message& m = out_[peer_slot(part)];
+                m.put(offer.sender);
+                m.put(offer.receiver);
+                m.put(offer.id);
+                m.put(offer.created);
+                offered_.push_back(offer.sender);
+            }
+        }
+        exchange(peers_, out_, in_);
+    }
+
+    // Polprodukty do odbiorcow tej czesci przyjmowane sa w kolejnosci nadawcow
+    // (jak w simulate()), z tym samym sprawdzaniem pojemnosci.
+    void resolve(Time t) {
+        incoming_ = local_;
+        for (auto& m : in_) {
+            while (m.remaining() > 0) {
+                Offer offer;
+                offer.sender = m.get<std::uint32_t>();
+                offer.receiver = m.get<std::uint32_t>();
+                offer.id = m.get<ElementID>();
+                offer.created = m.get<Time>();
+                incoming_.push_back(offer);
+            }
+        }
+        std::sort(incoming_.begin(), incoming_.end(), [](const Offer& a, const Offer& b) { return a.sender < b.sender; });
+
+        for (auto& m : rejected_out_) {
+            m.clear();
+        }
+        for (const Offer& offer : incoming_) {
+            IPackageReceiver* receiver = nodes_.receivers[offer.receiver];
+            std::size_t part = own_.sender_part[offer.sender];
+            IPackageSender& sender = *nodes_.senders[offer.sender];
+            if (!receiver->can_receive_package()) {
+                if (part == self_) {
+                    sender.count_blocked_turn();
+                } else {
+                    rejected_out_[peer_slot(part)].put(offer.sender);
+                }
+                continue;
+            }
+            if (part == self_) {
+                auto& buffer = sender.get_sending_buffer();
+                receiver->receive_package(std::move(*buffer), t);
+                buffer.reset();
+            } else {
+                receiver->receive_package(Package(offer.id, offer.created), t);
+            }
+        }
+
+        // Bez ograniczonych kolejek zadna oferta nie moze zostac odrzucona.
+        rejected_.clear();
+        if (bounded_) {
+            exchange(peers_, rejected_out_, in_);
+            for (auto& m : in_) {
+                while (m.remaining() > 0) {
+                    rejected_.push_back(m.get<std::uint32_t>());
+                }
+            }
+            std::sort(rejected_.begin(), rejected_.end());
+        }
+        for (std::uint32_t s : offered_) {
+            IPackageSender& sender = *nodes_.senders[s];
+            if (std::binary_search(rejected_.begin(), rejected_.end(), s)) {
+                sender.count_blocked_turn();
+            } else {
+                sender.get_sending_buffer()->release();
+                sender.get_sending_buffer().reset();
+            }
+        }
+    }
+
+    void reply(bool sync) {
+        Message& m = out_turn_;
+        m.clear();
+        for (std::size_t r : own_.ramps[self_]) {
+            m.put<std::uint8_t>(nodes_.ramps[r]->get_sending_buffer().has_value());
+        }
+        freed_.clear();
+        ids_.take_free(freed_);
+        m.put<std::uint64_t>(freed_.size());
+        for (ElementID id : freed_) {
+            m.put(id);
+        }
+        if (sync) {
+            for (std::size_t r : own_.ramps[self_]) {
+                write_buffer(nodes_.ramps[r]->get_sending_buffer(), m);
+                m.put<std::uint64_t>(nodes_.ramps[r]->get_blocked_turns());
+            }
+            for (std::size_t w : own_.workers[self_]) {
+                Worker& worker = *nodes_.workers[w];
+                write_buffer(worker.get_processing_buffer(), m);
+                m.put<Time>(worker.get_package_processing_start_time());
+                write_buffer(worker.get_sending_buffer(), m);
+                m.put<std::uint64_t>(worker.get_blocked_turns());
+                write_stockpile(*worker.get_queue(), m);
+            }
+            for (std::size_t s : own_.stores[self_]) {
+                const Storehouse& store = *nodes_.stores[s];
+                m.put<StorehouseStats>(store.get_stats());
+                write_stockpile(*store.get_queue(), m);
+            }
+        }
+        parent_.send(m);
+    }
+
+    PackageIdAllocator ids_;
+    PackageIdAllocator::Scope scope_{ids_};
+    Nodes nodes_;
+    const Ownership& own_;
+    std::size_t self_;
+    Channel& parent_;
+    std::vector<Channel>& peers_;
+    bool bounded_;
+
+    std::vector<std::size_t> own_senders_;
+    std::vector<Offer> local_;
+    std::vector<Offer> incoming_;
+    std::vector<std::uint32_t> offered_;
+    std::vector<std::uint32_t> rejected_;
+    std::vector<ElementID> freed_;
+    std::vector<Message> out_;
+    std::vector<Message> in_;
+    std::vector<Message> rejected_out_;
+    Message in_turn_;
+    Message out_turn_;
+};
+
+// Proces wywolujacy: nadaje ID polproduktom z ramp (pula ID musi byc jedna,
+// zeby ID byly takie jak w simulate()), przyjmuje ID zwolnione przez magazyny
+// czesci i w turach raportu przepisuje stan czesci do `f`. Sam nie przesyla
+// polproduktow - czesci wymieniaja je bezposrednio.
+class Coordinator {
+public:
+    Coordinator(Factory& f, std::size_t shards)
+        : f_(f), nodes_(f), shards_(shards), own_(partition_factory(f, shards), shards) {
+        for (Ramp* ramp : nodes_.ramps) {
+            ramp_busy_.push_back(ramp->get_sending_buffer().has_value());
+        }
+        bool bounded = false;
+        for (const Worker* worker : nodes_.workers) {
+            bounded = bounded || worker->get_queue()->capacity() != unbounded_capacity;
+        }
+        for (const Storehouse* store : nodes_.stores) {
+            bounded = bounded || store->get_queue()->capacity() != unbounded_capacity;
+        }
+        new_ids_.resize(shards);
+        start_shards(bounded);
+    }
+
+    ~Coordinator() {
+        // Zamkniecie gniazd konczy petle procesow potomnych.
+        channels_.clear();
+        for (pid_t pid : pids_) {
+            int status = 0;
+            while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        }
+    }
+
+    Coordinator(const Coordinator&) = delete;
+    Coordinator& operator=(const Coordinator&) = delete;
+
+    void run_turn(Time t, bool sync) {
+        for (std::size_t r = 0; r < nodes_.ramps.size(); ++r) {
+            if ((t - 1) % nodes_.ramps[r]->get_delivery_interval() != 0 || ramp_busy_[r]) continue;
+            // Magazyny sa w procesach potomnych, wiec koordynator nie zapisuje
+            // tury narodzin - nie bylby w stanie jej usunac.
+            ElementID id = PackageIdAllocator::current().allocate();
+            new_ids_[own_.sender_part[r]].emplace_back(static_cast<std::uint32_t>(r), id);
+        }
+
+        for (std::size_t k = 0; k < shards_; ++k) {
+            message_.clear();
+            message_.put(MessageType::TURN);
+            message_.put<Time>(t);
+            message_.put<std::uint8_t>(sync);
+            message_.put<std::uint64_t>(new_ids_[k].size());
+            for (const auto& [r, id] : new_ids_[k]) {
+                message_.put(r);
+                message_.put(id);
+            }
+            channels_[k].send(message_);
+            new_ids_[k].clear();
+        }
+
+        for (std::size_t k = 0; k < shards_; ++k) {
+            if (!channels_[k].receive(message_)) {
+                throw std::runtime_error("Distributed simulation: shard " + std::to_string(k) + " terminated");
+            }
+            apply_reply(k, sync);
+        }
+    }
+
+private:
+    void apply_reply(std::size_t k, bool sync) {
+        for (std::size_t r : own_.ramps[k]) {
+            ramp_busy_[r] = message_.get<std::uint8_t>() != 0;
+        }
+        for (auto n = message_.get<std::uint64_t>(); n > 0; --n) {
+            PackageIdAllocator::current().release(message_.get<ElementID>());
+        }
+        if (!sync) {
+            return;
+        }
+        for (std::size_t r : own_.ramps[k]) {
+            Ramp& ramp = *nodes_.ramps[r];
+            put_buffer(ramp.get_sending_buffer(), message_);
+            ramp.set_blocked_turns(message_.get<std::uint64_t>());
+        }
+        for (std::size_t w : own_.workers[k]) {
+            Worker& worker = *nodes_.workers[w];
+            put_buffer(worker.get_processing_buffer(), message_);
+            worker.set_package_processing_start_time(message_.get<Time>());
+            put_buffer(worker.get_sending_buffer(), message_);
+            worker.set_blocked_turns(message_.get<std::uint64_t>());
+            put_stockpile(*worker.get_queue(), message_);
+        }
+        for (std::size_t s : own_.stores[k]) {
+            Storehouse& store = *nodes_.stores[s];
+            store.set_stats(message_.get<StorehouseStats>());
+            put_stockpile(*store.get_queue(), message_);
+        }
+    }
+
+    void start_shards(bool bounded) {
+        // peers[k][j] - gniazdo czesci k do czesci j (bez j == k).
+        std::vector<std::vector<int>> peers(shards_, std::vector<int>(shards_, -1));
+        auto close_all = [&peers] {
+            for (auto& row : peers) {
+                for (int& fd : row) {
+                    if (fd >= 0) ::close(fd);
+                    fd = -1;
+                }
+            }
+        };
+        for (std::size_t i = 0; i < shards_; ++i) {
+            for (std::size_t j = i + 1; j < shards_; ++j) {
+                int fds[2];
+                if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+                    close_all();
+                    throw std::runtime_error(std::string("Distributed simulation: socketpair failed: ") + std::strerror(errno));
+                }
+                peers[i][j] = fds[0];
+                peers[j][i] = fds[1];
+            }
+        }
+
+        for (std::size_t k = 0; k < shards_; ++k) {
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+                close_all();
+                throw std::runtime_error(std::string("Distributed simulation: socketpair failed: ") + std::strerror(errno));
+            }
+            pid_t pid = ::fork();
+            if (pid < 0) {
+                ::close(fds[0]);
+                ::close(fds[1]);
+                close_all();
+                throw std::runtime_error(std::string("Distributed simulation: fork failed: ") + std::strerror(errno));
+            }
+            if (pid == 0) {
+                // Proces potomny nie wraca do wywolujacego - konczy sie przez _exit bez destruktorow.
+                int status = 0;
+                try {
+                    for (auto& channel : channels_) channel.close();
+                    ::close(fds[0]);
+                    std::vector<Channel> own_peers;
+                    for (std::size_t j = 0; j < shards_; ++j) {
+                        if (j != k) own_peers.emplace_back(std::exchange(peers[k][j], -1));
+                    }
+                    close_all();
+                    Channel parent(fds[1]);
+                    Shard(f_, own_, k, parent, own_peers, bounded).run();
+                } catch (...) {
+                    status = 1;
+                }
+                ::_exit(status);
+            }
+            ::close(fds[1]);
+            channels_.emplace_back(fds[0]);
+            pids_.push_back(pid);
+        }
+        close_all();
+    }
+
+    Factory& f_;
+    Nodes nodes_;
+    std::size_t shards_;
+    Ownership own_;
+
+    std::vector<bool> ramp_busy_;
+    std::vector<std::vector<std::pair<std::uint32_t, ElementID>>> new_ids_;
+    Message message_;
+
+    std::vector<Channel> channels_;
+    std::vector<pid_t> pids_;
+};
+
+}
+
+void simulate_distributed(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf,
+                          std::size_t shards, std::function<bool(Time)> report_turns) {
+    // Procesy potomne dostaja kopie fabryki, wiec zmiany wchodza tylko przed startem.
+    f.apply_pending_changes(1);
+    if (!f.is_consistent()) {
+        throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+    }
+    if (shards == 0) {
+        throw std::invalid_argument("Number of shards must be positive.");
+    }
+    if (!f.counter_rng()) {
+        throw std::invalid_argument("Distributed simulation requires the counter RNG (Factory::enable_counter_rng).");
+    }
+    for (const auto& ramp : f.ramp_collection()) {
+        if (ramp.get_batch_size() > 1) {
+            throw std::invalid_argument("Distributed simulation does not support batched ramps.");
+        }
+    }
+
+    Coordinator coordinator(f, shards);
+    for (Time t = 1; t <= rounds; ++t) {
+        if (f.has_pending_changes()) {
+            throw std::logic_error("Distributed simulation does not support topology changes during a run.");
+        }
+        bool report = !report_turns || report_turns(t);
+        coordinator.run_turn(t, report || t == rounds);
+        if (report) {
+            rf(f, t);
+        }
+    }
+}
@@ -1,66 +1,84 @@
 #include "factory.hxx"
+#include "mapped_file.hxx"
+#include <charconv>
+#include <cmath>
+#include <iterator>
+#include <set>
 #include <stdexcept>
-#include <sstream>
 #include <iostream>
-#include <map>
 
-enum class NodeColor {
-    UNVISITED,
-    VISITED,
-    VERIFIED
-};
-
-bool has_reachable_storehouse(const IPackageSender* sender, std::map<const IPackageSender*, NodeColor>& node_colors) {
-    
-    if (node_colors[sender] == NodeColor::VERIFIED) {
-        return true;
-    }
-
-    node_colors[sender] = NodeColor::VISITED;
-
-    if (sender->receiver_preferences_.get_preferences().empty()) {
-        throw std::logic_error("Sender has no receivers defined.");
+void Factory::remove_receiver_links(IPackageReceiver* receiver) {
+    for (IPackageSender* sender : topology_->senders_of(receiver)) {
+        sender->receiver_preferences_.remove_receiver(receiver);
     }
+}
 
-    bool does_sender_have_reachable_storehouse = false; 
-
-    for (const auto& [receiver, probability] : sender->receiver_preferences_.get_preferences()) {
-        
-        if (receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
-            does_sender_have_reachable_storehouse = true;
-        } 
-        else if (receiver->get_receiver_type() == ReceiverType::WORKER) {
-            IPackageReceiver* receiver_ptr = receiver;
-            auto worker_ptr = dynamic_cast<Worker*>(receiver_ptr);
-            auto sendrecv_ptr = dynamic_cast<const IPackageSender*>(worker_ptr);
-
-            if (sendrecv_ptr == sender) {
-                continue;
-            }
+void Factory::add_ramp(Ramp&& ramp) {
+    Ramp& added = ramps_.add(std::move(ramp));
+    attach_counter_rng(added);
+    topology_->add_ramp(added);
+}
 
-            does_sender_have_reachable_storehouse = true; 
+void Factory::add_worker(Worker&& worker) {
+    Worker& added = workers_.add(std::move(worker));
+    attach_counter_rng(added);
+    topology_->add_worker(added);
+}
 
-            if (node_colors[sendrecv_ptr] == NodeColor::UNVISITED) {
-                has_reachable_storehouse(sendrecv_ptr, node_colors); 
-            }
-        }
+// Strumienie ramp i robotnikow sa rozdzielone najstarszym bitem (ID moga sie powtarzac).
+void Factory::attach_counter_rng(Ramp& ramp) const {
+    if (counter_rng_) {
+        ramp.receiver_preferences_.set_counter_rng(*counter_rng_, static_cast<std::uint32_t>(ramp.get_id()));
     }
+}
 
-    node_colors[sender] = NodeColor::VERIFIED;
+void Factory::attach_counter_rng(Worker& worker) const {
+    if (counter_rng_) {
+        worker.receiver_preferences_.set_counter_rng(
+            *counter_rng_, std::uint64_t{1} << 32 | static_cast<std::uint32_t>(worker.get_id()));
+    }
+}
 
-    if (does_sender_have_reachable_storehouse) {
-        return true;
-    } else {
-        throw std::logic_error("Sender has no reachable storehouse.");
+void Factory::enable_counter_rng(std::uint64_t seed) {
+    counter_rng_.emplace(seed);
+    for (auto& ramp : ramps_) {
+        attach_counter_rng(ramp);
+    }
+    for (auto& worker : workers_) {
+        attach_counter_rng(worker);
     }
 }
 
+void Factory::relayout_workers(const std::vector<ElementID>& order) {
+    std::unordered_map<const IPackageReceiver*, IPackageReceiver*> moved;
+    workers_.relayout(order, [&moved](Worker& from, Worker& to) { moved.emplace(&from, &to); });
 
+    for (auto& ramp : ramps_) {
+        ramp.receiver_preferences_.replace_receivers(moved);
+    }
+    for (auto& worker : workers_) {
+        worker.receiver_preferences_.replace_receivers(moved);
+    }
+    // Indeks topologii trzyma wskazniki do wezlow - najprosciej zbudowac go od nowa.
+    topology_ = std::make_unique<TopologyIndex>(resource_);
+    for (auto& ramp : ramps_) {
+        topology_->add_ramp(ramp);
+    }
+    for (auto& worker : workers_) {
+        topology_->add_worker(worker);
+    }
+    for (auto& store : storehouses_) {
+        topology_->add_storehouse(store);
+    }
+    // Flagi spojnosci przeliczane sa od razu, a nie przy pierwszej symulacji.
+    topology_->is_consistent();
+}
 
-template <typename Sender>
-void Factory::remove_receiver_links(NodeCollection<Sender>& collection, IPackageReceiver* receiver) {
-    for (auto& sender : collection) {
-        sender.receiver_preferences_.remove_receiver(receiver);
+void Factory::remove_ramp(ElementID id) {
+    auto it = ramps_.find_by_id(id);
+    if (it != ramps_.end()) {
+        topology_->remove_node(&(*it), nullptr);
+        ramps_.remove_by_id(id);
     }
 }
 
@@ -68,8 +86,8 @@ void Factory::remove_worker(ElementID id) {
     auto it = workers_.find_by_id(id);
     if (it != workers_.end()) {
         Worker* w = &(*it);
-        remove_receiver_links(ramps_, w);
-        remove_receiver_links(workers_, w);
+        remove_receiver_links(w);
+        topology_->remove_node(w, w);
         workers_.remove_by_id(id);
     }
 }
@@ -78,33 +96,217 @@ void Factory::remove_storehouse(ElementID id) {
     auto it = storehouses_.find_by_id(id);
     if (it != storehouses_.end()) {
         Storehouse* s = &(*it);
-        remove_receiver_links(ramps_, s);
-        remove_receiver_links(workers_, s);
+        remove_receiver_links(s);
+        topology_->remove_node(nullptr, s);
         storehouses_.remove_by_id(id);
     }
 }
 
-bool Factory::is_consistent() {
-    std::map<const IPackageSender*, NodeColor> node_colors;
-    for (const auto& ramp : ramps_) {
-        node_colors[&ramp] = NodeColor::UNVISITED;
+namespace {
+
+std::string node_name(const NodeRef& node) {
+    const char* kind = node.kind == NodeKind::RAMP ? "ramp" : node.kind == NodeKind::WORKER ? "worker" : "store";
+    return std::string(kind) + "-" + std::to_string(node.id);
+}
+
+}
+
+IPackageSender* Factory::find_sender(const NodeRef& node) {
+    if (node.kind == NodeKind::RAMP) {
+        auto it = ramps_.find_by_id(node.id);
+        return it != ramps_.end() ? &(*it) : nullptr;
+    }
+    if (node.kind == NodeKind::WORKER) {
+        auto it = workers_.find_by_id(node.id);
+        return it != workers_.end() ? &(*it) : nullptr;
+    }
+    return nullptr;
+}
+
+IPackageReceiver* Factory::find_receiver(const NodeRef& node) {
+    if (node.kind == NodeKind::WORKER) {
+        auto it = workers_.find_by_id(node.id);
+        return it != workers_.end() ? &(*it) : nullptr;
+    }
+    if (node.kind == NodeKind::STOREHOUSE) {
+        auto it = storehouses_.find_by_id(node.id);
+        return it != storehouses_.end() ? &(*it) : nullptr;
+    }
+    return nullptr;
+}
+
+void Factory::validate(const ChangeSet& changes) {
+    auto fail = [](const std::string& message) { throw std::invalid_argument("Change set: " + message); };
+    auto exists_now = [this](const NodeRef& node) {
+        return node.kind == NodeKind::STOREHOUSE ? find_receiver(node) != nullptr : find_sender(node) != nullptr;
+    };
+    auto key = [](const NodeRef& node) { return std::make_pair(node.kind, node.id); };
+
+    std::set<std::pair<NodeKind, ElementID>> added;
+    auto add = [&](const NodeRef& node) {
+        if (exists_now(node) || !added.insert(key(node)).second) {
+            fail(node_name(node) + " already exists");
+        }
+    };
+    for (const auto& ramp : changes.ramps_) add({NodeKind::RAMP, ramp.get_id()});
+    for (const auto& worker : changes.workers_) add({NodeKind::WORKER, worker.get_id()});
+    for (const auto& store : changes.storehouses_) add({NodeKind::STOREHOUSE, store.get_id()});
+
+    std::set<std::pair<NodeKind, ElementID>> removed;
+    for (const auto& node : changes.removals_) {
+        if (!exists_now(node)) {
+            fail("unknown " + node_name(node));
+        }
+        removed.insert(key(node));
+    }
+
+    auto exists = [&](const NodeRef& node) {
+        return added.count(key(node)) || (exists_now(node) && !removed.count(key(node)));
+    };
+    auto check_link = [&](const ChangeSet::Link& link) {
+        if (link.src.kind == NodeKind::STOREHOUSE || link.dest.kind == NodeKind::RAMP) {
+            fail("invalid link " + node_name(link.src) + " -> " + node_name(link.dest));
+        }
+        if (!exists(link.src) || !exists(link.dest)) {
+            fail("link " + node_name(link.src) + " -> " + node_name(link.dest) + " refers to an unknown node");
+        }
+    };
+    for (const auto& link : changes.links_) {
+        check_link(link);
+        if (!(link.weight > 0.0) || !std::isfinite(link.weight)) {
+            fail("link weight must be a positive number");
+        }
+    }
+    for (const auto& link : changes.unlinks_) {
+        check_link(link);
+    }
+}
+
+void Factory::drain(const NodeRef& node, DrainPolicy policy, Time t) {
+    IPackageSender& sender = *find_sender(node);
+    std::vector<Package> packages;
+    auto take = [&packages](std::optional<Package>& buffer) {
+        if (buffer) {
+            packages.push_back(std::move(*buffer));
+            buffer.reset();
+        }
+    };
+    take(sender.get_sending_buffer());
+    if (node.kind == NodeKind::WORKER) {
+        Worker& worker = *workers_.find_by_id(node.id);
+        take(worker.get_processing_buffer());
+        while (auto p = worker.get_queue()->pop()) {
+            packages.push_back(std::move(*p));
+        }
+    } else {
+        auto& batch = ramps_.find_by_id(node.id)->get_batch();
+        std::move(batch.begin(), batch.end(), std::back_inserter(packages));
+        batch.clear();
     }
-    for (const auto& worker : workers_) {
-        node_colors[&worker] = NodeColor::UNVISITED;
+    if (policy == DrainPolicy::DISCARD) {
+        discarded_packages_ += packages.size();
+        if constexpr (metrics_enabled) {
+            for (const auto& p : packages) {
+                metrics_.package_dropped(p.get_id());
+            }
+        }
+        return;
     }
-    try {
-        for (const auto& ramp : ramps_) {
-            has_reachable_storehouse(&ramp, node_colors);
+    // Polprodukty, dla ktorych nie ma juz odbiorcy albo wylosowany odbiorca jest
+    // pelny, sa porzucane - usuwany nadawca nie moze ich zatrzymac.
+    for (auto& p : packages) {
+        IPackageReceiver* receiver = sender.receiver_preferences_.choose_receiver(t);
+        if (!receiver || !receiver->can_receive_package()) {
+            ++discarded_packages_;
+            if constexpr (metrics_enabled) {
+                metrics_.package_dropped(p.get_id());
+            }
+            continue;
         }
-    } catch (const std::logic_error&) {
+        if constexpr (metrics_enabled) {
+            if (receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
+                metrics_.package_stored(p.get_id(), t);
+            }
+        }
+        receiver->receive_package(std::move(p), t);
+        sender.receiver_preferences_.count_delivered();
+    }
+}
+
+void Factory::apply_changes(ChangeSet&& changes, Time t) {
+    validate(changes);
+
+    for (auto& ramp : changes.ramps_) add_ramp(std::move(ramp));
+    for (auto& worker : changes.workers_) add_worker(std::move(worker));
+    for (auto& store : changes.storehouses_) add_storehouse(std::move(store));
+    for (const auto& link : changes.links_) {
+        find_sender(link.src)->receiver_preferences_.add_receiver(find_receiver(link.dest), link.weight);
+    }
+    for (const auto& link : changes.unlinks_) {
+        find_sender(link.src)->receiver_preferences_.remove_receiver(find_receiver(link.dest));
+    }
+
+    // Usuwani odbiorcy sa odcinani przed oproznieniem nadawcow, zeby REROUTE
+    // nie skierowal polproduktow do wezla, ktory za chwile zniknie.
+    for (const auto& node : changes.removals_) {
+        if (node.kind != NodeKind::RAMP) {
+            remove_receiver_links(find_receiver(node));
+        }
+    }
+    for (const auto& node : changes.removals_) {
+        if (node.kind != NodeKind::STOREHOUSE) {
+            drain(node, changes.drain_, t);
+        }
+    }
+    for (const auto& node : changes.removals_) {
+        switch (node.kind) {
+        case NodeKind::RAMP: remove_ramp(node.id); break;
+        case NodeKind::WORKER: remove_worker(node.id); break;
+        case NodeKind::STOREHOUSE: remove_storehouse(node.id); break;
+        }
+    }
+}
+
+bool Factory::apply_pending_changes(Time t) {
+    if (pending_changes_.empty()) {
         return false;
     }
+    std::vector<ChangeSet> pending = std::move(pending_changes_);
+    pending_changes_.clear();
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+        try {
+            apply_changes(std::move(*it), t);
+        } catch (const std::invalid_argument&) {
+            // Odrzucony zestaw niczego nie zmienil; nastepne wracaja do kolejki,
+            // bo moga zalezec od wczesniejszych.
+            pending_changes_.insert(pending_changes_.begin(), std::make_move_iterator(it + 1),
+                                    std::make_move_iterator(pending.end()));
+            throw;
+        }
+    }
     return true;
-    
 }
 
 void Factory::do_deliveries(Time t) {
     for (auto& ramp : ramps_) {
+        do_delivery(ramp, t);
+    }
+}
+
+void Factory::do_delivery(Ramp& ramp, Time t) {
+    if constexpr (metrics_enabled) {
+        auto delivered = ramp.get_metrics().delivered;
+        ramp.deliver_goods(t);
+        if (ramp.get_metrics().delivered != delivered) {
+            if (ramp.get_batch_size() > 1) {
+                for (const auto& p : ramp.get_batch()) {
+                    metrics_.package_created(p.get_id(), t);
+                }
+            } else {
+                metrics_.package_created(ramp.get_sending_buffer()->get_id(), t);
+            }
+        }
+    } else {
         ramp.deliver_goods(t);
     }
 }
@@ -113,126 +315,365 @@ void Factory::do_work(Time t) {
     for (auto& worker : workers_) {
         worker.do_work(t);
     }
+    if constexpr (metrics_enabled) {
+        metrics_.last_turn = t;
+    }
 }
 
 void Factory::do_package_passing(Time t) {
+    auto pass = [this, t](IPackageSender& sender) {
+        if constexpr (metrics_enabled) {
+            ElementID id = sender.get_sending_buffer()->get_id();
+            IPackageReceiver* receiver = sender.send_package(t);
+            if (receiver && receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
+                metrics_.package_stored(id, t);
+            }
+        } else {
+            sender.send_package(t);
+        }
+    };
     for (auto& ramp : ramps_) {
-        if (ramp.get_sending_buffer()) {
-            ramp.send_package();
+        if (ramp.get_batch_size() > 1) {
+            if constexpr (metrics_enabled) {
+                ramp.send_batch(t, [this, t](IPackageReceiver* receiver, const Package* packages, std::size_t n) {
+                    if (receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
+                        for (std::size_t k = 0; k < n; ++k) {
+                            metrics_.package_stored(packages[k].get_id(), t);
+                        }
+                    }
+                });
+            } else {
+                ramp.send_batch(t);
+            }
+        } else if (ramp.get_sending_buffer()) {
+            pass(ramp);
         }
     }
-    for (auto& worker : workers_) {
-         if (worker.get_sending_buffer()) {
-            worker.send_package();
+    for (auto it = workers_.declared_begin(); it != workers_.declared_end(); ++it) {
+        if (it->get_sending_buffer()) {
+            pass(*it);
+        }
+    }
+}
+
+StructureParseError::StructureParseError(std::size_t line, std::size_t column, const std::string& message)
+    : std::runtime_error("line " + std::to_string(line) + ", column " + std::to_string(column) + ": " + message),
+      line_(line), column_(column) {}
+
+namespace {
+
+bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Wczytuje strukture z tekstu bez kopiowania: tokeny sa widokami na bufor wejsciowy.
+class StructureParser {
+public:
+    StructureParser(std::string_view text) : text_(text) {}
+
+    Factory parse() {
+        std::size_t pos = 0;
+        while (pos < text_.size()) {
+            std::size_t eol = text_.find('\n', pos);
+            if (eol == std::string_view::npos) eol = text_.size();
+            line_start_ = pos;
+            ++line_no_;
+            parse_line(text_.substr(pos, eol - pos));
+            pos = eol + 1;
+        }
+        return std::move(factory_);
+    }
+
+private:
+    struct Token {
+        std::string_view key;
+        std::string_view value;
+    };
+
+    [[noreturn]] void fail(std::string_view at, const std::string& message) const {
+        throw StructureParseError(line_no_, static_cast<std::size_t>(at.data() - text_.data()) - line_start_ + 1, message);
+    }
+
+    bool next_token(std::string_view& rest, std::string_view& token) const {
+        std::size_t b = 0;
+        while (b < rest.size() && is_blank(rest[b])) ++b;
+        if (b == rest.size()) return false;
+        std::size_t e = b;
+        while (e < rest.size() && !is_blank(rest[e])) ++e;
+        token = rest.substr(b, e - b);
+        rest.remove_prefix(e);
+        return true;
+    }
+
+    bool next_pair(std::string_view& rest, Token& t) const {
+        std::string_view token;
+        if (!next_token(rest, token)) return false;
+        auto eq = token.find('=');
+        t.key = token.substr(0, eq);
+        t.value = eq == std::string_view::npos ? token.substr(token.size()) : token.substr(eq + 1);
+        return true;
+    }
+
+    template <typename Number>
+    Number number(const Token& t) const {
+        Number value{};
+        auto [end, ec] = std::from_chars(t.value.data(), t.value.data() + t.value.size(), value);
+        if (ec != std::errc() || end != t.value.data() + t.value.size() || t.value.empty()) {
+            fail(t.value.empty() ? t.key : t.value, "invalid value '" + std::string(t.value) + "' for " + std::string(t.key));
+        }
+        return value;
+    }
+
+    void parse_line(std::string_view line) {
+        std::string_view type;
+        if (!next_token(line, type) || type[0] == ';') return;
+
+        if (type == "LOADING_RAMP") parse_ramp(line);
+        else if (type == "WORKER") parse_worker(line);
+        else if (type == "STOREHOUSE") parse_storehouse(line);
+        else if (type == "LINK") parse_link(type, line);
+    }
+
+    // Powtorzone ID wezla zglaszane jest w miejscu wartosci id.
+    template <typename Add>
+    void add_node(std::string_view at, Add add) {
+        try {
+            add();
+        } catch (const std::invalid_argument& e) {
+            fail(at, e.what());
+        }
+    }
+
+    void parse_ramp(std::string_view rest) {
+        ElementID id = 0;
+        std::string_view id_at = rest;
+        TimeOffset di = 1;
+        std::size_t batch = 1;
+        for (Token t; next_pair(rest, t);) {
+            if (t.key == "id") {
+                id = number<ElementID>(t);
+                id_at = t.value;
+            }
+            else if (t.key == "delivery-interval") {
+                di = number<TimeOffset>(t);
+                if (di <= 0) {
+                    fail(t.value, "delivery interval must be positive");
+                }
+            }
+            else if (t.key == "batch-size") {
+                batch = number<std::size_t>(t);
+                if (batch == 0) {
+                    fail(t.value, "batch size must be positive");
+                }
+            }
+        }
+        add_node(id_at, [&] { factory_.add_ramp(Ramp(id, di, batch)); });
+    }
+
+    std::size_t capacity(const Token& t) const {
+        auto c = number<std::size_t>(t);
+        if (c == 0) {
+            fail(t.value, "queue capacity must be positive");
+        }
+        return c;
+    }
+
+    void parse_worker(std::string_view rest) {
+        ElementID id = 0;
+        std::string_view id_at = rest;
+        TimeOffset pd = 1;
+        PackageQueueType qt = PackageQueueType::FIFO;
+        std::size_t cap = unbounded_capacity;
+        for (Token t; next_pair(rest, t);) {
+            if (t.key == "id") {
+                id = number<ElementID>(t);
+                id_at = t.value;
+            }
+            else if (t.key == "processing-time") {
+                pd = number<TimeOffset>(t);
+                if (pd <= 0) {
+                    fail(t.value, "processing time must be positive");
+                }
+            }
+            else if (t.key == "queue-capacity") cap = capacity(t);
+            else if (t.key == "queue-type") {
+                if (t.value == "FIFO") qt = PackageQueueType::FIFO;
+                else if (t.value == "LIFO") qt = PackageQueueType::LIFO;
+                else if (t.value == "AGE") qt = PackageQueueType::AGE;
+                else fail(t.value, "unknown queue type '" + std::string(t.value) + "'");
+            }
+        }
+        add_node(id_at, [&] { factory_.add_worker(Worker(id, pd, std::make_unique<PackageQueue>(qt, cap))); });
+    }
+
+    void parse_storehouse(std::string_view rest) {
+        ElementID id = 0;
+        std::string_view id_at = rest;
+        std::size_t cap = unbounded_capacity;
+        StorehouseRetention retention = StorehouseRetention::FULL;
+        std::string_view retention_value;
+        std::size_t window = 0;
+        for (Token t; next_pair(rest, t);) {
+            if (t.key == "id") {
+                id = number<ElementID>(t);
+                id_at = t.value;
+            }
+            else if (t.key == "queue-capacity") cap = capacity(t);
+            else if (t.key == "window-size") {
+                window = number<std::size_t>(t);
+                if (window == 0) {
+                    fail(t.value, "window size must be positive");
+                }
+            }
+            else if (t.key == "retention") {
+                retention_value = t.value;
+                if (t.value == "full") retention = StorehouseRetention::FULL;
+                else if (t.value == "window") retention = StorehouseRetention::WINDOW;
+                else if (t.value == "count") retention = StorehouseRetention::COUNT;
+                else fail(t.value, "unknown retention '" + std::string(t.value) + "'");
+            }
+        }
+        if (retention == StorehouseRetention::WINDOW && window == 0) {
+            fail(retention_value, "retention=window requires window-size");
+        }
+        Storehouse store(id, std::make_unique<PackageQueue>(PackageQueueType::FIFO, cap));
+        store.set_retention(retention, window);
+        add_node(id_at, [&] { factory_.add_storehouse(std::move(store)); });
+    }
+
+    std::pair<std::string_view, ElementID> endpoint(const Token& t) const {
+        auto dash = t.value.find('-');
+        if (dash == std::string_view::npos) {
+            fail(t.value, "expected <type>-<id> in " + std::string(t.key));
         }
+        Token id_token{t.key, t.value.substr(dash + 1)};
+        return {t.value.substr(0, dash), number<ElementID>(id_token)};
     }
+
+    // Brak src/dest zglaszany jest przy slowie LINK, pozostale bledy przy tokenie.
+    void parse_link(std::string_view keyword, std::string_view rest) {
+        Token src, dest;
+        double weight = 1.0;
+        for (Token t; next_pair(rest, t);) {
+            if (t.key == "src") src = t;
+            else if (t.key == "dest") dest = t;
+            else if (t.key == "weight") {
+                weight = number<double>(t);
+                if (!(weight > 0.0) || !std::isfinite(weight)) {
+                    fail(t.value, "LINK weight must be a positive finite number");
+                }
+            }
+        }
+        if (src.value.empty()) fail(src.key.empty() ? keyword : src.key, "LINK without src");
+        if (dest.value.empty()) fail(dest.key.empty() ? keyword : dest.key, "LINK without dest");
+
+        auto [src_type, src_id] = endpoint(src);
+        auto [dest_type, dest_id] = endpoint(dest);
+
+        IPackageSender* sender = nullptr;
+        if (src_type == "ramp") {
+            auto it = factory_.find_ramp_by_id(src_id);
+            if (it == factory_.ramp_end()) fail(src.value, "unknown ramp #" + std::to_string(src_id));
+            sender = &(*it);
+        } else if (src_type == "worker") {
+            auto it = factory_.find_worker_by_id(src_id);
+            if (it == factory_.worker_end()) fail(src.value, "unknown worker #" + std::to_string(src_id));
+            sender = &(*it);
+        } else {
+            fail(src.value, "invalid link source '" + std::string(src_type) + "'");
+        }
+
+        IPackageReceiver* receiver = nullptr;
+        if (dest_type == "worker") {
+            auto it = factory_.find_worker_by_id(dest_id);
+            if (it == factory_.worker_end()) fail(dest.value, "unknown worker #" + std::to_string(dest_id));
+            receiver = &(*it);
+        } else if (dest_type == "store") {
+            auto it = factory_.find_storehouse_by_id(dest_id);
+            if (it == factory_.storehouse_end()) fail(dest.value, "unknown storehouse #" + std::to_string(dest_id));
+            receiver = &(*it);
+        } else {
+            fail(dest.value, "invalid link destination '" + std::string(dest_type) + "'");
+        }
+
+        sender->receiver_preferences_.add_receiver(receiver, weight);
+    }
+
+    std::string_view text_;
+    std::size_t line_start_ = 0;
+    std::size_t line_no_ = 0;
+    Factory factory_;
+};
+
 }
 
-std::pair<std::string, std::string> parse_key_value(const std::string& token) {
-    auto pos = token.find('=');
-    if (pos == std::string::npos) return {token, ""};
-    return {token.substr(0, pos), token.substr(pos + 1)};
+Factory load_factory_structure(std::string_view text) {
+    return StructureParser(text).parse();
 }
 
 Factory load_factory_structure(std::istream& is) {
-    Factory factory;
-    std::string line;
-    
-    while (std::getline(is, line)) {
-        if (line.empty() || line[0] == ';') continue; 
-        
-        std::istringstream iss(line);
-        std::string type;
-        iss >> type;
-        
-        if (type == "LOADING_RAMP") {
-            std::string token;
-            ElementID id = 0;
-            TimeOffset di = 1;
-            while (iss >> token) {
-                auto [key, val] = parse_key_value(token);
-                if (key == "id") id = std::stoi(val);
-                else if (key == "delivery-interval") di = std::stoi(val);
-            }
-            factory.add_ramp(Ramp(id, di));
-        } else if (type == "WORKER") {
-            std::string token;
-            ElementID id = 0;
-            TimeOffset pd = 1;
-            PackageQueueType qt = PackageQueueType::FIFO;
-            while (iss >> token) {
-                auto [key, val] = parse_key_value(token);
-                if (key == "id") id = std::stoi(val);
-                else if (key == "processing-time") pd = std::stoi(val);
-                else if (key == "queue-type") qt = (val == "LIFO") ? PackageQueueType::LIFO : PackageQueueType::FIFO;
-            }
-            factory.add_worker(Worker(id, pd, std::make_unique<PackageQueue>(qt)));
-        } else if (type == "STOREHOUSE") {
-            std::string token;
-            ElementID id = 0;
-            while (iss >> token) {
-                auto [key, val] = parse_key_value(token);
-                if (key == "id") id = std::stoi(val);
-            }
-            factory.add_storehouse(Storehouse(id));
-        } else if (type == "LINK") {
-            std::string token;
-            std::string src_val, dest_val;
-            while (iss >> token) {
-                auto [key, val] = parse_key_value(token);
-                if (key == "src") src_val = val;
-                else if (key == "dest") dest_val = val;
-            }
-            
-            auto parse_node_id = [](const std::string& s) -> std::pair<std::string, ElementID> {
-                auto pos = s.find('-');
-                return {s.substr(0, pos), std::stoi(s.substr(pos + 1))};
-            };
-            
-            auto [src_type, src_id] = parse_node_id(src_val);
-            auto [dest_type, dest_id] = parse_node_id(dest_val);
-
-            IPackageSender* sender = nullptr;
-            if (src_type == "ramp") sender = &(*factory.find_ramp_by_id(src_id));
-            else if (src_type == "worker") sender = &(*factory.find_worker_by_id(src_id));
-
-            IPackageReceiver* receiver = nullptr;
-            if (dest_type == "worker") receiver = &(*factory.find_worker_by_id(dest_id));
-            else if (dest_type == "store") receiver = &(*factory.find_storehouse_by_id(dest_id));
-
-            if (sender && receiver) {
-                sender->receiver_preferences_.add_receiver(receiver);
-            }
-        }
-    }
-    return factory;
+    std::string text(std::istreambuf_iterator<char>(is), {});
+    return load_factory_structure(std::string_view(text));
+}
+
+Factory load_factory_structure_file(const std::string& path) {
+    MappedFile file(path);
+    return load_factory_structure(file.view());
+}
+
+static void save_capacity(std::ostream& os, const IPackageStockpile& stockpile) {
+    if (stockpile.capacity() != unbounded_capacity) {
+        os << " queue-capacity=" << stockpile.capacity();
+    }
+}
+
+static void save_links(std::ostream& os, const char* src_type, ElementID src_id, const ReceiverPreferences& prefs) {
+    for (const auto& [receiver, prob] : prefs.get_preferences()) {
+        std::string dest_type = (receiver->get_receiver_type() == ReceiverType::WORKER) ? "worker" : "store";
+        os << "LINK src=" << src_type << "-" << src_id << " dest=" << dest_type << "-" << receiver->get_id();
+        double weight = prefs.get_weight(receiver);
+        if (weight != 1.0) {
+            // Najkrotszy zapis, ktory wczytuje sie jako ta sama liczba (klony
+            // fabryki przez tekst struktury maja te same wagi co zrodlo).
+            char buf[32];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), weight);
+            os << " weight=" << std::string_view(buf, static_cast<std::size_t>(end - buf));
+        }
+        os << "\n";
+    }
 }
 
 void save_factory_structure(const Factory& factory, std::ostream& os) {
     for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
-        os << "LOADING_RAMP id=" << it->get_id() << " delivery-interval=" << it->get_delivery_interval() << "\n";
+        os << "LOADING_RAMP id=" << it->get_id() << " delivery-interval=" << it->get_delivery_interval();
+        if (it->get_batch_size() > 1) {
+            os << " batch-size=" << it->get_batch_size();
+        }
+        os << "\n";
     }
 
-    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
-        std::string q_type = (it->get_queue()->get_queue_type() == PackageQueueType::LIFO) ? "LIFO" : "FIFO";
-        os << "WORKER id=" << it->get_id() << " processing-time=" << it->get_processing_duration() << " queue-type=" << q_type << "\n";
+    for (auto it = factory.worker_declared_begin(); it != factory.worker_declared_end(); ++it) {
+        PackageQueueType qt = it->get_queue()->get_queue_type();
+        std::string q_type = qt == PackageQueueType::LIFO ? "LIFO" : qt == PackageQueueType::AGE ? "AGE" : "FIFO";
+        os << "WORKER id=" << it->get_id() << " processing-time=" << it->get_processing_duration() << " queue-type=" << q_type;
+        save_capacity(os, *it->get_queue());
+        os << "\n";
     }
 
     for (auto it = factory.storehouse_cbegin(); it != factory.storehouse_cend(); ++it) {
-        os << "STOREHOUSE id=" << it->get_id() << "\n";
+        os << "STOREHOUSE id=" << it->get_id();
+        save_capacity(os, *it->get_queue());
+        if (it->get_retention() == StorehouseRetention::WINDOW) {
+            os << " retention=window window-size=" << it->get_window_size();
+        } else if (it->get_retention() == StorehouseRetention::COUNT) {
+            os << " retention=count";
+        }
+        os << "\n";
     }
 
     for (auto it = factory.ramp_cbegin(); it != factory.ramp_cend(); ++it) {
-        for (const auto& [receiver, prob] : it->receiver_preferences_.get_preferences()) {
-             std::string dest_type = (receiver->get_receiver_type() == ReceiverType::WORKER) ? "worker" : "store";
-             os << "LINK src=ramp-" << it->get_id() << " dest=" << dest_type << "-" << receiver->get_id() << "\n";
-        }
+        save_links(os, "ramp", it->get_id(), it->receiver_preferences_);
     }
 
-    for (auto it = factory.worker_cbegin(); it != factory.worker_cend(); ++it) {
-        for (const auto& [receiver, prob] : it->receiver_preferences_.get_preferences()) {
-             std::string dest_type = (receiver->get_receiver_type() == ReceiverType::WORKER) ? "worker" : "store";
-             os << "LINK src=worker-" << it->get_id() << " dest=" << dest_type << "-" << receiver->get_id() << "\n";
-        }
+    for (auto it = factory.worker_declared_begin(); it != factory.worker_declared_end(); ++it) {
+        save_links(os, "worker", it->get_id(), it->receiver_preferences_);
     }
 }
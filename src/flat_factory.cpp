@@ -0,0 +1,394 @@
+#include "flat_factory.hxx"
+#include "package_id_allocator.hxx"
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NETSIM_X86_KERNELS 1
+#endif
+
+namespace {
+
+constexpr std::size_t block_size = 64;
+
+std::uint64_t block_bits(std::size_t n) {
+    return n >= block_size ? ~std::uint64_t{0} : (std::uint64_t{1} << n) - 1;
+}
+
+// Bit i maski jest ustawiony, gdy due[i] <= t (n <= 64).
+std::uint64_t due_mask_scalar(const Time* due, std::size_t n, Time t) {
+    std::uint64_t mask = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        mask |= std::uint64_t{due[i] <= t} << i;
+    }
+    return mask;
+}
+
+#ifdef NETSIM_X86_KERNELS
+
+std::uint64_t due_mask_sse2(const Time* due, std::size_t n, Time t) {
+    static_assert(sizeof(Time) == 4, "SIMD kernels assume 32-bit Time");
+    const __m128i limit = _mm_set1_epi32(t);
+    std::uint64_t later = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(due + i));
+        auto bits = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, limit))));
+        later |= std::uint64_t{bits} << i;
+    }
+    std::uint64_t mask = ~later & block_bits(i);
+    if (i < n) {
+        mask |= due_mask_scalar(due + i, n - i, t) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+std::uint64_t due_mask_avx2(const Time* due, std::size_t n, Time t) {
+    const __m256i limit = _mm256_set1_epi32(t);
+    std::uint64_t later = 0;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(due + i));
+        auto bits = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, limit))));
+        later |= std::uint64_t{bits} << i;
+    }
+    std::uint64_t mask = ~later & block_bits(i);
+    if (i < n) {
+        mask |= due_mask_scalar(due + i, n - i, t) << i;
+    }
+    return mask;
+}
+
+#endif
+
+// Plaska postac trzyma same ID, a tury powstania (potrzebne kolejkom AGE)
+// osobno, w tablicy indeksowanej ID.
+void note_created(std::vector<Time>& created, ElementID id, Time t) {
+    if (static_cast<std::size_t>(id) >= created.size()) {
+        created.resize(static_cast<std::size_t>(id) + 1);
+    }
+    created[static_cast<std::size_t>(id)] = t;
+}
+
+ElementID take(std::optional<Package>& buffer, std::vector<Time>& created) {
+    ElementID id = FlatFactory::no_package;
+    if (buffer) {
+        note_created(created, buffer->get_id(), buffer->get_creation_time());
+        id = buffer->release();
+    }
+    buffer.reset();
+    return id;
+}
+
+void put(std::optional<Package>& buffer, ElementID id, const std::vector<Time>& created) {
+    if (buffer) {
+        buffer->release();
+    }
+    buffer.reset();
+    if (id != FlatFactory::no_package) {
+        buffer.emplace(id, created[static_cast<std::size_t>(id)]);
+    }
+}
+
+template <typename Out>
+void drain(IPackageStockpile& stockpile, Out& out, std::vector<Time>& created) {
+    for (const auto& p : stockpile) {
+        note_created(created, p.get_id(), p.get_creation_time());
+        out.push_back(ElementID(p.get_id()));
+    }
+    while (auto p = stockpile.pop()) {
+        p->release();
+    }
+}
+
+}
+
+FlatFactory::CompletionKernel FlatFactory::best_kernel() {
+    if (kernel_supported(CompletionKernel::AVX2)) return CompletionKernel::AVX2;
+    if (kernel_supported(CompletionKernel::SSE2)) return CompletionKernel::SSE2;
+    return CompletionKernel::SCALAR;
+}
+
+bool FlatFactory::kernel_supported(CompletionKernel kernel) {
+    switch (kernel) {
+#ifdef NETSIM_X86_KERNELS
+    case CompletionKernel::AVX2: return __builtin_cpu_supports("avx2");
+    case CompletionKernel::SSE2: return __builtin_cpu_supports("sse2");
+#endif
+    case CompletionKernel::SCALAR: return true;
+    default: return false;
+    }
+}
+
+void FlatFactory::set_kernel(CompletionKernel kernel) {
+    if (!kernel_supported(kernel)) {
+        throw std::invalid_argument("Completion kernel is not supported on this CPU.");
+    }
+    kernel_ = kernel;
+    switch (kernel) {
+#ifdef NETSIM_X86_KERNELS
+    case CompletionKernel::AVX2: due_mask_ = due_mask_avx2; break;
+    case CompletionKernel::SSE2: due_mask_ = due_mask_sse2; break;
+#endif
+    default: due_mask_ = due_mask_scalar; break;
+    }
+}
+
+FlatFactory::FlatFactory(Factory& f) : metrics_(f.metrics()) {
+    set_kernel(best_kernel());
+    std::unordered_map<const IPackageReceiver*, std::uint32_t> receiver_index;
+
+    for (auto& ramp : f.ramp_collection()) {
+        if (ramp.get_batch_size() > 1) {
+            throw std::invalid_argument("Flat engine does not support batched ramps.");
+        }
+        ramps_.push_back(&ramp);
+        ramp_di_.push_back(ramp.get_delivery_interval());
+        ramp_buffer_.push_back(take(ramp.get_sending_buffer(), package_created_));
+        sender_blocked_.push_back(ramp.get_blocked_turns());
+        if constexpr (metrics_enabled) {
+            ramp_metrics_.push_back(ramp.get_metrics());
+        }
+    }
+    // Kolejnosc deklaracji - w niej simulate() wysyla polprodukty robotnikow.
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        Worker& worker = *it;
+        receiver_index.emplace(&worker, static_cast<std::uint32_t>(workers_.size()));
+        workers_.push_back(&worker);
+        worker_pd_.push_back(worker.get_processing_duration());
+        worker_start_.push_back(worker.get_package_processing_start_time());
+        worker_processing_.push_back(take(worker.get_processing_buffer(), package_created_));
+        worker_sending_.push_back(take(worker.get_sending_buffer(), package_created_));
+        worker_queue_type_.push_back(worker.get_queue()->get_queue_type());
+        worker_capacity_.push_back(worker.get_queue()->capacity());
+        sender_blocked_.push_back(worker.get_blocked_turns());
+        if constexpr (metrics_enabled) {
+            worker_metrics_.push_back(worker.get_metrics());
+        }
+        drain(*worker.get_queue(), worker_queue_.emplace_back(), package_created_);
+        worker_due_.push_back(worker_processing_.back() == no_package ? idle_due
+                              : worker_start_.back() + worker_pd_.back() - 1);
+    }
+    worker_waiting_.assign((workers_.size() + block_size - 1) / block_size, 0);
+    for (std::size_t w = 0; w < workers_.size(); ++w) {
+        if (!worker_queue_[w].empty()) {
+            worker_waiting_[w / block_size] |= std::uint64_t{1} << (w % block_size);
+        }
+    }
+    for (auto& store : f.storehouse_collection()) {
+        receiver_index.emplace(&store, static_cast<std::uint32_t>(workers_.size() + storehouses_.size()));
+        storehouses_.push_back(&store);
+    }
+
+    auto add_links = [&](const IPackageSender& sender) {
+        const auto& prefs = sender.receiver_preferences_;
+        double distribution = 0.0;
+        for (const auto& [receiver, p] : prefs.get_preferences()) {
+            distribution += p;
+            link_target_.push_back(receiver_index.at(receiver));
+            link_cumulative_.push_back(distribution);
+            if constexpr (metrics_enabled) {
+                link_traffic_.push_back(prefs.get_traffic(receiver));
+            }
+        }
+        link_offset_.push_back(static_cast<std::uint32_t>(link_target_.size()));
+        sender_pg_.push_back(&prefs.get_probability_generator());
+        sender_rng_.push_back(prefs.get_counter_rng() ? &*prefs.get_counter_rng() : nullptr);
+        sender_stream_.push_back(prefs.get_stream());
+    };
+    link_offset_.push_back(0);
+    for (Ramp* ramp : ramps_) {
+        add_links(*ramp);
+    }
+    for (Worker* worker : workers_) {
+        add_links(*worker);
+    }
+}
+
+void FlatFactory::do_deliveries(Time t) {
+    for (std::size_t r = 0; r < ramp_di_.size(); ++r) {
+        if ((t - 1) % ramp_di_[r] == 0 && ramp_buffer_[r] == no_package) {
+            ramp_buffer_[r] = PackageIdAllocator::current().allocate();
+            note_created(package_created_, ramp_buffer_[r], t);
+            if constexpr (metrics_enabled) {
+                ++ramp_metrics_[r].delivered;
+                metrics_.package_created(ramp_buffer_[r], t);
+            }
+        }
+    }
+}
+
+bool FlatFactory::send(std::size_t sender, ElementID package, Time t) {
+    std::uint32_t begin = link_offset_[sender];
+    std::uint32_t end = link_offset_[sender + 1];
+    if (begin == end) {
+        PackageIdAllocator::current().release(package);
+        return true;
+    }
+
+    // Nadawca losuje co najwyzej raz na ture, wiec numer losowania to zawsze 0.
+    double p = sender_rng_[sender] ? sender_rng_[sender]->canonical(static_cast<std::uint64_t>(t), sender_stream_[sender], 0)
+                                   : (*sender_pg_[sender])();
+    auto first = link_cumulative_.begin() + begin;
+    auto last = link_cumulative_.begin() + end;
+    auto it = std::lower_bound(first, last, p);
+    std::uint32_t link = it != last ? begin + static_cast<std::uint32_t>(it - first) : end - 1;
+    std::uint32_t target = link_target_[link];
+
+    if (target < worker_queue_.size()) {
+        if (worker_queue_[target].size() >= worker_capacity_[target]) {
+            ++sender_blocked_[sender];
+            return false;
+        }
+        if (worker_queue_type_[target] == PackageQueueType::AGE) {
+            AgePriorityPolicy::push(worker_queue_[target], ElementID(package),
+                                    [this](ElementID id) { return package_created_[static_cast<std::size_t>(id)]; });
+        } else {
+            worker_queue_[target].push_back(ElementID(package));
+        }
+        if constexpr (metrics_enabled) {
+            auto& high_water = worker_metrics_[target].queue_high_water;
+            high_water = std::max(high_water, worker_queue_[target].size());
+        }
+        worker_waiting_[target / block_size] |= std::uint64_t{1} << (target % block_size);
+    } else {
+        Storehouse& store = *storehouses_[target - worker_queue_.size()];
+        if (!store.can_receive_package()) {
+            ++sender_blocked_[sender];
+            return false;
+        }
+        store.receive_package(Package(package, package_created_[static_cast<std::size_t>(package)]), t);
+        if constexpr (metrics_enabled) {
+            metrics_.package_stored(package, t);
+        }
+    }
+    if constexpr (metrics_enabled) {
+        ++link_traffic_[link];
+    }
+    return true;
+}
+
+void FlatFactory::do_package_passing(Time t) {
+    std::size_t ramps = ramp_buffer_.size();
+    for (std::size_t r = 0; r < ramps; ++r) {
+        if (ramp_buffer_[r] != no_package && send(r, ramp_buffer_[r], t)) {
+            ramp_buffer_[r] = no_package;
+        }
+    }
+    for (std::size_t w = 0; w < worker_sending_.size(); ++w) {
+        if (worker_sending_[w] != no_package && send(ramps + w, worker_sending_[w], t)) {
+            worker_sending_[w] = no_package;
+        }
+    }
+}
+
+// Robotnicy sa od siebie niezalezni, wiec w bloku najpierw startuja wszyscy
+// wolni z niepusta kolejka, a potem konczy sie praca wskazana przez maske.
+void FlatFactory::do_work(Time t) {
+    std::size_t workers = worker_pd_.size();
+    for (std::size_t base = 0, b = 0; base < workers; base += block_size, ++b) {
+        std::size_t n = std::min(block_size, workers - base);
+        const Time* due = worker_due_.data() + base;
+
+        std::uint64_t idle = ~due_mask_(due, n, idle_due - 1) & block_bits(n);
+        for (std::uint64_t m = worker_waiting_[b] & idle; m; m &= m - 1) {
+            std::size_t w = base + static_cast<std::size_t>(__builtin_ctzll(m));
+            auto& queue = worker_queue_[w];
+            worker_processing_[w] = worker_queue_type_[w] == PackageQueueType::LIFO ? queue.pop_back() : queue.pop_front();
+            worker_start_[w] = t;
+            worker_due_[w] = t + worker_pd_[w] - 1;
+            if (queue.empty()) {
+                worker_waiting_[b] &= ~(std::uint64_t{1} << (w - base));
+            }
+        }
+
+        for (std::uint64_t m = due_mask_(due, n, t); m; m &= m - 1) {
+            std::size_t w = base + static_cast<std::size_t>(__builtin_ctzll(m));
+            if (worker_sending_[w] != no_package) {
+                continue;  // zablokowany - sprobuje w nastepnej turze
+            }
+            worker_sending_[w] = std::exchange(worker_processing_[w], no_package);
+            worker_due_[w] = idle_due;
+            if constexpr (metrics_enabled) {
+                ++worker_metrics_[w].processed;
+                worker_metrics_[w].busy_turns += static_cast<std::uint64_t>(t - worker_start_[w] + 1);
+            }
+        }
+    }
+    if constexpr (metrics_enabled) {
+        metrics_.last_turn = t;
+    }
+}
+
+void FlatFactory::sync_to_factory() const {
+    for (std::size_t r = 0; r < ramps_.size(); ++r) {
+        put(ramps_[r]->get_sending_buffer(), ramp_buffer_[r], package_created_);
+        ramps_[r]->set_blocked_turns(sender_blocked_[r]);
+        if constexpr (metrics_enabled) {
+            ramps_[r]->set_metrics(ramp_metrics_[r]);
+        }
+    }
+    for (std::size_t w = 0; w < workers_.size(); ++w) {
+        Worker& worker = *workers_[w];
+        put(worker.get_processing_buffer(), worker_processing_[w], package_created_);
+        put(worker.get_sending_buffer(), worker_sending_[w], package_created_);
+        worker.set_package_processing_start_time(worker_start_[w]);
+        worker.set_blocked_turns(sender_blocked_[ramps_.size() + w]);
+        if constexpr (metrics_enabled) {
+            worker.set_metrics(worker_metrics_[w]);
+        }
+
+        IPackageStockpile& queue = *worker.get_queue();
+        while (auto p = queue.pop()) {
+            p->release();
+        }
+        const auto& ring = worker_queue_[w];
+        for (std::size_t i = 0; i < ring.size(); ++i) {
+            queue.push(Package(ring[i], package_created_[static_cast<std::size_t>(ring[i])]));
+        }
+    }
+    if constexpr (metrics_enabled) {
+        for (std::size_t s = 0; s + 1 < link_offset_.size(); ++s) {
+            IPackageSender& sender = s < ramps_.size() ? static_cast<IPackageSender&>(*ramps_[s]) : *workers_[s - ramps_.size()];
+            for (std::uint32_t k = link_offset_[s]; k < link_offset_[s + 1]; ++k) {
+                sender.receiver_preferences_.set_traffic(k - link_offset_[s], link_traffic_[k]);
+            }
+        }
+    }
+}
+
+void simulate_flat(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf,
+                   std::function<bool(Time)> report_turns, Time first_turn) {
+    if (!f.is_consistent()) {
+        throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+    }
+
+    std::optional<FlatFactory> flat;
+    flat.emplace(f);
+    for (Time t = first_turn; t <= rounds; ++t) {
+        // Zmiany struktury: stan wraca do fabryki, a tablice sa budowane od nowa.
+        if (f.has_pending_changes()) {
+            flat->sync_to_factory();
+            flat.reset();
+            f.apply_pending_changes(t);
+            if (!f.is_consistent()) {
+                throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+            }
+            flat.emplace(f);
+        }
+
+        flat->do_deliveries(t);
+        flat->do_package_passing(t);
+        flat->do_work(t);
+
+        if (!report_turns || report_turns(t)) {
+            flat->sync_to_factory();
+            rf(f, t);
+        }
+    }
+    flat->sync_to_factory();
+}
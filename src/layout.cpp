@@ -0,0 +1,47 @@
+#include "layout.hxx"
+#include <unordered_map>
+
+std::vector<ElementID> locality_order(const Factory& f) {
+    std::unordered_map<const IPackageReceiver*, std::size_t> index;
+    std::vector<const Worker*> workers;
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        index.emplace(&*it, workers.size());
+        workers.push_back(&*it);
+    }
+
+    std::vector<bool> seen(workers.size(), false);
+    std::vector<ElementID> order;
+    order.reserve(workers.size());
+    std::size_t head = 0;
+    auto visit = [&](const ReceiverPreferences& prefs) {
+        for (const auto& [receiver, p] : prefs) {
+            auto it = index.find(receiver);
+            if (it != index.end() && !seen[it->second]) {
+                seen[it->second] = true;
+                order.push_back(workers[it->second]->get_id());
+            }
+        }
+    };
+    auto drain = [&] {
+        for (; head < order.size(); ++head) {
+            visit(f.find_worker_by_id(order[head])->receiver_preferences_);
+        }
+    };
+
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        visit(it->receiver_preferences_);
+    }
+    drain();
+    for (std::size_t w = 0; w < workers.size(); ++w) {
+        if (!seen[w]) {
+            seen[w] = true;
+            order.push_back(workers[w]->get_id());
+            drain();
+        }
+    }
+    return order;
+}
+
+void optimize_layout(Factory& f) {
+    f.relayout_workers(locality_order(f));
+}
@@ -0,0 +1,55 @@
+#include "metrics.hxx"
+#include <algorithm>
+
+namespace {
+
+constexpr unsigned sub_bucket_bits = 4;
+constexpr std::uint64_t sub_buckets = std::uint64_t{1} << sub_bucket_bits;
+
+}
+
+std::size_t LatencyHistogram::bucket_of(std::uint64_t value) {
+    if (value < 2 * sub_buckets) {
+        return static_cast<std::size_t>(value);
+    }
+    unsigned shift = 63 - __builtin_clzll(value) - sub_bucket_bits;
+    std::uint64_t sub = value >> shift;
+    return static_cast<std::size_t>(sub_buckets + shift * sub_buckets + (sub - sub_buckets));
+}
+
+std::uint64_t LatencyHistogram::bucket_upper_bound(std::size_t i) {
+    if (i < 2 * sub_buckets) {
+        return i;
+    }
+    std::uint64_t shift = (i - sub_buckets) / sub_buckets;
+    std::uint64_t sub = sub_buckets + (i - sub_buckets) % sub_buckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::uint64_t value) {
+    std::size_t b = bucket_of(value);
+    if (b >= counts_.size()) {
+        counts_.resize(b + 1, 0);
+    }
+    ++counts_[b];
+    ++count_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+std::uint64_t LatencyHistogram::percentile(double q) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(q / 100.0 * count_ + 0.5);
+    rank = std::clamp<std::uint64_t>(rank, 1, count_);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(bucket_upper_bound(i), max_);
+        }
+    }
+    return max_;
+}
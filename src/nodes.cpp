@@ -1,86 +1,389 @@
 #include "nodes.hxx"
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <numeric>
+#include <stdexcept>
 
 Storehouse::Storehouse(ElementID id, std::unique_ptr<IPackageStockpile> d) 
     : id_(id), d_(std::move(d)) {}
 
 void Storehouse::receive_package(Package&& p) {
-    d_->push(std::move(p));
+    ++stats_.received;
+    if (retention_ != StorehouseRetention::COUNT) {
+        d_->push(std::move(p));
+        trim();
+    }
+    if constexpr (metrics_enabled) {
+        ++metrics_.received;
+        metrics_.stock_high_water = std::max(metrics_.stock_high_water, d_->size());
+    }
+}
+
+void Storehouse::receive_package(Package&& p, Time t) {
+    if (stats_.first_arrival == 0) {
+        stats_.first_arrival = t;
+    }
+    if (stats_.last_arrival != t) {
+        stats_.last_arrival = t;
+        ++stats_.arrival_turns;
+    }
+    receive_package(std::move(p));
+}
+
+void Storehouse::set_retention(StorehouseRetention retention, std::size_t window_size) {
+    if (retention == StorehouseRetention::WINDOW && window_size == 0) {
+        throw std::invalid_argument("Storehouse window size must be positive.");
+    }
+    retention_ = retention;
+    window_size_ = retention == StorehouseRetention::WINDOW ? window_size : 0;
+    trim();
+}
+
+void Storehouse::trim() {
+    std::size_t keep = retention_ == StorehouseRetention::FULL ? d_->size()
+                     : retention_ == StorehouseRetention::WINDOW ? window_size_ : 0;
+    while (d_->size() > keep) {
+        d_->pop();
+    }
 }
 
 ReceiverPreferences::ReceiverPreferences(ProbabilityGenerator pg) : pg_(pg) {}
 
-void ReceiverPreferences::add_receiver(IPackageReceiver* receiver) {
-    preferences_[receiver] = 1.0;
-    double p = 1.0 / preferences_.size();
-    for (auto& item : preferences_) {
-        item.second = p;
+ReceiverPreferences::ReceiverPreferences(const ReceiverPreferences& other, std::pmr::memory_resource* resource)
+    : pg_(other.pg_), counter_rng_(other.counter_rng_), stream_(other.stream_),
+      draw_turn_(other.draw_turn_), draw_index_(other.draw_index_),
+      receivers_(other.receivers_, resource), weights_(other.weights_, resource),
+      traffic_(other.traffic_, resource), preferences_(other.preferences_, resource),
+      cumulative_(other.cumulative_, resource), dirty_(other.dirty_) {}
+
+void ReceiverPreferences::add_receiver(IPackageReceiver* receiver, double weight) {
+    if (!(weight > 0.0) || !std::isfinite(weight)) {
+        throw std::invalid_argument("Receiver weight must be a positive number.");
+    }
+    auto it = std::find(receivers_.begin(), receivers_.end(), receiver);
+    if (it != receivers_.end()) {
+        weights_[it - receivers_.begin()] = weight;
+    } else {
+        receivers_.push_back(receiver);
+        weights_.push_back(weight);
+        traffic_.push_back(0);
+        if (observer_.observer) {
+            observer_.observer->on_link_added(observer_.owner, receiver);
+        }
     }
+    dirty_ = true;
 }
 
 void ReceiverPreferences::remove_receiver(IPackageReceiver* receiver) {
-    preferences_.erase(receiver);
-    if (!preferences_.empty()) {
-        double p = 1.0 / preferences_.size();
-        for (auto& item : preferences_) {
-            item.second = p;
+    auto it = std::find(receivers_.begin(), receivers_.end(), receiver);
+    if (it != receivers_.end()) {
+        weights_.erase(weights_.begin() + (it - receivers_.begin()));
+        traffic_.erase(traffic_.begin() + (it - receivers_.begin()));
+        receivers_.erase(it);
+        dirty_ = true;
+        if (observer_.observer) {
+            observer_.observer->on_link_removed(observer_.owner, receiver);
         }
     }
 }
 
-IPackageReceiver* ReceiverPreferences::choose_receiver() {
-    double p = pg_(); 
+void ReceiverPreferences::replace_receivers(const std::unordered_map<const IPackageReceiver*, IPackageReceiver*>& moved) {
+    for (IPackageReceiver*& receiver : receivers_) {
+        auto it = moved.find(receiver);
+        if (it != moved.end()) {
+            receiver = it->second;
+            dirty_ = true;
+        }
+    }
+}
+
+double ReceiverPreferences::get_weight(const IPackageReceiver* receiver) const {
+    auto it = std::find(receivers_.begin(), receivers_.end(), receiver);
+    return it != receivers_.end() ? weights_[it - receivers_.begin()] : 0.0;
+}
+
+namespace {
+
+// Przypisanie nie zmienia alokatora kontenera pmr, wiec kontener jest budowany od nowa.
+template <typename Container>
+void rebind(Container& c, std::pmr::memory_resource* resource) {
+    if (c.get_allocator().resource() == resource) {
+        return;
+    }
+    Container moved(std::move(c), resource);
+    c.~Container();
+    ::new (static_cast<void*>(&c)) Container(std::move(moved));
+}
+
+}
+
+void ReceiverPreferences::set_memory_resource(std::pmr::memory_resource* resource) {
+    rebind(receivers_, resource);
+    rebind(weights_, resource);
+    rebind(traffic_, resource);
+    rebind(preferences_, resource);
+    rebind(cumulative_, resource);
+}
+
+std::uint64_t ReceiverPreferences::get_traffic(const IPackageReceiver* receiver) const {
+    auto it = std::find(receivers_.begin(), receivers_.end(), receiver);
+    return it != receivers_.end() ? traffic_[it - receivers_.begin()] : 0;
+}
+
+const ReceiverPreferences::preferences_t& ReceiverPreferences::get_preferences() const {
+    if (dirty_) {
+        rebuild();
+    }
+    return preferences_;
+}
+
+void ReceiverPreferences::rebuild() const {
+    double total = std::accumulate(weights_.begin(), weights_.end(), 0.0);
+
+    preferences_.clear();
+    cumulative_.clear();
     double distribution = 0.0;
-    for (const auto& item : preferences_) {
-        distribution += item.second;
-        if (p <= distribution) {
-            return item.first;
+    for (std::size_t i = 0; i < receivers_.size(); ++i) {
+        double p = weights_[i] / total;
+        distribution += p;
+        preferences_.emplace_back(receivers_[i], p);
+        cumulative_.push_back(distribution);
+    }
+    dirty_ = false;
+}
+
+IPackageReceiver* ReceiverPreferences::choose_receiver() {
+    return pick(pg_());
+}
+
+IPackageReceiver* ReceiverPreferences::choose_receiver(Time t) {
+    return pick(draw(t));
+}
+
+double ReceiverPreferences::draw(Time t) {
+    if (!counter_rng_) {
+        return pg_();
+    }
+    if (t != draw_turn_) {
+        draw_turn_ = t;
+        draw_index_ = 0;
+    }
+    return counter_rng_->canonical(static_cast<std::uint64_t>(t), stream_, draw_index_++);
+}
+
+namespace {
+
+// Liczba sukcesow w n probach z prawdopodobienstwem p, metoda odwracania
+// dystrybuanty z jednego losowania u. Dla n <= 512 i p <= 0.5 poczatkowe
+// (1-p)^n nie ulega niedomiarowi.
+std::size_t binomial(std::size_t n, double p, double u) {
+    if (p > 0.5) {
+        return n - binomial(n, 1.0 - p, 1.0 - u);
+    }
+    if (p <= 0.0) {
+        return 0;
+    }
+    double ratio = p / (1.0 - p);
+    double pmf = std::pow(1.0 - p, static_cast<double>(n));
+    double cdf = pmf;
+    std::size_t k = 0;
+    while (u > cdf && k < n) {
+        pmf *= ratio * static_cast<double>(n - k) / static_cast<double>(k + 1);
+        cdf += pmf;
+        ++k;
+    }
+    return k;
+}
+
+}
+
+void ReceiverPreferences::choose_receivers(std::size_t n, Time t, std::vector<std::size_t>& counts) {
+    if (dirty_) {
+        rebuild();
+    }
+    counts.assign(preferences_.size(), 0);
+    if (preferences_.empty()) {
+        return;
+    }
+    // Rozklad wielomianowy jako ciag rozkladow dwumianowych: i-ty odbiorca
+    // dostaje Bin(pozostale, p_i / (1 - p_0 - ... - p_{i-1})). Suma niezaleznych
+    // rozkladow wielomianowych tez jest wielomianowa, wiec partia dzielona jest
+    // na kawalki po 512.
+    constexpr std::size_t chunk = 512;
+    std::size_t last = preferences_.size() - 1;
+    for (std::size_t done = 0; done < n; done += chunk) {
+        std::size_t remaining = std::min(chunk, n - done);
+        double mass = 1.0;
+        for (std::size_t i = 0; i < last && remaining > 0; ++i) {
+            double p = preferences_[i].second / mass;
+            std::size_t k = p >= 1.0 ? remaining : binomial(remaining, p, draw(t));
+            counts[i] += k;
+            remaining -= k;
+            mass -= preferences_[i].second;
         }
+        counts[last] += remaining;
+    }
+}
+
+IPackageReceiver* ReceiverPreferences::pick(double p) {
+    if (dirty_) {
+        rebuild();
+    }
+    if (preferences_.empty()) {
+        return nullptr;
+    }
+    auto it = std::lower_bound(cumulative_.begin(), cumulative_.end(), p);
+    std::size_t i = it == cumulative_.end() ? preferences_.size() - 1 : static_cast<std::size_t>(it - cumulative_.begin());
+    last_pick_ = i;
+    return preferences_[i].first;
+}
+
+IPackageReceiver* IPackageSender::send_package() {
+    if (!get_sending_buffer()) {
+        return nullptr;
+    }
+    return pass_to(receiver_preferences_.choose_receiver(), 0);
+}
+
+IPackageReceiver* IPackageSender::send_package(Time t) {
+    if (!get_sending_buffer()) {
+        return nullptr;
     }
-    if (!preferences_.empty()) return preferences_.rbegin()->first;
-    return nullptr;
+    return pass_to(receiver_preferences_.choose_receiver(t), t);
 }
 
-void IPackageSender::push_package(Package&& package) {
-    IPackageReceiver* receiver = receiver_preferences_.choose_receiver();
+IPackageReceiver* IPackageSender::pass_to(IPackageReceiver* receiver, Time t) {
+    auto& buffer = get_sending_buffer();
+    if (receiver && !receiver->can_receive_package()) {
+        ++blocked_turns_;
+        return nullptr;
+    }
+    if (receiver && t > 0) {
+        receiver->receive_package(std::move(*buffer), t);
+    } else if (receiver) {
+        receiver->receive_package(std::move(*buffer));
+    }
     if (receiver) {
-        receiver->receive_package(std::move(package));
+        receiver_preferences_.count_delivered();
     }
+    buffer.reset();
+    return receiver;
 }
 
-void IPackageSender::send_package() {
-    if (get_sending_buffer()) {
-        push_package(std::move(get_sending_buffer().value()));
-        get_sending_buffer().reset();
+Ramp::Ramp(ElementID id, TimeOffset di, std::size_t batch_size) : id_(id), di_(di), batch_size_(batch_size) {
+    if (batch_size == 0) {
+        throw std::invalid_argument("Ramp batch size must be positive.");
     }
 }
 
-Ramp::Ramp(ElementID id, TimeOffset di) : id_(id), di_(di) {}
+void Ramp::set_memory_resource(std::pmr::memory_resource* resource) {
+    IPackageSender::set_memory_resource(resource);
+    rebind(batch_, resource);
+}
 
 void Ramp::deliver_goods(Time t) {
-    if ((t - 1) % di_ == 0) {
-        if (!buffer_) {
-             buffer_ = Package();
+    if ((t - 1) % di_ != 0) {
+        return;
+    }
+    if (batch_size_ > 1) {
+        // Nowa partia dopiero, gdy poprzednia zostala w calosci wyslana.
+        if (batch_.empty()) {
+            batch_.reserve(batch_size_);
+            for (std::size_t k = 0; k < batch_size_; ++k) {
+                batch_.emplace_back().set_creation_time(t);
+            }
+            if constexpr (metrics_enabled) {
+                metrics_.delivered += batch_size_;
+            }
+        }
+        return;
+    }
+    if (!buffer_) {
+        buffer_.emplace().set_creation_time(t);
+        if constexpr (metrics_enabled) {
+            ++metrics_.delivered;
         }
     }
 }
 
+void Ramp::send_batch(Time t, const Delivered& on_delivered) {
+    offer_batch(t, [t, &on_delivered](IPackageReceiver* receiver, Package* packages, std::size_t n) {
+        n = std::min(n, receiver->free_capacity());
+        if (n > 0) {
+            if (on_delivered) {
+                on_delivered(receiver, packages, n);
+            }
+            receiver->receive_packages(packages, n, t);
+        }
+        return n;
+    });
+}
+
 Worker::Worker(ElementID id, TimeOffset pd, std::unique_ptr<IPackageStockpile> q)
-    : id_(id), pd_(pd), q_(std::move(q)) {}
+    : id_(id), pd_(pd), q_(std::move(q)), queues_(queues_of(q_.get())) {}
+
+Worker::Worker(Worker& other, std::pmr::memory_resource* resource)
+    : IPackageSender(ReceiverPreferences(other.receiver_preferences_, resource)),
+      id_(other.id_), pd_(other.pd_), t_(other.t_), q_(other.q_->relocate(resource)), queues_(queues_of(q_.get())),
+      processing_buffer_(std::move(other.processing_buffer_)),
+      sending_buffer_(std::move(other.sending_buffer_)), metrics_(other.metrics_) {
+    set_blocked_turns(other.get_blocked_turns());
+}
+
+void Worker::set_memory_resource(std::pmr::memory_resource* resource) {
+    IPackageSender::set_memory_resource(resource);
+    q_->set_memory_resource(resource);
+}
 
 void Worker::receive_package(Package&& p) {
-    q_->push(std::move(p));
+    with_queue([this, &p](auto& q) {
+        q.push(std::move(p));
+        if constexpr (metrics_enabled) {
+            metrics_.queue_high_water = std::max(metrics_.queue_high_water, q.size());
+        }
+    });
+}
+
+bool Worker::can_receive_package() const {
+    return !with_queue([](auto& q) { return q.full(); });
+}
+
+std::size_t Worker::free_capacity() const {
+    return with_queue([](auto& q) -> std::size_t { return q.full() ? 0 : q.capacity() - q.size(); });
+}
+
+void Worker::receive_packages(Package* packages, std::size_t count, Time) {
+    with_queue([this, packages, count](auto& q) {
+        q.reserve(q.size() + count);
+        for (std::size_t k = 0; k < count; ++k) {
+            q.push(std::move(packages[k]));
+        }
+        if constexpr (metrics_enabled) {
+            metrics_.queue_high_water = std::max(metrics_.queue_high_water, q.size());
+        }
+    });
 }
 
 void Worker::do_work(Time t) {
-    if (!processing_buffer_ && !q_->empty()) {
-        processing_buffer_ = q_->pop();
-        t_ = t;
+    if (!processing_buffer_) {
+        with_queue([this, t](auto& q) {
+            if (!q.empty()) {
+                processing_buffer_ = q.pop();
+                t_ = t;
+            }
+        });
     }
     
-    if (processing_buffer_) {
+    // Gotowy polprodukt czeka w buforze przetwarzania, dopoki poprzedni nie opusci bufora wysylkowego.
+    if (processing_buffer_ && !sending_buffer_) {
         if (t - t_ + 1 >= pd_) {
             sending_buffer_ = std::move(processing_buffer_);
             processing_buffer_.reset();
+            if constexpr (metrics_enabled) {
+                ++metrics_.processed;
+                metrics_.busy_turns += static_cast<std::uint64_t>(t - t_ + 1);
+            }
         }
     }
 }
\ No newline at end of file
@@ -1,33 +1,26 @@
 #include "package.hxx"
+#include "package_id_allocator.hxx"
 
-std::set<ElementID> Package::freed_ids_;
-ElementID Package::assigned_ids_ = 1;
-
-Package::Package() {
-    if (freed_ids_.empty()) {
-        id_ = assigned_ids_++;
-    } else {
-        id_ = *freed_ids_.begin();
-        freed_ids_.erase(freed_ids_.begin());
-    }
+Package::Package() : owner_(&PackageIdAllocator::current()) {
+    id_ = owner_->allocate();
 }
 
-Package::Package(ElementID id) : id_(id) {
-    if (id >= assigned_ids_) {
-        assigned_ids_ = id + 1;
-    }
+Package::Package(ElementID id, Time created) : id_(id), created_(created), owner_(&PackageIdAllocator::current()) {
+    owner_->reserve(id);
 }
 
-Package::Package(Package&& other) noexcept : id_(other.id_) {
+Package::Package(Package&& other) noexcept : id_(other.id_), created_(other.created_), owner_(other.owner_) {
     other.id_ = -1; 
 }
 
 Package& Package::operator=(Package&& other) noexcept {
     if (this != &other) {
         if (id_ != -1) {
-            freed_ids_.insert(id_);
+            owner_->release(id_);
         }
         id_ = other.id_;
+        created_ = other.created_;
+        owner_ = other.owner_;
         other.id_ = -1;
     }
     return *this;
@@ -35,6 +28,6 @@ Package& Package::operator=(Package&& other) noexcept {
 
 Package::~Package() {
     if (id_ != -1) {
-        freed_ids_.insert(id_);
+        owner_->release(id_);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,204 @@
+#include "package_id_allocator.hxx"
+#include <algorithm>
+
+namespace {
+
+constexpr std::size_t cache_batch = 64;
+
+std::atomic<std::uint64_t> next_instance{1};
+
+thread_local PackageIdAllocator* current_allocator = nullptr;
+
+}
+
+struct PackageIdAllocator::ThreadCache {
+    std::uint64_t owner = 0;
+    std::weak_ptr<Pool> pool;
+    std::vector<ElementID> ids;
+
+    void flush(std::size_t keep) {
+        if (auto p = pool.lock()) {
+            std::lock_guard<std::mutex> lock(p->mutex);
+            while (ids.size() > keep) {
+                p->put(ids.back());
+                ids.pop_back();
+            }
+        }
+        ids.resize(std::min(ids.size(), keep));
+    }
+
+    ~ThreadCache() { flush(0); }
+};
+
+bool PackageIdAllocator::Pool::take_smallest(ElementID& id) {
+    if (free_count == 0) {
+        return false;
+    }
+    while (free_bits[first_word] == 0) {
+        ++first_word;
+    }
+    std::uint64_t& word = free_bits[first_word];
+    int bit = __builtin_ctzll(word);
+    word &= word - 1;
+    --free_count;
+    id = static_cast<ElementID>(first_word * 64 + bit);
+    return true;
+}
+
+void PackageIdAllocator::Pool::put(ElementID id) {
+    if (id < 0) {
+        return;
+    }
+    std::size_t w = static_cast<std::size_t>(id) / 64;
+    std::uint64_t mask = std::uint64_t{1} << (id % 64);
+    if (w >= free_bits.size()) {
+        free_bits.resize(w + 1, 0);
+    }
+    if (free_bits[w] & mask) {
+        return;
+    }
+    free_bits[w] |= mask;
+    ++free_count;
+    if (w < first_word || free_count == 1) {
+        first_word = w;
+    }
+}
+
+PackageIdAllocator::PackageIdAllocator(IdAllocationMode mode)
+    : mode_(mode), instance_(next_instance++), pool_(std::make_shared<Pool>()) {}
+
+PackageIdAllocator& PackageIdAllocator::global() {
+    static PackageIdAllocator allocator;
+    return allocator;
+}
+
+PackageIdAllocator& PackageIdAllocator::current() {
+    return current_allocator ? *current_allocator : global();
+}
+
+PackageIdAllocator::Scope::Scope(PackageIdAllocator& allocator) : previous_(current_allocator) {
+    current_allocator = &allocator;
+}
+
+PackageIdAllocator::Scope::~Scope() {
+    current_allocator = previous_;
+}
+
+PackageIdAllocator::ThreadCache& PackageIdAllocator::thread_cache() {
+    thread_local ThreadCache cache;
+    if (cache.owner != instance_) {
+        cache.flush(0);
+        cache.owner = instance_;
+        cache.pool = pool_;
+    }
+    return cache;
+}
+
+void PackageIdAllocator::set_mode(IdAllocationMode mode) {
+    if (mode_ == IdAllocationMode::POOLED) {
+        thread_cache().flush(0);
+    }
+    mode_ = mode;
+}
+
+ElementID PackageIdAllocator::allocate() {
+    ElementID id;
+    switch (mode_) {
+    case IdAllocationMode::MONOTONIC:
+        return pool_->next.fetch_add(1, std::memory_order_relaxed);
+    case IdAllocationMode::POOLED: {
+        ThreadCache& cache = thread_cache();
+        if (cache.ids.empty()) {
+            std::lock_guard<std::mutex> lock(pool_->mutex);
+            while (cache.ids.size() < cache_batch && pool_->take_smallest(id)) {
+                cache.ids.push_back(id);
+            }
+        }
+        if (!cache.ids.empty()) {
+            id = cache.ids.back();
+            cache.ids.pop_back();
+            return id;
+        }
+        return pool_->next.fetch_add(1, std::memory_order_relaxed);
+    }
+    case IdAllocationMode::SMALLEST_FREE:
+    default: {
+        std::lock_guard<std::mutex> lock(pool_->mutex);
+        if (pool_->take_smallest(id)) {
+            return id;
+        }
+        return pool_->next.fetch_add(1, std::memory_order_relaxed);
+    }
+    }
+}
+
+void PackageIdAllocator::release(ElementID id) {
+    switch (mode_) {
+    case IdAllocationMode::MONOTONIC:
+        return;
+    case IdAllocationMode::POOLED: {
+        ThreadCache& cache = thread_cache();
+        cache.ids.push_back(id);
+        if (cache.ids.size() >= 2 * cache_batch) {
+            cache.flush(cache_batch);
+        }
+        return;
+    }
+    case IdAllocationMode::SMALLEST_FREE:
+    default: {
+        std::lock_guard<std::mutex> lock(pool_->mutex);
+        pool_->put(id);
+        return;
+    }
+    }
+}
+
+void PackageIdAllocator::reserve(ElementID id) {
+    ElementID next = pool_->next.load(std::memory_order_relaxed);
+    while (id >= next && !pool_->next.compare_exchange_weak(next, id + 1, std::memory_order_relaxed)) {
+    }
+}
+
+PackageIdAllocator::State PackageIdAllocator::save_state() {
+    if (mode_ == IdAllocationMode::POOLED) {
+        thread_cache().flush(0);
+    }
+    State state;
+    state.mode = mode_;
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    state.next = pool_->next.load();
+    for (std::size_t w = pool_->first_word; w < pool_->free_bits.size(); ++w) {
+        for (std::uint64_t word = pool_->free_bits[w]; word; word &= word - 1) {
+            state.free_ids.push_back(static_cast<ElementID>(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    return state;
+}
+
+void PackageIdAllocator::take_free(std::vector<ElementID>& out) {
+    if (mode_ == IdAllocationMode::POOLED) {
+        thread_cache().flush(0);
+    }
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    for (std::size_t w = pool_->first_word; pool_->free_count > 0; ++w) {
+        for (std::uint64_t& word = pool_->free_bits[w]; word; word &= word - 1) {
+            out.push_back(static_cast<ElementID>(w * 64 + __builtin_ctzll(word)));
+            --pool_->free_count;
+        }
+    }
+}
+
+void PackageIdAllocator::restore_state(const State& state) {
+    if (mode_ == IdAllocationMode::POOLED) {
+        thread_cache().ids.clear();
+    }
+    mode_ = state.mode;
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    pool_->free_bits.clear();
+    pool_->first_word = 0;
+    pool_->free_count = 0;
+    pool_->next.store(state.next);
+    for (ElementID id : state.free_ids) {
+        pool_->put(id);
+    }
+}
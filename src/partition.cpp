@@ -0,0 +1,154 @@
+#include "partition.hxx"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+constexpr double balance_tolerance = 0.1;
+constexpr int refinement_passes = 4;
+
+struct Graph {
+    // Sasiedztwo nieskierowane; krawedz wielokrotna liczy sie tyle razy, ile polaczen.
+    std::vector<std::vector<std::size_t>> adjacent;
+    std::vector<std::size_t> roots;
+};
+
+Graph build_graph(const Factory& f) {
+    std::unordered_map<const IPackageReceiver*, std::size_t> index;
+    for (auto it = f.worker_cbegin(); it != f.worker_cend(); ++it) {
+        index.emplace(&*it, index.size());
+    }
+    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
+        index.emplace(&*it, index.size());
+    }
+
+    Graph g;
+    g.adjacent.resize(index.size());
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        for (const auto& [receiver, p] : it->receiver_preferences_) {
+            g.roots.push_back(index.at(receiver));
+        }
+    }
+    std::size_t w = 0;
+    for (auto it = f.worker_cbegin(); it != f.worker_cend(); ++it, ++w) {
+        for (const auto& [receiver, p] : it->receiver_preferences_) {
+            std::size_t r = index.at(receiver);
+            g.adjacent[w].push_back(r);
+            g.adjacent[r].push_back(w);
+        }
+    }
+    return g;
+}
+
+std::vector<std::size_t> bfs_order(const Graph& g) {
+    std::size_t n = g.adjacent.size();
+    std::vector<std::size_t> order;
+    order.reserve(n);
+    std::vector<bool> seen(n, false);
+
+    auto visit_from = [&](std::size_t start) {
+        if (seen[start]) return;
+        seen[start] = true;
+        std::size_t head = order.size();
+        order.push_back(start);
+        for (std::size_t i = head; i < order.size(); ++i) {
+            for (std::size_t next : g.adjacent[order[i]]) {
+                if (!seen[next]) {
+                    seen[next] = true;
+                    order.push_back(next);
+                }
+            }
+        }
+    };
+    for (std::size_t root : g.roots) {
+        visit_from(root);
+    }
+    for (std::size_t v = 0; v < n; ++v) {
+        visit_from(v);
+    }
+    return order;
+}
+
+void refine(const Graph& g, std::vector<std::size_t>& part, std::size_t parts) {
+    std::size_t n = part.size();
+    auto max_size = static_cast<std::size_t>(static_cast<double>(n) / parts * (1.0 + balance_tolerance)) + 1;
+    auto min_size = static_cast<std::size_t>(static_cast<double>(n) / parts * (1.0 - balance_tolerance));
+
+    std::vector<std::size_t> size(parts, 0);
+    for (std::size_t p : part) ++size[p];
+
+    std::vector<long> links(parts, 0);
+    for (int pass = 0; pass < refinement_passes; ++pass) {
+        bool moved = false;
+        for (std::size_t v = 0; v < n; ++v) {
+            std::fill(links.begin(), links.end(), 0);
+            for (std::size_t u : g.adjacent[v]) {
+                ++links[part[u]];
+            }
+            std::size_t from = part[v];
+            std::size_t best = from;
+            for (std::size_t p = 0; p < parts; ++p) {
+                if (p != from && size[p] < max_size && links[p] > links[best]) {
+                    best = p;
+                }
+            }
+            if (best != from && size[from] > min_size) {
+                --size[from];
+                ++size[best];
+                part[v] = best;
+                moved = true;
+            }
+        }
+        if (!moved) break;
+    }
+}
+
+}
+
+FactoryPartition partition_factory(const Factory& f, std::size_t parts) {
+    if (parts == 0) {
+        throw std::invalid_argument("Number of parts must be positive.");
+    }
+    Graph g = build_graph(f);
+    std::size_t n = g.adjacent.size();
+
+    std::vector<std::size_t> part(n, 0);
+    std::vector<std::size_t> order = bfs_order(g);
+    for (std::size_t i = 0; i < n; ++i) {
+        part[order[i]] = i * parts / std::max<std::size_t>(n, 1);
+    }
+    if (parts > 1) {
+        refine(g, part, parts);
+    }
+
+    FactoryPartition result;
+    result.parts = parts;
+    auto workers = static_cast<std::size_t>(std::distance(f.worker_cbegin(), f.worker_cend()));
+    result.worker_part.assign(part.begin(), part.begin() + static_cast<std::ptrdiff_t>(workers));
+    result.storehouse_part.assign(part.begin() + static_cast<std::ptrdiff_t>(workers), part.end());
+    for (std::size_t v = 0; v < workers; ++v) {
+        for (std::size_t u : g.adjacent[v]) {
+            // Krawedzie robotnik-robotnik sa zapisane w obu listach, pozostale w jednej.
+            if (part[u] != part[v] && (u >= workers || u > v)) {
+                ++result.cut;
+            }
+        }
+    }
+
+    // g.roots to odbiorcy kolejnych ramp, w kolejnosci ramp i ich preferencji.
+    std::vector<std::size_t> links(parts, 0);
+    std::size_t root = 0;
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        std::fill(links.begin(), links.end(), 0);
+        std::size_t receivers = it->receiver_preferences_.get_preferences().size();
+        for (std::size_t k = 0; k < receivers; ++k) {
+            ++links[part[g.roots[root + k]]];
+        }
+        root += receivers;
+        std::size_t best = static_cast<std::size_t>(std::max_element(links.begin(), links.end()) - links.begin());
+        result.ramp_part.push_back(best);
+        result.cut += receivers - links[best];
+    }
+    return result;
+}
@@ -0,0 +1,129 @@
+#include "replication.hxx"
+#include "package_id_allocator.hxx"
+#include "simulation.hxx"
+#include "thread_pool.hxx"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Kwantyl 0.975 rozkladu t dla 1..30 stopni swobody; dalej przyblizenie Cornisha-Fishera.
+constexpr double t_quantiles[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+double t_quantile(std::size_t df) {
+    if (df <= std::size(t_quantiles)) {
+        return t_quantiles[df - 1];
+    }
+    constexpr double z = 1.959964;
+    return z + (z * z * z + z) / (4.0 * static_cast<double>(df));
+}
+
+ReplicaResult run_replica(std::string_view structure, TimeOffset rounds, std::uint64_t seed, bool counter_rng) {
+    PackageIdAllocator ids;
+    PackageIdAllocator::Scope scope(ids);
+
+    std::mt19937 engine(static_cast<std::mt19937::result_type>(seed ^ (seed >> 32)));
+    ProbabilityGenerator pg = [&engine] { return std::generate_canonical<double, 10>(engine); };
+
+    ReplicaResult result;
+    result.seed = seed;
+    {
+        // Fabryka musi zostac zniszczona przed pula ID, do ktorej wracaja ID jej polproduktow.
+        Factory f = load_factory_structure(structure);
+        // Struktura nie zawiera trybu losowania; generator licznikowy zrodla
+        // dostaje ziarno replikacji, zeby replikacje pozostaly niezalezne.
+        if (counter_rng) {
+            f.enable_counter_rng(seed);
+        }
+        for (auto& ramp : f.ramp_collection()) {
+            ramp.receiver_preferences_.set_probability_generator(pg);
+        }
+        for (auto& worker : f.worker_collection()) {
+            worker.receiver_preferences_.set_probability_generator(pg);
+        }
+
+        double queue_sum = 0.0;
+        std::size_t samples = 0;
+        simulate(f, rounds, [&](Factory& factory, Time) {
+            for (const auto& worker : factory.worker_collection()) {
+                std::size_t length = worker.get_queue()->size();
+                queue_sum += static_cast<double>(length);
+                result.max_queue_length = std::max(result.max_queue_length, length);
+                ++samples;
+            }
+        });
+
+        for (const auto& store : f.storehouse_collection()) {
+            result.stored += store.get_stats().received;
+        }
+        result.throughput = rounds > 0 ? static_cast<double>(result.stored) / rounds : 0.0;
+        result.mean_queue_length = samples ? queue_sum / static_cast<double>(samples) : 0.0;
+    }
+    return result;
+}
+
+}
+
+std::uint64_t replica_seed(std::uint64_t base_seed, std::size_t i) {
+    // splitmix64 - sasiednie numery replikacji daja nieskorelowane ziarna.
+    std::uint64_t z = base_seed + 0x9e3779b97f4a7c15ULL * (static_cast<std::uint64_t>(i) + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+Estimate estimate_mean(const std::vector<double>& samples) {
+    Estimate e;
+    if (samples.empty()) {
+        return e;
+    }
+    double n = static_cast<double>(samples.size());
+    for (double x : samples) {
+        e.mean += x;
+    }
+    e.mean /= n;
+    if (samples.size() > 1) {
+        double ss = 0.0;
+        for (double x : samples) {
+            ss += (x - e.mean) * (x - e.mean);
+        }
+        e.stddev = std::sqrt(ss / (n - 1.0));
+    }
+    double half = samples.size() > 1 ? t_quantile(samples.size() - 1) * e.stddev / std::sqrt(n) : 0.0;
+    e.ci_low = e.mean - half;
+    e.ci_high = e.mean + half;
+    return e;
+}
+
+ReplicationSummary run_replications(const Factory& f, const ReplicationOptions& options) {
+    std::ostringstream os;
+    save_factory_structure(f, os);
+    const std::string structure = os.str();
+
+    ReplicationSummary summary;
+    summary.replicas.resize(options.replicas);
+
+    ThreadPool pool(options.threads);
+    pool.parallel_for(options.replicas, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            summary.replicas[i] = run_replica(structure, options.rounds, replica_seed(options.base_seed, i),
+                                              f.counter_rng().has_value());
+        }
+    });
+
+    std::vector<double> samples(summary.replicas.size());
+    auto estimate = [&](auto field) {
+        std::transform(summary.replicas.begin(), summary.replicas.end(), samples.begin(),
+                       [&](const ReplicaResult& r) { return static_cast<double>(r.*field); });
+        return estimate_mean(samples);
+    };
+    summary.throughput = estimate(&ReplicaResult::throughput);
+    summary.mean_queue_length = estimate(&ReplicaResult::mean_queue_length);
+    summary.max_queue_length = estimate(&ReplicaResult::max_queue_length);
+    return summary;
+}
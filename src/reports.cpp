@@ -1,53 +1,474 @@
 #include "reports.hxx"
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <string_view>
 
-void generate_structure_report(const Factory& f, std::ostream& os) {
-    save_factory_structure(f, os);
+namespace {
+
+constexpr std::size_t buffer_capacity = 64 * 1024;
+
+bool same_range(const TurnState& a, std::size_t a_begin, std::size_t a_end,
+                const TurnState& b, std::size_t b_begin, std::size_t b_end) {
+    return a_end - a_begin == b_end - b_begin &&
+           std::equal(a.packages.begin() + a_begin, a.packages.begin() + a_end, b.packages.begin() + b_begin);
 }
 
-void generate_simulation_turn_report(const Factory& f, std::ostream& os, Time t) {
-    os << "=== [ Turn: " << t << " ] ===\n";
-
-    os << "WORKERS_BLUEPRINT\n"; 
-    for (auto it = f.worker_cbegin(); it != f.worker_cend(); ++it) {
-        const auto& worker = *it;
-        os << "WORKER #" << worker.get_id() << "\n";
-
-        const auto& processing_buffer = worker.get_processing_buffer();
-        
-        if (processing_buffer) {
-            os << "  PBuffer: #" << processing_buffer->get_id() << " (pt = " 
-               << (t - worker.get_package_processing_start_time() + 1) << ")\n";
+bool worker_changed(const TurnState& state, const TurnState::WorkerState& w, const TurnState* previous, std::size_t i) {
+    if (!previous || i >= previous->workers.size()) return true;
+    const auto& p = previous->workers[i];
+    return p.id != w.id || p.processing != w.processing || p.pt != w.pt ||
+           !same_range(state, w.queue_begin, w.queue_end, *previous, p.queue_begin, p.queue_end);
+}
+
+constexpr double latency_quantiles[] = {50.0, 90.0, 99.0};
+
+std::string node_name(const IPackageReceiver* r) {
+    return (r->get_receiver_type() == ReceiverType::WORKER ? "worker-" : "store-") + std::to_string(r->get_id());
+}
+
+template <typename F>
+void for_each_link(const Factory& f, F&& fn) {
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        for (const auto& [r, p] : it->receiver_preferences_) {
+            fn("ramp-" + std::to_string(it->get_id()), r, it->receiver_preferences_.get_traffic(r));
+        }
+    }
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        for (const auto& [r, p] : it->receiver_preferences_) {
+            fn("worker-" + std::to_string(it->get_id()), r, it->receiver_preferences_.get_traffic(r));
+        }
+    }
+}
+
+void write_metrics_json(const Factory& f, std::ostream& os) {
+    const auto& m = f.metrics();
+    os << "{\n  \"turns\": " << m.last_turn << ",\n  \"ramps\": [";
+    const char* sep = "";
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        os << sep << "\n    {\"id\": " << it->get_id() << ", \"delivered\": " << it->get_metrics().delivered
+           << ", \"blocked_turns\": " << it->get_blocked_turns() << "}";
+        sep = ",";
+    }
+    os << "\n  ],\n  \"workers\": [";
+    sep = "";
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        const auto& wm = it->get_metrics();
+        os << sep << "\n    {\"id\": " << it->get_id() << ", \"processed\": " << wm.processed
+           << ", \"busy_turns\": " << wm.busy_turns
+           << ", \"idle_turns\": " << static_cast<std::uint64_t>(m.last_turn) - std::min<std::uint64_t>(wm.busy_turns, m.last_turn)
+           << ", \"queue_high_water\": " << wm.queue_high_water
+           << ", \"blocked_turns\": " << it->get_blocked_turns() << "}";
+        sep = ",";
+    }
+    os << "\n  ],\n  \"storehouses\": [";
+    sep = "";
+    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
+        const auto& sm = it->get_metrics();
+        const auto& stats = it->get_stats();
+        os << sep << "\n    {\"id\": " << it->get_id() << ", \"received\": " << stats.received
+           << ", \"stock_high_water\": " << sm.stock_high_water
+           << ", \"first_arrival\": " << stats.first_arrival << ", \"last_arrival\": " << stats.last_arrival
+           << ", \"arrival_turns\": " << stats.arrival_turns << "}";
+        sep = ",";
+    }
+    os << "\n  ],\n  \"links\": [";
+    sep = "";
+    for_each_link(f, [&](const std::string& src, const IPackageReceiver* r, std::uint64_t packages) {
+        os << sep << "\n    {\"src\": \"" << src << "\", \"dest\": \"" << node_name(r) << "\", \"packages\": " << packages << "}";
+        sep = ",";
+    });
+    os << "\n  ],\n  \"latency\": {\"count\": " << m.latency.count() << ", \"min\": " << m.latency.min()
+       << ", \"max\": " << m.latency.max() << ", \"mean\": " << m.latency.mean();
+    for (double q : latency_quantiles) {
+        os << ", \"p" << q << "\": " << m.latency.percentile(q);
+    }
+    os << "}\n}\n";
+}
+
+void write_metrics_prometheus(const Factory& f, std::ostream& os) {
+    const auto& m = f.metrics();
+    os << "# TYPE netsim_turns gauge\nnetsim_turns " << m.last_turn << "\n";
+    os << "# TYPE netsim_ramp_delivered_total counter\n";
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        os << "netsim_ramp_delivered_total{ramp=\"" << it->get_id() << "\"} " << it->get_metrics().delivered << "\n";
+    }
+    os << "# TYPE netsim_worker_processed_total counter\n";
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        os << "netsim_worker_processed_total{worker=\"" << it->get_id() << "\"} " << it->get_metrics().processed << "\n";
+    }
+    os << "# TYPE netsim_worker_busy_turns_total counter\n";
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        os << "netsim_worker_busy_turns_total{worker=\"" << it->get_id() << "\"} " << it->get_metrics().busy_turns << "\n";
+    }
+    os << "# TYPE netsim_worker_queue_high_water gauge\n";
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        os << "netsim_worker_queue_high_water{worker=\"" << it->get_id() << "\"} " << it->get_metrics().queue_high_water << "\n";
+    }
+    os << "# TYPE netsim_sender_blocked_turns_total counter\n";
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) {
+        os << "netsim_sender_blocked_turns_total{sender=\"ramp-" << it->get_id() << "\"} " << it->get_blocked_turns() << "\n";
+    }
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        os << "netsim_sender_blocked_turns_total{sender=\"worker-" << it->get_id() << "\"} " << it->get_blocked_turns() << "\n";
+    }
+    os << "# TYPE netsim_storehouse_received_total counter\n";
+    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
+        os << "netsim_storehouse_received_total{storehouse=\"" << it->get_id() << "\"} " << it->get_stats().received << "\n";
+    }
+    os << "# TYPE netsim_link_packages_total counter\n";
+    for_each_link(f, [&](const std::string& src, const IPackageReceiver* r, std::uint64_t packages) {
+        os << "netsim_link_packages_total{src=\"" << src << "\",dest=\"" << node_name(r) << "\"} " << packages << "\n";
+    });
+
+    // Histogram kumulatywny: le = gorna granica kubelka.
+    os << "# TYPE netsim_latency_turns histogram\n";
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < m.latency.bucket_count(); ++i) {
+        if (m.latency.bucket_value(i) == 0) continue;
+        cumulative += m.latency.bucket_value(i);
+        os << "netsim_latency_turns_bucket{le=\"" << LatencyHistogram::bucket_upper_bound(i) << "\"} " << cumulative << "\n";
+    }
+    os << "netsim_latency_turns_bucket{le=\"+Inf\"} " << m.latency.count() << "\n";
+    os << "netsim_latency_turns_sum " << m.latency.sum() << "\n";
+    os << "netsim_latency_turns_count " << m.latency.count() << "\n";
+}
+
+}
+
+void TurnState::capture_workers(const Factory& f, Time t) {
+    turn = t;
+    workers.clear();
+    storehouses.clear();
+    packages.clear();
+
+    for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+        const auto& pb = it->get_processing_buffer();
+        WorkerState w{it->get_id(), pb ? pb->get_id() : no_package,
+                      pb ? t - it->get_package_processing_start_time() + 1 : 0, packages.size(), 0};
+        for (const auto& p : *it->get_queue()) {
+            packages.push_back(p.get_id());
+        }
+        w.queue_end = packages.size();
+        workers.push_back(w);
+    }
+}
+
+void TurnState::capture(const Factory& f, Time t) {
+    capture_workers(f, t);
+    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
+        StorehouseState s{it->get_id(), packages.size(), 0};
+        for (auto pkg = it->cbegin(); pkg != it->cend(); ++pkg) {
+            packages.push_back(pkg->get_id());
+        }
+        s.stock_end = packages.size();
+        storehouses.push_back(s);
+    }
+}
+
+void TurnState::capture(const Factory& f, Time t, StockCursor& cursor) {
+    capture_workers(f, t);
+    std::size_t i = 0;
+    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it, ++i) {
+        const Storehouse& store = *it;
+        std::size_t size = store.get_queue()->size();
+        std::uint64_t received = store.get_stats().received;
+        StorehouseState s{store.get_id(), packages.size(), 0};
+
+        // Przyrost wynika z licznika przyjec, o ile zapas zmienial sie tylko przez
+        // przyjecia (na koniec) i przycinanie (od poczatku) - czyli w kolejce FIFO.
+        std::size_t appended = size;
+        if (i < cursor.entries_.size()) {
+            const auto& prev = cursor.entries_[i];
+            if (prev.store == &store && prev.id == s.id && received >= prev.received &&
+                store.get_queue()->get_queue_type() == PackageQueueType::FIFO) {
+                std::uint64_t added = store.get_retention() == StorehouseRetention::COUNT ? 0 : received - prev.received;
+                std::size_t kept = static_cast<std::size_t>(std::min<std::uint64_t>(added, size));
+                if (prev.size + kept >= size) {
+                    s.dropped = prev.size + kept - size;
+                    s.complete = false;
+                    appended = kept;
+                }
+            }
+        }
+        for (auto pkg = store.cend() - static_cast<std::ptrdiff_t>(appended); pkg != store.cend(); ++pkg) {
+            packages.push_back(pkg->get_id());
+        }
+        s.stock_end = packages.size();
+        storehouses.push_back(s);
+
+        StockCursor::Entry entry{&store, s.id, received, size};
+        if (i < cursor.entries_.size()) {
+            cursor.entries_[i] = entry;
         } else {
-            os << "  PBuffer: (empty)\n";
+            cursor.entries_.push_back(entry);
         }
+    }
+    cursor.entries_.resize(i);
+}
 
-        os << "  Queue: ";
-        const auto* queue = worker.get_queue();
-        if (queue->empty()) {
-            os << "(empty)";
+TurnReportWriter::TurnReportWriter(std::ostream& os, ReportFormat format, bool delta)
+    : os_(os), format_(format), delta_(delta) {}
+
+TurnReportWriter::~TurnReportWriter() {
+    flush();
+}
+
+void TurnReportWriter::flush() {
+    if (used_) {
+        os_.write(buffer_.data(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+    }
+}
+
+// Bufor rosnie wraz z wypisanym tekstem do buffer_capacity, wiec krotki raport
+// (np. jednorazowy writer w generate_simulation_turn_report) nie alokuje calego.
+bool TurnReportWriter::reserve(std::size_t n) {
+    if (buffer_.size() - used_ >= n) {
+        return true;
+    }
+    if (buffer_.size() < buffer_capacity) {
+        buffer_.resize(std::min(buffer_capacity, std::max({buffer_.size() * 2, used_ + n, std::size_t{256}})));
+        if (buffer_.size() - used_ >= n) {
+            return true;
+        }
+    }
+    flush();
+    return buffer_.size() >= n;
+}
+
+void TurnReportWriter::put(std::string_view s) {
+    if (!reserve(s.size())) {
+        os_.write(s.data(), static_cast<std::streamsize>(s.size()));
+        return;
+    }
+    std::memcpy(buffer_.data() + used_, s.data(), s.size());
+    used_ += s.size();
+}
+
+void TurnReportWriter::put(long long value) {
+    reserve(24);
+    auto res = std::to_chars(buffer_.data() + used_, buffer_.data() + buffer_.size(), value);
+    used_ = static_cast<std::size_t>(res.ptr - buffer_.data());
+}
+
+template <typename T>
+void TurnReportWriter::put_raw(T value) {
+    put(std::string_view(reinterpret_cast<const char*>(&value), sizeof(T)));
+}
+
+void TurnReportWriter::write(const Factory& f, Time t) {
+    current_.capture(f, t, cursor_);
+    write(current_);
+}
+
+void TurnReportWriter::write(const TurnState& state) {
+    const TurnState* previous = delta_ && has_previous_ ? &previous_ : nullptr;
+    update_stocks(state, previous != nullptr);
+    switch (format_) {
+    case ReportFormat::CSV: write_csv(state, previous); break;
+    case ReportFormat::BINARY: write_binary(state, previous); break;
+    default: write_text(state, previous); break;
+    }
+
+    if (delta_) {
+        // Zapas magazynow z poprzedniego raportu jest w stocks_.
+        previous_.turn = state.turn;
+        previous_.workers.assign(state.workers.begin(), state.workers.end());
+        std::size_t worker_packages = state.workers.empty() ? 0 : state.workers.back().queue_end;
+        previous_.packages.assign(state.packages.begin(), state.packages.begin() + worker_packages);
+        has_previous_ = true;
+    }
+}
+
+void TurnReportWriter::update_stocks(const TurnState& state, bool has_previous) {
+    stocks_.resize(state.storehouses.size());
+    stock_changes_.resize(state.storehouses.size());
+    for (std::size_t i = 0; i < state.storehouses.size(); ++i) {
+        const auto& s = state.storehouses[i];
+        Stock& stock = stocks_[i];
+        const ElementID* added = state.packages.data() + s.stock_begin;
+        const ElementID* added_end = state.packages.data() + s.stock_end;
+        std::size_t old_size = stock.ids.size();
+        bool known = has_previous && stock.id == s.id;
+        stock.id = s.id;
+
+        if (!s.complete && s.dropped == 0) {
+            // Tylko dolozono - wystarczy dopisac przyrost.
+            stock_changes_[i] = {!known || added != added_end, known ? old_size : 0};
+            stock.ids.insert(stock.ids.end(), added, added_end);
+            continue;
+        }
+
+        scratch_.clear();
+        if (!s.complete) {
+            scratch_.assign(stock.ids.begin() + static_cast<std::ptrdiff_t>(std::min(s.dropped, old_size)), stock.ids.end());
+        }
+        scratch_.insert(scratch_.end(), added, added_end);
+        bool prefix = known && old_size <= scratch_.size() &&
+                      std::equal(stock.ids.begin(), stock.ids.end(), scratch_.begin());
+        stock_changes_[i] = {!prefix || old_size != scratch_.size(), prefix ? old_size : 0};
+        stock.ids.swap(scratch_);
+    }
+}
+
+void TurnReportWriter::write_text(const TurnState& state, const TurnState* previous) {
+    put("=== [ Turn: ");
+    put(state.turn);
+    put(previous ? " ] (delta) ===\n" : " ] ===\n");
+
+    put("WORKERS_BLUEPRINT\n");
+    for (std::size_t i = 0; i < state.workers.size(); ++i) {
+        const auto& w = state.workers[i];
+        if (previous && !worker_changed(state, w, previous, i)) continue;
+
+        put("WORKER #");
+        put(w.id);
+        if (w.processing != TurnState::no_package) {
+            put("\n  PBuffer: #");
+            put(w.processing);
+            put(" (pt = ");
+            put(w.pt);
+            put(")\n");
         } else {
-            for (const auto& pkg : *queue) {
-                os << "#" << pkg.get_id() << " ";
-            }
+            put("\n  PBuffer: (empty)\n");
+        }
+        put("  Queue: ");
+        if (w.queue_begin == w.queue_end) {
+            put("(empty)");
+        }
+        for (std::size_t k = w.queue_begin; k < w.queue_end; ++k) {
+            put("#");
+            put(state.packages[k]);
+            put(" ");
         }
-        os << "\n";
+        put("\n");
     }
 
-    os << "STOREHOUSES_BLUEPRINT\n";
-    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) {
-        const auto& store = *it;
-        os << "STOREHOUSE #" << store.get_id() << "\n";
-        os << "  Stock: ";
-        if (store.cbegin() == store.cend()) {
-            os << "(empty)";
+    put("STOREHOUSES_BLUEPRINT\n");
+    for (std::size_t i = 0; i < state.storehouses.size(); ++i) {
+        const auto& s = state.storehouses[i];
+        const auto& stock = stocks_[i].ids;
+        auto [changed, from] = stock_changes_[i];
+        if (previous && !changed) continue;
+
+        put("STOREHOUSE #");
+        put(s.id);
+        put(from == 0 ? "\n  Stock: " : "\n  Stock+: ");
+        if (stock.empty()) {
+            put("(empty)");
+        }
+        for (std::size_t k = from; k < stock.size(); ++k) {
+            put("#");
+            put(stock[k]);
+            put(" ");
+        }
+        put("\n");
+    }
+
+    put("\n");
+}
+
+void TurnReportWriter::write_csv(const TurnState& state, const TurnState* previous) {
+    if (!header_written_) {
+        put("turn,kind,id,pbuffer,pt,packages\n");
+        header_written_ = true;
+    }
+    for (std::size_t i = 0; i < state.workers.size(); ++i) {
+        const auto& w = state.workers[i];
+        if (previous && !worker_changed(state, w, previous, i)) continue;
+
+        put(state.turn);
+        put(",worker,");
+        put(w.id);
+        put(",");
+        if (w.processing != TurnState::no_package) {
+            put(w.processing);
+            put(",");
+            put(w.pt);
         } else {
-            for (auto pkg_it = store.cbegin(); pkg_it != store.cend(); ++pkg_it) {
-                os << "#" << pkg_it->get_id() << " ";
-            }
+            put(",");
         }
-        os << "\n";
+        put(",");
+        for (std::size_t k = w.queue_begin; k < w.queue_end; ++k) {
+            if (k != w.queue_begin) put(" ");
+            put(state.packages[k]);
+        }
+        put("\n");
+    }
+    for (std::size_t i = 0; i < state.storehouses.size(); ++i) {
+        const auto& s = state.storehouses[i];
+        const auto& stock = stocks_[i].ids;
+        auto [changed, from] = stock_changes_[i];
+        if (previous && !changed) continue;
+
+        put(state.turn);
+        put(from == 0 ? ",storehouse," : ",storehouse+,");
+        put(s.id);
+        put(",,,");
+        for (std::size_t k = from; k < stock.size(); ++k) {
+            if (k != from) put(" ");
+            put(stock[k]);
+        }
+        put("\n");
+    }
+}
+
+void TurnReportWriter::write_binary(const TurnState& state, const TurnState* previous) {
+    // Naglowek tury: turn, flagi (1 = delta), liczba rekordow robotnikow;
+    // rekord robotnika: id, pbuffer (-1 = pusty), pt, dlugosc kolejki, ID.
+    put_raw<std::int32_t>(state.turn);
+    put_raw<std::uint8_t>(previous ? 1 : 0);
+
+    std::uint32_t changed = 0;
+    for (std::size_t i = 0; i < state.workers.size(); ++i) {
+        changed += !previous || worker_changed(state, state.workers[i], previous, i);
     }
-    
-    os << "\n";
-}
\ No newline at end of file
+    put_raw<std::uint32_t>(changed);
+    for (std::size_t i = 0; i < state.workers.size(); ++i) {
+        const auto& w = state.workers[i];
+        if (previous && !worker_changed(state, w, previous, i)) continue;
+        put_raw<std::int32_t>(w.id);
+        put_raw<std::int32_t>(w.processing);
+        put_raw<std::int32_t>(w.pt);
+        put_raw<std::uint32_t>(static_cast<std::uint32_t>(w.queue_end - w.queue_begin));
+        put(std::string_view(reinterpret_cast<const char*>(state.packages.data() + w.queue_begin),
+                             (w.queue_end - w.queue_begin) * sizeof(ElementID)));
+    }
+
+    // Magazyny: id, flaga dopisania (1 = tylko nowe polprodukty), liczba, ID.
+    changed = 0;
+    for (std::size_t i = 0; i < state.storehouses.size(); ++i) {
+        changed += !previous || stock_changes_[i].changed;
+    }
+    put_raw<std::uint32_t>(changed);
+    for (std::size_t i = 0; i < state.storehouses.size(); ++i) {
+        const auto& s = state.storehouses[i];
+        const auto& stock = stocks_[i].ids;
+        std::size_t from = stock_changes_[i].from;
+        if (previous && !stock_changes_[i].changed) continue;
+        put_raw<std::int32_t>(s.id);
+        put_raw<std::uint8_t>(from != 0);
+        put_raw<std::uint32_t>(static_cast<std::uint32_t>(stock.size() - from));
+        put(std::string_view(reinterpret_cast<const char*>(stock.data() + from),
+                             (stock.size() - from) * sizeof(ElementID)));
+    }
+}
+
+void generate_structure_report(const Factory& f, std::ostream& os) {
+    save_factory_structure(f, os);
+}
+
+void generate_simulation_turn_report(const Factory& f, std::ostream& os, Time t) {
+    TurnReportWriter writer(os);
+    writer.write(f, t);
+}
+
+void generate_metrics_report(const Factory& f, std::ostream& os, MetricsFormat format) {
+    if (format == MetricsFormat::PROMETHEUS) {
+        write_metrics_prometheus(f, os);
+    } else {
+        write_metrics_json(f, os);
+    }
+}
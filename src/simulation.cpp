@@ -1,12 +1,24 @@
 #include "simulation.hxx"
+#include "thread_pool.hxx"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <queue>
 #include <stdexcept>
+#include <unordered_map>
+#include <vector>
 
-void simulate(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf) {
+void simulate(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf, Time first_turn) {
     if (!f.is_consistent()) {
-        throw std::logic_error("Network is inconsistent");
+        throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
     }
 
-    for (Time t = 1; t <= rounds; ++t) {
+    for (Time t = first_turn; t <= rounds; ++t) {
+        if (f.apply_pending_changes(t) && !f.is_consistent()) {
+            throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+        }
 
         f.do_deliveries(t);
 
@@ -16,4 +28,394 @@ void simulate(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)>
 
         rf(f, t);
     }
-}
\ No newline at end of file
+}
+
+namespace {
+
+constexpr std::size_t node_grain = 256;
+
+// Tury sa rozbite na fazy: dostawy i losowanie odbiorcow odbywaja sie
+// sekwencyjnie (ta sama kolejnosc losowan i nadawania ID co w simulate()),
+// a wstawianie do kolejek odbiorcow i praca robotnikow - rownolegle. Gdy
+// wszyscy nadawcy losuja generatorem licznikowym, kolejnosc losowan nie ma
+// znaczenia i samo losowanie tez jest rownolegle; sekwencyjne zostaje tylko
+// sprawdzanie pojemnosci i rozdzial do skrzynek.
+class ParallelTurnEngine {
+public:
+    ParallelTurnEngine(Factory& f, std::size_t threads) : f_(f), pool_(threads) {
+        for (auto& ramp : f.ramp_collection()) {
+            senders_.push_back(&ramp);
+            ramps_.push_back(&ramp);
+        }
+        for (auto& worker : f.worker_collection()) {
+            workers_.push_back(&worker);
+            add_receiver(&worker, worker.get_queue());
+        }
+        for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+            senders_.push_back(&*it);
+        }
+        for (auto& store : f.storehouse_collection()) {
+            add_receiver(&store, store.get_queue());
+        }
+        inboxes_.resize(receivers_.size());
+
+        parallel_choice_ = std::all_of(senders_.begin(), senders_.end(), [](const IPackageSender* sender) {
+            return sender->receiver_preferences_.get_counter_rng().has_value();
+        });
+        if (parallel_choice_) {
+            // Leniwa przebudowa preferencji alokuje z areny - musi sie odbyc przed
+            // pierwszym rownoleglym losowaniem.
+            for (const IPackageSender* sender : senders_) {
+                sender->receiver_preferences_.get_preferences();
+            }
+            chosen_.resize(senders_.size());
+        }
+    }
+
+    void run_turn(Time t) {
+        t_ = t;
+        f_.do_deliveries(t);
+
+        if (parallel_choice_) {
+            pool_.parallel_for(senders_.size(), node_grain, [this, t](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    IPackageSender& sender = *senders_[i];
+                    chosen_[i] = sender.get_sending_buffer() ? sender.receiver_preferences_.choose_receiver(t) : nullptr;
+                }
+            });
+            for (std::size_t i = 0; i < senders_.size(); ++i) {
+                if (i < ramps_.size() && ramps_[i]->get_batch_size() > 1) {
+                    send_batch(*ramps_[i], t);
+                } else if (senders_[i]->get_sending_buffer()) {
+                    route(*senders_[i], chosen_[i]);
+                }
+            }
+        } else {
+            for (std::size_t i = 0; i < senders_.size(); ++i) {
+                IPackageSender* sender = senders_[i];
+                if (i < ramps_.size() && ramps_[i]->get_batch_size() > 1) {
+                    send_batch(*ramps_[i], t);
+                } else if (sender->get_sending_buffer()) {
+                    route(*sender, sender->receiver_preferences_.choose_receiver(t));
+                }
+            }
+        }
+
+        // Arena fabryki nie jest synchronizowana, wiec miejsce w kolejkach
+        // rezerwowane jest przed rownoleglym wstawianiem.
+        for (std::size_t r : touched_) {
+            stockpiles_[r]->reserve(stockpiles_[r]->size() + inboxes_[r].size());
+        }
+        pool_.parallel_for(touched_.size(), node_grain, [this, t](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                std::size_t r = touched_[i];
+                for (auto& p : inboxes_[r]) {
+                    receivers_[r]->receive_package(std::move(p), t);
+                }
+                inboxes_[r].clear();
+            }
+        });
+        touched_.clear();
+
+        pool_.parallel_for(workers_.size(), node_grain, [this, t](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                workers_[i]->do_work(t);
+            }
+        });
+        if constexpr (metrics_enabled) {
+            f_.metrics().last_turn = t;
+        }
+    }
+
+private:
+    void add_receiver(IPackageReceiver* r, IPackageStockpile* stockpile) {
+        receiver_index_.emplace(r, receivers_.size());
+        receivers_.push_back(r);
+        stockpiles_.push_back(stockpile);
+    }
+
+    void route(IPackageSender& sender, IPackageReceiver* receiver) {
+        auto& buffer = sender.get_sending_buffer();
+        std::size_t r = receiver ? receiver_index_.at(receiver) : 0;
+        // Pojemnosc liczona jest razem z polproduktami juz skierowanymi do odbiorcy w tej turze.
+        if (receiver && stockpiles_[r]->size() + inboxes_[r].size() >= stockpiles_[r]->capacity()) {
+            sender.count_blocked_turn();
+            return;
+        }
+        if constexpr (metrics_enabled) {
+            if (receiver && receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
+                f_.metrics().package_stored(buffer->get_id(), t_);
+            }
+        }
+        if (receiver) {
+            if (inboxes_[r].empty()) {
+                touched_.push_back(r);
+            }
+            inboxes_[r].push_back(std::move(*buffer));
+            sender.receiver_preferences_.count_delivered();
+        }
+        buffer.reset();
+    }
+
+    // Czesci partii trafiaja do skrzynek jak pojedyncze polprodukty - w tej
+    // samej kolejnosci i z tym samym limitem pojemnosci co w simulate().
+    void send_batch(Ramp& ramp, Time t) {
+        ramp.offer_batch(t, [this, t](IPackageReceiver* receiver, Package* packages, std::size_t n) {
+            std::size_t r = receiver_index_.at(receiver);
+            std::size_t queued = stockpiles_[r]->size() + inboxes_[r].size();
+            std::size_t capacity = stockpiles_[r]->capacity();
+            n = std::min(n, queued >= capacity ? 0 : capacity - queued);
+            if (n == 0) {
+                return n;
+            }
+            if constexpr (metrics_enabled) {
+                if (receiver->get_receiver_type() == ReceiverType::STOREHOUSE) {
+                    for (std::size_t k = 0; k < n; ++k) {
+                        f_.metrics().package_stored(packages[k].get_id(), t);
+                    }
+                }
+            }
+            if (inboxes_[r].empty()) {
+                touched_.push_back(r);
+            }
+            std::move(packages, packages + n, std::back_inserter(inboxes_[r]));
+            return n;
+        });
+    }
+
+    Factory& f_;
+    Time t_ = 0;
+    ThreadPool pool_;
+    std::vector<Worker*> workers_;
+    std::vector<IPackageSender*> senders_;  // rampy, potem robotnicy
+    std::vector<Ramp*> ramps_;
+    bool parallel_choice_ = false;
+    std::vector<IPackageReceiver*> chosen_;
+    std::vector<IPackageReceiver*> receivers_;
+    std::vector<IPackageStockpile*> stockpiles_;
+    std::unordered_map<const IPackageReceiver*, std::size_t> receiver_index_;
+    std::vector<std::vector<Package>> inboxes_;
+    std::vector<std::size_t> touched_;
+};
+
+}
+
+void simulate_parallel(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf, std::size_t threads,
+                       Time first_turn) {
+    if (!f.is_consistent()) {
+        throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+    }
+
+    // Po zmianie struktury silnik jest budowany od nowa (trzyma wskazniki do wezlow).
+    std::optional<ParallelTurnEngine> engine;
+    engine.emplace(f, threads);
+    for (Time t = first_turn; t <= rounds; ++t) {
+        if (f.has_pending_changes()) {
+            engine.reset();
+            f.apply_pending_changes(t);
+            if (!f.is_consistent()) {
+                throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+            }
+            engine.emplace(f, threads);
+        }
+        engine->run_turn(t);
+        rf(f, t);
+    }
+}
+
+namespace {
+
+// Zdarzenia dotycza pojedynczych wezlow: rampa ma zdarzenie w turach dostaw i
+// po zablokowanej wysylce, robotnik - gdy ma co wyslac, co pobrac z kolejki albo
+// konczy przetwarzanie. W turze obslugiwane sa tylko wezly ze zdarzeniem (w
+// kolejnosci deklaracji, wiec losowania ida w tej samej kolejnosci co w
+// simulate()) oraz robotnicy, ktorym w tej turze przybyly polprodukty.
+class EventTurnEngine {
+public:
+    EventTurnEngine(Factory& f, Time t) : f_(f) {
+        for (auto& ramp : f.ramp_collection()) {
+            ramps_.push_back(&ramp);
+        }
+        // Indeksy robotnikow ida w kolejnosci deklaracji, jak wysylka w simulate().
+        for (auto it = f.worker_declared_begin(); it != f.worker_declared_end(); ++it) {
+            worker_index_.emplace(&*it, workers_.size());
+            workers_.push_back(&*it);
+        }
+        seen_.assign(ramps_.size() + workers_.size(), 0);
+        next_delivery_.assign(ramps_.size(), 0);
+        // Stan wezlow nie jest znany (poczatek albo zmiana struktury) - wszystkie sa sprawdzane w turze t.
+        for (std::size_t node = 0; node < seen_.size(); ++node) {
+            events_.emplace(t, node);
+        }
+    }
+
+    void run_turn(Time t) {
+        due_ramps_.clear();
+        due_workers_.clear();
+        due_.swap(next_turn_);
+        next_turn_.clear();
+        while (!events_.empty() && events_.top().first <= t) {
+            due_.push_back(events_.top().second);
+            events_.pop();
+        }
+        for (std::size_t node : due_) {
+            if (node < ramps_.size()) {
+                if (seen_[node] != t) {
+                    seen_[node] = t;
+                    due_ramps_.push_back(node);
+                }
+            } else {
+                wake_worker(node - ramps_.size(), t);
+            }
+        }
+        std::sort(due_ramps_.begin(), due_ramps_.end());
+        std::sort(due_workers_.begin(), due_workers_.end());
+        std::size_t senders = due_workers_.size();
+
+        for (std::size_t r : due_ramps_) {
+            Ramp& ramp = *ramps_[r];
+            f_.do_delivery(ramp, t);
+            TimeOffset di = ramp.get_delivery_interval();
+            Time next = t + di - (t - 1) % di;
+            if (next_delivery_[r] != next) {
+                next_delivery_[r] = next;
+                schedule(r, next, t);
+            }
+        }
+        for (std::size_t r : due_ramps_) {
+            Ramp& ramp = *ramps_[r];
+            if (ramp.get_batch_size() > 1) {
+                ramp.send_batch(t, [this, t](IPackageReceiver* receiver, const Package* packages, std::size_t n) {
+                    for (std::size_t k = 0; k < n; ++k) {
+                        received(receiver, packages[k].get_id(), t);
+                    }
+                });
+            } else if (ramp.get_sending_buffer()) {
+                pass(ramp, t);
+            }
+            if (ramp.get_sending_buffer() || !ramp.get_batch().empty()) {
+                schedule(r, t + 1, t);
+            }
+        }
+        // Nadawcami moga byc tylko robotnicy ze zdarzeniem - polprodukt w buforze
+        // wysylkowym zawsze planuje zdarzenie na nastepna ture.
+        for (std::size_t i = 0; i < senders; ++i) {
+            Worker& worker = *workers_[due_workers_[i]];
+            if (worker.get_sending_buffer()) {
+                pass(worker, t);
+            }
+        }
+
+        for (std::size_t w : due_workers_) {
+            Worker& worker = *workers_[w];
+            worker.do_work(t);
+            if (worker.get_sending_buffer() || (!worker.get_processing_buffer() && !worker.get_queue()->empty())) {
+                schedule(ramps_.size() + w, t + 1, t);
+            } else if (worker.get_processing_buffer()) {
+                Time done = worker.get_package_processing_start_time() + worker.get_processing_duration() - 1;
+                schedule(ramps_.size() + w, std::max(done, t + 1), t);
+            }
+        }
+    }
+
+    // Najblizsza tura po t, w ktorej jakis wezel ma zdarzenie.
+    Time next_event_turn(Time t) const {
+        if (!next_turn_.empty()) {
+            return t + 1;
+        }
+        return events_.empty() ? std::numeric_limits<Time>::max() : events_.top().first;
+    }
+
+private:
+    // Wezly: rampy [0, R), robotnicy [R, R + W). Zdarzenia na nastepna ture (najczestsze)
+    // ida do zwyklej tablicy, pozniejsze - do kolejki priorytetowej.
+    using event_t = std::pair<Time, std::size_t>;
+
+    void schedule(std::size_t node, Time turn, Time t) {
+        if (turn == t + 1) {
+            next_turn_.push_back(node);
+        } else {
+            events_.emplace(turn, node);
+        }
+    }
+
+    void wake_worker(std::size_t w, Time t) {
+        if (seen_[ramps_.size() + w] != t) {
+            seen_[ramps_.size() + w] = t;
+            due_workers_.push_back(w);
+        }
+    }
+
+    void pass(IPackageSender& sender, Time t) {
+        ElementID id = sender.get_sending_buffer()->get_id();
+        IPackageReceiver* receiver = sender.send_package(t);
+        if (receiver) {
+            received(receiver, id, t);
+        }
+    }
+
+    void received(IPackageReceiver* receiver, ElementID id, Time t) {
+        if (receiver->get_receiver_type() == ReceiverType::WORKER) {
+            wake_worker(worker_index_.at(receiver), t);
+        } else if constexpr (metrics_enabled) {
+            f_.metrics().package_stored(id, t);
+        }
+    }
+
+    Factory& f_;
+    std::vector<Ramp*> ramps_;
+    std::vector<Worker*> workers_;
+    std::unordered_map<const IPackageReceiver*, std::size_t> worker_index_;
+    std::priority_queue<event_t, std::vector<event_t>, std::greater<>> events_;
+    std::vector<std::size_t> next_turn_;
+    std::vector<std::size_t> due_;
+    std::vector<Time> seen_;           // ostatnia tura, w ktorej wezel byl obsluzony
+    std::vector<Time> next_delivery_;  // zaplanowana tura nastepnej dostawy rampy
+    std::vector<std::size_t> due_ramps_;
+    std::vector<std::size_t> due_workers_;
+};
+
+}
+
+std::size_t simulate_event_driven(Factory& f, TimeOffset rounds, std::function<void(Factory&, Time)> rf,
+                                  std::function<bool(Time)> report_turns) {
+    if (!f.is_consistent()) {
+        throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+    }
+
+    // Po zmianie struktury silnik jest budowany od nowa (trzyma wskazniki do wezlow).
+    std::optional<EventTurnEngine> engine;
+    engine.emplace(f, 1);
+    std::size_t processed = 0;
+    Time t = 1;
+    while (t <= rounds) {
+        if (f.has_pending_changes()) {
+            engine.reset();
+            f.apply_pending_changes(t);
+            if (!f.is_consistent()) {
+                throw std::logic_error("Network is inconsistent: " + f.describe_inconsistency());
+            }
+            engine.emplace(f, t);
+        }
+        engine->run_turn(t);
+        ++processed;
+
+        // Tury bez zdarzen nie zmieniaja stanu - do nastepnego zdarzenia wolane sa
+        // tylko raporty. Zmiany zgloszone z raportu sa nakladane w nastepnej turze.
+        Time next = std::min(engine->next_event_turn(t), rounds + 1);
+        while (t < next) {
+            if constexpr (metrics_enabled) {
+                f.metrics().last_turn = t;
+            }
+            bool report = !report_turns || report_turns(t);
+            ++t;
+            if (report) {
+                rf(f, t - 1);
+                if (f.has_pending_changes()) {
+                    break;
+                }
+            }
+        }
+    }
+    return processed;
+}
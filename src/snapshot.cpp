@@ -0,0 +1,415 @@
+#include "snapshot.hxx"
+#include "helpers.hxx"
+#include "mapped_file.hxx"
+#include "package_id_allocator.hxx"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+constexpr char snapshot_magic[8] = {'N', 'S', 'I', 'M', 'S', 'N', 'A', 'P'};
+constexpr ElementID no_package = -1;
+
+struct PackageRecord {
+    ElementID id;
+    Time created;
+};
+
+class Writer {
+public:
+    explicit Writer(std::ostream& os) : os_(os) {}
+
+    template <typename T>
+    void put(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        os_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void put_string(const std::string& s) {
+        put<std::uint64_t>(s.size());
+        os_.write(s.data(), static_cast<std::streamsize>(s.size()));
+    }
+
+    void put_package(const Package& p) {
+        put<ElementID>(p.get_id());
+        put<Time>(p.get_creation_time());
+    }
+
+    void put_buffer(const std::optional<Package>& buffer) {
+        put<ElementID>(buffer ? buffer->get_id() : no_package);
+        put<Time>(buffer ? buffer->get_creation_time() : 0);
+    }
+
+    template <typename Packages>
+    void put_packages(const Packages& packages) {
+        put<std::uint64_t>(packages.size());
+        for (const auto& p : packages) {
+            put_package(p);
+        }
+    }
+
+    void put_links(const ReceiverPreferences& prefs) {
+        put<std::uint64_t>(prefs.get_preferences().size());
+        for (const auto& [receiver, p] : prefs.get_preferences()) {
+            put<std::uint8_t>(receiver->get_receiver_type() == ReceiverType::WORKER ? 0 : 1);
+            put<ElementID>(receiver->get_id());
+            put<double>(prefs.get_weight(receiver));
+        }
+    }
+
+private:
+    std::ostream& os_;
+};
+
+class Reader {
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        need(sizeof(T));
+        T value;
+        std::memcpy(&value, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    std::string_view get_bytes(std::size_t n) {
+        need(n);
+        std::string_view bytes = data_.substr(pos_, n);
+        pos_ += n;
+        return bytes;
+    }
+
+    std::size_t get_count() {
+        auto n = get<std::uint64_t>();
+        // Kazdy element zajmuje co najmniej bajt - chroni przed absurdalnymi rezerwacjami.
+        need(static_cast<std::size_t>(n));
+        return static_cast<std::size_t>(n);
+    }
+
+    // Bajt wyliczenia o wartosciach 0..last.
+    template <typename Enum>
+    Enum get_enum(Enum last, const char* what) {
+        auto value = get<std::uint8_t>();
+        if (value > static_cast<std::uint8_t>(last)) {
+            throw std::runtime_error(std::string("Corrupted snapshot: invalid ") + what);
+        }
+        return static_cast<Enum>(value);
+    }
+
+    std::vector<ElementID> get_ids() {
+        std::vector<ElementID> ids(get_count());
+        for (ElementID& id : ids) {
+            id = get<ElementID>();
+        }
+        return ids;
+    }
+
+    // Przed wersja 5 zapisywano same ID; tura powstania przyjmuje wtedy 0.
+    PackageRecord get_package(std::uint32_t version) {
+        PackageRecord p{get<ElementID>(), 0};
+        if (version >= 5) {
+            p.created = get<Time>();
+        }
+        return p;
+    }
+
+    std::vector<PackageRecord> get_packages(std::uint32_t version) {
+        std::vector<PackageRecord> packages(get_count());
+        for (PackageRecord& p : packages) {
+            p = get_package(version);
+        }
+        return packages;
+    }
+
+private:
+    void need(std::size_t n) const {
+        if (data_.size() - pos_ < n) {
+            throw std::runtime_error("Corrupted snapshot: unexpected end of data");
+        }
+    }
+
+    std::string_view data_;
+    std::size_t pos_ = 0;
+};
+
+// Polprodukty tworzone sa dopiero po wczytaniu calej migawki. Blad w trakcie
+// niszczy niepelna fabryke bez zwracania ID do puli wywolujacego, ktora moze
+// je miec w uzyciu.
+class PendingPackages {
+public:
+    void buffer(std::optional<Package>& target, PackageRecord p) {
+        if (p.id != no_package) {
+            buffers_.emplace_back(&target, p);
+        }
+    }
+    void batch(std::pmr::vector<Package>& target, std::vector<PackageRecord> packages) {
+        batches_.emplace_back(&target, std::move(packages));
+    }
+    void stockpile(IPackageStockpile& target, std::vector<PackageRecord> packages) {
+        stockpiles_.emplace_back(&target, std::move(packages));
+    }
+
+    void create() {
+        for (auto& [target, p] : buffers_) {
+            target->emplace(p.id, p.created);
+        }
+        for (auto& [target, packages] : batches_) {
+            target->reserve(packages.size());
+            for (const PackageRecord& p : packages) {
+                target->emplace_back(p.id, p.created);
+            }
+        }
+        for (auto& [target, packages] : stockpiles_) {
+            target->reserve(packages.size());
+            for (const PackageRecord& p : packages) {
+                target->push(Package(p.id, p.created));
+            }
+        }
+    }
+
+private:
+    std::vector<std::pair<std::optional<Package>*, PackageRecord>> buffers_;
+    std::vector<std::pair<std::pmr::vector<Package>*, std::vector<PackageRecord>>> batches_;
+    std::vector<std::pair<IPackageStockpile*, std::vector<PackageRecord>>> stockpiles_;
+};
+
+void read_links(Reader& in, Factory& f, IPackageSender& sender) {
+    for (std::size_t n = in.get_count(); n > 0; --n) {
+        auto kind = in.get_enum(ReceiverType::STOREHOUSE, "receiver type");
+        auto id = in.get<ElementID>();
+        auto weight = in.get<double>();
+        if (!(weight > 0.0) || !std::isfinite(weight)) {
+            throw std::runtime_error("Corrupted snapshot: invalid link weight");
+        }
+
+        IPackageReceiver* receiver = nullptr;
+        if (kind == ReceiverType::WORKER) {
+            auto it = f.find_worker_by_id(id);
+            if (it != f.worker_end()) receiver = &(*it);
+        } else {
+            auto it = f.find_storehouse_by_id(id);
+            if (it != f.storehouse_end()) receiver = &(*it);
+        }
+        if (!receiver) {
+            throw std::runtime_error("Corrupted snapshot: link to unknown node");
+        }
+        sender.receiver_preferences_.add_receiver(receiver, weight);
+    }
+}
+
+}
+
+void save_snapshot(const Factory& f, Time turn, std::ostream& os) {
+    Writer out(os);
+    os.write(snapshot_magic, sizeof(snapshot_magic));
+    out.put<std::uint32_t>(snapshot_version);
+    out.put<Time>(turn);
+
+    std::ostringstream rng_state;
+    rng_state << rng;
+    out.put_string(rng_state.str());
+    out.put<std::uint8_t>(f.counter_rng().has_value());
+    out.put<std::uint64_t>(f.counter_rng() ? f.counter_rng()->seed() : 0);
+
+    auto ids = PackageIdAllocator::current().save_state();
+    out.put<std::uint8_t>(static_cast<std::uint8_t>(ids.mode));
+    out.put<ElementID>(ids.next);
+    out.put<std::uint64_t>(ids.free_ids.size());
+    for (ElementID id : ids.free_ids) {
+        out.put<ElementID>(id);
+    }
+
+    std::vector<const Ramp*> ramps;
+    std::vector<Worker*> workers;
+    std::vector<const Storehouse*> storehouses;
+    for (auto it = f.ramp_cbegin(); it != f.ramp_cend(); ++it) ramps.push_back(&(*it));
+    for (auto it = f.worker_cbegin(); it != f.worker_cend(); ++it) workers.push_back(const_cast<Worker*>(&(*it)));
+    for (auto it = f.storehouse_cbegin(); it != f.storehouse_cend(); ++it) storehouses.push_back(&(*it));
+
+    out.put<std::uint64_t>(ramps.size());
+    for (const Ramp* ramp : ramps) {
+        out.put<ElementID>(ramp->get_id());
+        out.put<TimeOffset>(ramp->get_delivery_interval());
+        out.put_buffer(const_cast<Ramp*>(ramp)->get_sending_buffer());
+        out.put<std::uint64_t>(ramp->get_blocked_turns());
+        out.put<std::uint64_t>(ramp->get_batch_size());
+        out.put_packages(ramp->get_batch());
+    }
+
+    out.put<std::uint64_t>(workers.size());
+    for (Worker* worker : workers) {
+        out.put<ElementID>(worker->get_id());
+        out.put<TimeOffset>(worker->get_processing_duration());
+        out.put<std::uint8_t>(static_cast<std::uint8_t>(worker->get_queue()->get_queue_type()));
+        out.put<std::uint64_t>(worker->get_queue()->capacity());
+        out.put<std::uint64_t>(worker->get_blocked_turns());
+        out.put<Time>(worker->get_package_processing_start_time());
+        out.put_buffer(worker->get_processing_buffer());
+        out.put_buffer(worker->get_sending_buffer());
+        out.put_packages(*worker->get_queue());
+    }
+
+    out.put<std::uint64_t>(storehouses.size());
+    for (const Storehouse* store : storehouses) {
+        out.put<ElementID>(store->get_id());
+        out.put<std::uint64_t>(store->get_queue()->capacity());
+        out.put<std::uint8_t>(static_cast<std::uint8_t>(store->get_retention()));
+        out.put<std::uint64_t>(store->get_window_size());
+        const StorehouseStats& stats = store->get_stats();
+        out.put<std::uint64_t>(stats.received);
+        out.put<Time>(stats.first_arrival);
+        out.put<Time>(stats.last_arrival);
+        out.put<std::uint64_t>(stats.arrival_turns);
+        out.put_packages(*store->get_queue());
+    }
+
+    for (const Ramp* ramp : ramps) {
+        out.put_links(ramp->receiver_preferences_);
+    }
+    for (Worker* worker : workers) {
+        out.put_links(worker->receiver_preferences_);
+    }
+}
+
+void save_snapshot_file(const Factory& f, Time turn, const std::string& path) {
+    std::ofstream os(path, std::ios::binary);
+    if (!os) {
+        throw std::runtime_error("Cannot open " + path + " for writing");
+    }
+    save_snapshot(f, turn, os);
+    if (!os) {
+        throw std::runtime_error("Cannot write snapshot to " + path);
+    }
+}
+
+Snapshot load_snapshot(std::string_view data) {
+    Reader in(data);
+    if (in.get_bytes(sizeof(snapshot_magic)) != std::string_view(snapshot_magic, sizeof(snapshot_magic))) {
+        throw std::runtime_error("Not a NetSim snapshot");
+    }
+    auto version = in.get<std::uint32_t>();
+    // Wersja 1 nie zawiera pojemnosci kolejek ani liczby zablokowanych tur.
+    if (version < 1 || version > snapshot_version) {
+        throw std::runtime_error("Unsupported snapshot version " + std::to_string(version));
+    }
+
+    Snapshot snapshot;
+    snapshot.turn = in.get<Time>();
+
+    std::istringstream rng_state(std::string(in.get_bytes(in.get_count())));
+    std::mt19937 restored_rng;
+    rng_state >> restored_rng;
+    if (!rng_state) {
+        throw std::runtime_error("Corrupted snapshot: invalid rng state");
+    }
+    Factory& f = snapshot.factory;
+    if (version >= 6) {
+        bool counter_rng = in.get_enum(std::uint8_t{1}, "counter rng flag") != 0;
+        auto seed = in.get<std::uint64_t>();
+        // Wlaczone przed dodaniem wezlow - kazdy nadawca dostaje je przy add_*().
+        if (counter_rng) {
+            f.enable_counter_rng(seed);
+        }
+    }
+
+    PackageIdAllocator::State ids;
+    ids.mode = in.get_enum(IdAllocationMode::POOLED, "id allocation mode");
+    ids.next = in.get<ElementID>();
+    ids.free_ids = in.get_ids();
+
+    PendingPackages packages;
+    std::vector<Ramp*> ramps;
+    std::vector<Worker*> workers;
+
+    for (std::size_t n = in.get_count(); n > 0; --n) {
+        auto id = in.get<ElementID>();
+        auto di = in.get<TimeOffset>();
+        auto buffer = in.get_package(version);
+        auto blocked = version >= 2 ? in.get<std::uint64_t>() : 0;
+        auto batch = version >= 4 ? static_cast<std::size_t>(in.get<std::uint64_t>()) : 1;
+        if (batch == 0 || di <= 0) {
+            throw std::runtime_error("Corrupted snapshot: invalid ramp parameters");
+        }
+        if (f.find_ramp_by_id(id) != f.ramp_end()) {
+            throw std::runtime_error("Corrupted snapshot: duplicate node");
+        }
+        f.add_ramp(Ramp(id, di, batch));
+        Ramp* ramp = &(*f.find_ramp_by_id(id));
+        ramps.push_back(ramp);
+        packages.buffer(ramp->get_sending_buffer(), buffer);
+        ramp->set_blocked_turns(blocked);
+        if (version >= 4) {
+            packages.batch(ramp->get_batch(), in.get_packages(version));
+        }
+    }
+
+    for (std::size_t n = in.get_count(); n > 0; --n) {
+        auto id = in.get<ElementID>();
+        auto pd = in.get<TimeOffset>();
+        auto qt = in.get_enum(PackageQueueType::AGE, "queue type");
+        auto cap = version >= 2 ? static_cast<std::size_t>(in.get<std::uint64_t>()) : unbounded_capacity;
+        auto blocked = version >= 2 ? in.get<std::uint64_t>() : 0;
+        if (f.find_worker_by_id(id) != f.worker_end()) {
+            throw std::runtime_error("Corrupted snapshot: duplicate node");
+        }
+        f.add_worker(Worker(id, pd, std::make_unique<PackageQueue>(qt, cap)));
+        Worker* worker = &(*f.find_worker_by_id(id));
+        workers.push_back(worker);
+        worker->set_blocked_turns(blocked);
+        worker->set_package_processing_start_time(in.get<Time>());
+        packages.buffer(worker->get_processing_buffer(), in.get_package(version));
+        packages.buffer(worker->get_sending_buffer(), in.get_package(version));
+        packages.stockpile(*worker->get_queue(), in.get_packages(version));
+    }
+
+    for (std::size_t n = in.get_count(); n > 0; --n) {
+        auto id = in.get<ElementID>();
+        auto cap = version >= 2 ? static_cast<std::size_t>(in.get<std::uint64_t>()) : unbounded_capacity;
+        Storehouse store(id, std::make_unique<PackageQueue>(PackageQueueType::FIFO, cap));
+        if (version >= 3) {
+            auto retention = in.get_enum(StorehouseRetention::COUNT, "storehouse retention");
+            auto window = static_cast<std::size_t>(in.get<std::uint64_t>());
+            if (retention == StorehouseRetention::WINDOW && window == 0) {
+                throw std::runtime_error("Corrupted snapshot: invalid storehouse window");
+            }
+            store.set_retention(retention, window);
+            StorehouseStats stats;
+            stats.received = in.get<std::uint64_t>();
+            stats.first_arrival = in.get<Time>();
+            stats.last_arrival = in.get<Time>();
+            stats.arrival_turns = in.get<std::uint64_t>();
+            store.set_stats(stats);
+        }
+        if (f.find_storehouse_by_id(id) != f.storehouse_end()) {
+            throw std::runtime_error("Corrupted snapshot: duplicate node");
+        }
+        f.add_storehouse(std::move(store));
+        packages.stockpile(*f.find_storehouse_by_id(id)->get_queue(), in.get_packages(version));
+    }
+
+    for (Ramp* ramp : ramps) {
+        read_links(in, f, *ramp);
+    }
+    for (Worker* worker : workers) {
+        read_links(in, f, *worker);
+    }
+
+    // Polprodukty i stan globalny - dopiero po poprawnym wczytaniu calej migawki.
+    packages.create();
+    PackageIdAllocator::current().restore_state(ids);
+    rng = restored_rng;
+    return snapshot;
+}
+
+Snapshot load_snapshot_file(const std::string& path) {
+    MappedFile file(path);
+    return load_snapshot(file.view());
+}
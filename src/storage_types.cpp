@@ -1,29 +1,67 @@
 #include "storage_types.hxx"
+#include <algorithm>
+
+namespace {
+
+PackageQueue::queues_t make_queues(PackageQueueType type, std::size_t capacity) {
+    switch (type) {
+    case PackageQueueType::LIFO: return LifoQueue(capacity);
+    case PackageQueueType::AGE: return AgePriorityQueue(capacity);
+    default: return FifoQueue(capacity);
+    }
+}
+
+}
+
+PackageQueue::PackageQueue(PackageQueueType type, std::size_t capacity) : queues_(make_queues(type, capacity)) {}
 
 void PackageQueue::push(Package&& package) {
-    queue_.emplace_back(std::move(package));
+    std::visit([&package](auto& q) { q.push(std::move(package)); }, queues_);
 }
 
 bool PackageQueue::empty() const {
-    return queue_.empty();
+    return std::visit([](const auto& q) { return q.empty(); }, queues_);
 }
 
 std::size_t PackageQueue::size() const {
-    return queue_.size();
+    return std::visit([](const auto& q) { return q.size(); }, queues_);
 }
 
 std::optional<Package> PackageQueue::pop() {
-    if (empty()) {
-        return std::nullopt;
-    }
-    
-    Package p = std::move((queue_type_ == PackageQueueType::FIFO) ? queue_.front() : queue_.back());
-    
-    if (queue_type_ == PackageQueueType::FIFO) {
-        queue_.pop_front();
-    } else {
-        queue_.pop_back();
-    }
-    
-    return std::move(p);
-}
\ No newline at end of file
+    return std::visit([](auto& q) { return q.pop(); }, queues_);
+}
+
+PackageQueueType PackageQueue::get_queue_type() const {
+    return std::visit([](const auto& q) { return q.get_queue_type(); }, queues_);
+}
+
+std::size_t PackageQueue::capacity() const {
+    return std::visit([](const auto& q) { return q.capacity(); }, queues_);
+}
+
+void PackageQueue::set_memory_resource(std::pmr::memory_resource* resource) {
+    std::visit([resource](auto& q) { q.set_memory_resource(resource); }, queues_);
+}
+
+void PackageQueue::reserve(std::size_t n) {
+    std::visit([n](auto& q) { q.reserve(n); }, queues_);
+}
+
+std::unique_ptr<IPackageStockpile> PackageQueue::relocate(std::pmr::memory_resource* resource) {
+    auto fresh = std::make_unique<PackageQueue>(get_queue_type(), capacity());
+    std::visit([&fresh, resource](auto& q) {
+        auto& target = std::get<std::decay_t<decltype(q)>>(fresh->queues_);
+        target.set_memory_resource(resource);
+        target.reserve(std::max<std::size_t>(q.size(), 1));
+        target.take_all(q);
+    }, queues_);
+    return fresh;
+}
+
+IPackageStockpile::const_iterator PackageQueue::cbegin() const {
+    return std::visit([](const auto& q) { return q.cbegin(); }, queues_);
+}
+
+IPackageStockpile::const_iterator PackageQueue::cend() const {
+    return std::visit([](const auto& q) { return q.cend(); }, queues_);
+}
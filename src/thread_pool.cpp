@@ -0,0 +1,103 @@
+#include "thread_pool.hxx"
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    ranges_ = std::make_unique<Range[]>(threads);
+    workers_.reserve(threads - 1);
+    for (std::size_t i = 1; i < threads; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto& w : workers_) {
+        w.join();
+    }
+}
+
+void ThreadPool::parallel_for(std::size_t n, std::size_t grain, const range_function& f) {
+    if (n == 0) {
+        return;
+    }
+    grain = std::max<std::size_t>(grain, 1);
+    if (workers_.empty() || n <= grain) {
+        f(0, n);
+        return;
+    }
+
+    std::size_t participants = size();
+    for (std::size_t i = 0; i < participants; ++i) {
+        ranges_[i].next.store(n * i / participants, std::memory_order_relaxed);
+        ranges_[i].end = n * (i + 1) / participants;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &f;
+        grain_ = grain;
+        error_ = nullptr;
+        pending_ = workers_.size();
+        ++generation_;
+    }
+    start_cv_.notify_all();
+
+    run_participant(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+    job_ = nullptr;
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void ThreadPool::worker_loop(std::size_t participant) {
+    std::size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+        }
+
+        run_participant(participant);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) {
+            done_cv_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run_participant(std::size_t participant) {
+    std::size_t participants = size();
+    try {
+        // Najpierw wlasny zakres, potem podkradanie od kolejnych uczestnikow.
+        for (std::size_t k = 0; k < participants; ++k) {
+            Range& r = ranges_[(participant + k) % participants];
+            for (;;) {
+                std::size_t begin = r.next.fetch_add(grain_, std::memory_order_relaxed);
+                if (begin >= r.end) {
+                    break;
+                }
+                (*job_)(begin, std::min(begin + grain_, r.end));
+            }
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+    }
+}
@@ -0,0 +1,256 @@
+#include "topology.hxx"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+void erase_one(std::pmr::vector<std::uint32_t>& v, std::uint32_t x) {
+    auto it = std::find(v.begin(), v.end(), x);
+    if (it != v.end()) {
+        *it = v.back();
+        v.pop_back();
+    }
+}
+
+const char* kind_name(NodeKind kind) {
+    switch (kind) {
+    case NodeKind::RAMP: return "ramp";
+    case NodeKind::WORKER: return "worker";
+    default: return "storehouse";
+    }
+}
+
+}
+
+std::uint32_t TopologyIndex::add_node(NodeKind kind, ElementID id, IPackageSender* sender, IPackageReceiver* receiver) {
+    std::uint32_t n;
+    if (receiver && receiver_index_.count(receiver)) {
+        // Odbiorca znany wczesniej tylko jako cel polaczenia - flagi trzeba przeliczyc.
+        n = receiver_index_[receiver];
+        dirty_ = true;
+    } else if (!free_nodes_.empty()) {
+        n = free_nodes_.back();
+        free_nodes_.pop_back();
+        nodes_[n] = Node(resource_);
+    } else {
+        n = static_cast<std::uint32_t>(nodes_.size());
+        nodes_.emplace_back(resource_);
+    }
+
+    Node& node = nodes_[n];
+    node.kind = kind;
+    node.id = id;
+    node.sender = sender;
+    node.receiver = receiver;
+    node.alive = true;
+    if (sender) {
+        sender_index_[sender] = n;
+    }
+    if (receiver) {
+        receiver_index_[receiver] = n;
+    }
+
+    if (!dirty_ && kind == NodeKind::STOREHOUSE) {
+        mark_reaches_store(n);
+    }
+    if (!dirty_ && kind == NodeKind::RAMP) {
+        mark_from_ramp(n);
+    }
+    if (sender) {
+        sender->receiver_preferences_.set_observer(this, sender);
+        for (const auto& [r, p] : sender->receiver_preferences_.get_preferences()) {
+            on_link_added(sender, r);
+        }
+    }
+    return n;
+}
+
+void TopologyIndex::add_ramp(Ramp& ramp) {
+    add_node(NodeKind::RAMP, ramp.get_id(), &ramp, nullptr);
+}
+
+void TopologyIndex::add_worker(Worker& worker) {
+    add_node(NodeKind::WORKER, worker.get_id(), &worker, &worker);
+}
+
+void TopologyIndex::add_storehouse(Storehouse& storehouse) {
+    add_node(NodeKind::STOREHOUSE, storehouse.get_id(), nullptr, &storehouse);
+}
+
+std::uint32_t TopologyIndex::node_of(IPackageReceiver* receiver) {
+    auto it = receiver_index_.find(receiver);
+    if (it != receiver_index_.end()) {
+        return it->second;
+    }
+    // Odbiorca spoza fabryki: zapamietywany jako martwy wezel, zeby zachowac krawedz.
+    std::uint32_t n = static_cast<std::uint32_t>(nodes_.size());
+    nodes_.emplace_back(resource_);
+    nodes_[n].kind = receiver->get_receiver_type() == ReceiverType::STOREHOUSE ? NodeKind::STOREHOUSE : NodeKind::WORKER;
+    nodes_[n].id = receiver->get_id();
+    nodes_[n].receiver = receiver;
+    nodes_[n].reaches_store = nodes_[n].kind == NodeKind::STOREHOUSE;
+    receiver_index_.emplace(receiver, n);
+    return n;
+}
+
+void TopologyIndex::remove_node(const IPackageSender* sender, const IPackageReceiver* receiver) {
+    std::uint32_t n = npos;
+    if (sender && sender_index_.count(sender)) {
+        n = sender_index_[sender];
+    } else if (receiver && receiver_index_.count(receiver)) {
+        n = receiver_index_[receiver];
+    }
+    if (n == npos) {
+        return;
+    }
+
+    Node& node = nodes_[n];
+    for (std::uint32_t m : node.out) {
+        erase_one(nodes_[m].in, n);
+    }
+    for (std::uint32_t m : node.in) {
+        erase_one(nodes_[m].out, n);
+    }
+    if (node.sender) {
+        sender_index_.erase(node.sender);
+    }
+    if (node.receiver) {
+        receiver_index_.erase(node.receiver);
+    }
+    node = Node(resource_);
+    free_nodes_.push_back(n);
+    dirty_ = true;
+}
+
+void TopologyIndex::on_link_added(IPackageSender* sender, IPackageReceiver* receiver) {
+    auto it = sender_index_.find(sender);
+    if (it == sender_index_.end()) {
+        return;
+    }
+    std::uint32_t u = it->second;
+    std::uint32_t v = node_of(receiver);
+    nodes_[u].out.push_back(v);
+    nodes_[v].in.push_back(u);
+
+    if (dirty_ || u == v) {
+        return;
+    }
+    if (nodes_[v].reaches_store && !nodes_[u].reaches_store) {
+        mark_reaches_store(u);
+    }
+    if (nodes_[u].from_ramp && !nodes_[v].from_ramp) {
+        mark_from_ramp(v);
+    }
+}
+
+void TopologyIndex::on_link_removed(IPackageSender* sender, IPackageReceiver* receiver) {
+    auto s = sender_index_.find(sender);
+    auto r = receiver_index_.find(receiver);
+    if (s == sender_index_.end() || r == receiver_index_.end()) {
+        return;
+    }
+    erase_one(nodes_[s->second].out, r->second);
+    erase_one(nodes_[r->second].in, s->second);
+    dirty_ = true;
+}
+
+std::vector<IPackageSender*> TopologyIndex::senders_of(const IPackageReceiver* receiver) const {
+    std::vector<IPackageSender*> senders;
+    auto it = receiver_index_.find(receiver);
+    if (it != receiver_index_.end()) {
+        for (std::uint32_t m : nodes_[it->second].in) {
+            senders.push_back(nodes_[m].sender);
+        }
+    }
+    return senders;
+}
+
+void TopologyIndex::mark_reaches_store(std::uint32_t start) {
+    std::vector<std::uint32_t> stack{start};
+    nodes_[start].reaches_store = true;
+    while (!stack.empty()) {
+        std::uint32_t n = stack.back();
+        stack.pop_back();
+        if (nodes_[n].alive && nodes_[n].from_ramp) {
+            --bad_count_;
+        }
+        for (std::uint32_t m : nodes_[n].in) {
+            if (!nodes_[m].reaches_store) {
+                nodes_[m].reaches_store = true;
+                stack.push_back(m);
+            }
+        }
+    }
+}
+
+void TopologyIndex::mark_from_ramp(std::uint32_t start) {
+    std::vector<std::uint32_t> stack{start};
+    nodes_[start].from_ramp = true;
+    while (!stack.empty()) {
+        std::uint32_t n = stack.back();
+        stack.pop_back();
+        if (is_bad(nodes_[n])) {
+            ++bad_count_;
+        }
+        for (std::uint32_t m : nodes_[n].out) {
+            if (!nodes_[m].from_ramp) {
+                nodes_[m].from_ramp = true;
+                stack.push_back(m);
+            }
+        }
+    }
+}
+
+void TopologyIndex::recompute() {
+    bad_count_ = 0;
+    for (auto& node : nodes_) {
+        node.from_ramp = false;
+        node.reaches_store = false;
+    }
+    // Kolejnosc ma znaczenie dla licznika: najpierw "prowadzi do magazynu",
+    // potem "osiagalny z rampy" (ten drugi liczy wezly bez drogi do magazynu).
+    for (std::uint32_t n = 0; n < nodes_.size(); ++n) {
+        if (nodes_[n].kind == NodeKind::STOREHOUSE && !nodes_[n].reaches_store) {
+            mark_reaches_store(n);
+        }
+    }
+    for (std::uint32_t n = 0; n < nodes_.size(); ++n) {
+        if (nodes_[n].alive && nodes_[n].kind == NodeKind::RAMP && !nodes_[n].from_ramp) {
+            mark_from_ramp(n);
+        }
+    }
+    dirty_ = false;
+}
+
+bool TopologyIndex::is_consistent() {
+    if (dirty_) {
+        recompute();
+    }
+    return bad_count_ == 0;
+}
+
+std::string TopologyIndex::describe_inconsistency() {
+    if (is_consistent()) {
+        return {};
+    }
+    // Wskazujemy najglebszy wezel: bez polaczen do innych wezlow, jesli taki jest.
+    const Node* offending = nullptr;
+    for (std::uint32_t n = 0; n < nodes_.size(); ++n) {
+        const Node& node = nodes_[n];
+        if (!is_bad(node)) {
+            continue;
+        }
+        bool dead_end = std::all_of(node.out.begin(), node.out.end(), [n](std::uint32_t m) { return m == n; });
+        if (!offending || dead_end) {
+            offending = &node;
+            if (dead_end) {
+                break;
+            }
+        }
+    }
+
+    std::ostringstream os;
+    os << kind_name(offending->kind) << " #" << offending->id;
+    os << (offending->out.empty() ? " has no receivers" : " has no reachable storehouse");
+    return os.str();
+}
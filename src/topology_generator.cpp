@@ -0,0 +1,88 @@
+#include "topology_generator.hxx"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::unique_ptr<IPackageStockpile> make_queue(std::size_t i) {
+    return std::make_unique<PackageQueue>(i % 2 ? PackageQueueType::LIFO : PackageQueueType::FIFO);
+}
+
+}
+
+Factory generate_topology(const TopologySpec& spec, std::pmr::memory_resource* resource) {
+    Factory f(resource);
+    std::size_t n = std::max<std::size_t>(spec.workers, 1);
+    std::size_t width = std::max<std::size_t>(spec.width, 1);
+    // Warstwa ramp ma szerokosc warstwy robotnikow tylko w sieci warstwowej.
+    std::size_t ramps = spec.shape == TopologyShape::LAYERED ? std::min(width, n) : 1;
+
+    for (std::size_t i = 0; i < ramps; ++i) {
+        f.add_ramp(Ramp(static_cast<ElementID>(i + 1), spec.delivery_interval));
+    }
+    std::vector<std::size_t> declared(n);
+    std::iota(declared.begin(), declared.end(), 0);
+    if (spec.shuffle_seed) {
+        std::shuffle(declared.begin(), declared.end(), std::mt19937_64(spec.shuffle_seed));
+    }
+    for (std::size_t i : declared) {
+        f.add_worker(Worker(static_cast<ElementID>(i + 1), spec.processing_time, make_queue(i)));
+    }
+    f.add_storehouse(Storehouse(1));
+
+    // Kolekcje wezlow nie przenosza elementow przy dodawaniu, wiec wskazniki sa stale.
+    std::vector<Worker*> w;
+    w.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        w.push_back(&*f.find_worker_by_id(static_cast<ElementID>(i + 1)));
+    }
+    Storehouse* store = &*f.find_storehouse_by_id(1);
+
+    switch (spec.shape) {
+    case TopologyShape::CHAIN:
+        f.find_ramp_by_id(1)->receiver_preferences_.add_receiver(w[0]);
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+            w[i]->receiver_preferences_.add_receiver(w[i + 1]);
+        }
+        w[n - 1]->receiver_preferences_.add_receiver(store);
+        break;
+
+    case TopologyShape::FAN_OUT:
+        f.find_ramp_by_id(1)->receiver_preferences_.add_receiver(w[0]);
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t first = i * width + 1;
+            if (first >= n) {
+                w[i]->receiver_preferences_.add_receiver(store);
+                continue;
+            }
+            for (std::size_t c = first; c < std::min(first + width, n); ++c) {
+                w[i]->receiver_preferences_.add_receiver(w[c]);
+            }
+        }
+        break;
+
+    case TopologyShape::LAYERED: {
+        std::size_t layer_width = std::min(width, n);
+        for (std::size_t i = 0; i < ramps; ++i) {
+            auto& prefs = f.find_ramp_by_id(static_cast<ElementID>(i + 1))->receiver_preferences_;
+            prefs.add_receiver(w[i]);
+            prefs.add_receiver(w[(i + 1) % layer_width]);
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t next_layer = (i / layer_width + 1) * layer_width;
+            if (next_layer >= n) {
+                w[i]->receiver_preferences_.add_receiver(store);
+                continue;
+            }
+            std::size_t next_width = std::min(layer_width, n - next_layer);
+            std::size_t j = i % layer_width;
+            w[i]->receiver_preferences_.add_receiver(w[next_layer + j % next_width]);
+            w[i]->receiver_preferences_.add_receiver(w[next_layer + (j + 1) % next_width]);
+        }
+        break;
+    }
+    }
+    return f;
+}
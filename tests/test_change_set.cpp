@@ -0,0 +1,173 @@
+#include "gtest/gtest.h"
+#include "change_set.hxx"
+#include "distributed.hxx"
+#include "factory.hxx"
+#include "flat_factory.hxx"
+#include "helpers.hxx"
+#include "package_id_allocator.hxx"
+#include "reports.hxx"
+#include "simulation.hxx"
+#include <sstream>
+
+namespace {
+
+constexpr const char* structure =
+    "LOADING_RAMP id=1 delivery-interval=1\n"
+    "LOADING_RAMP id=2 delivery-interval=2\n"
+    "WORKER id=1 processing-time=2\n"
+    "WORKER id=2 processing-time=3 queue-type=LIFO\n"
+    "WORKER id=3 processing-time=1\n"
+    "STOREHOUSE id=1\n"
+    "STOREHOUSE id=2\n"
+    "LINK src=ramp-1 dest=worker-1\n"
+    "LINK src=ramp-1 dest=worker-2\n"
+    "LINK src=ramp-2 dest=worker-2\n"
+    "LINK src=worker-1 dest=worker-2\n"
+    "LINK src=worker-1 dest=worker-3\n"
+    "LINK src=worker-2 dest=worker-3\n"
+    "LINK src=worker-2 dest=store-1\n"
+    "LINK src=worker-3 dest=store-1\n"
+    "LINK src=worker-3 dest=store-2\n";
+
+// W turze 12 dochodzi robotnik 4, robotnik 2 znika (z REROUTE), a polaczenie
+// rampy 1 dostaje nowa wage.
+ChangeSet hot_swap() {
+    ChangeSet changes;
+    changes.add_worker(Worker(4, 2, std::make_unique<PackageQueue>(PackageQueueType::AGE)))
+        .link({NodeKind::RAMP, 1}, {NodeKind::WORKER, 4})
+        .link({NodeKind::RAMP, 2}, {NodeKind::WORKER, 4})
+        .link({NodeKind::WORKER, 4}, {NodeKind::STOREHOUSE, 2})
+        .link({NodeKind::RAMP, 1}, {NodeKind::WORKER, 1}, 3.0)
+        .remove({NodeKind::WORKER, 2})
+        .set_drain_policy(DrainPolicy::REROUTE);
+    return changes;
+}
+
+template <typename Simulate>
+std::string run_with_hot_swap(Simulate simulate_fn) {
+    PackageIdAllocator ids;
+    PackageIdAllocator::Scope scope(ids);
+    Factory f = load_factory_structure(std::string_view(structure));
+    rng.seed(11);
+    std::ostringstream report;
+    simulate_fn(f, 30, [&report](Factory& factory, Time t) {
+        generate_simulation_turn_report(factory, report, t);
+        if (t == 11) {
+            factory.submit_changes(hot_swap());
+        }
+    });
+    EXPECT_EQ(f.worker_collection().end(), f.find_worker_by_id(2));
+    return report.str();
+}
+
+}
+
+TEST(ChangeSetTest, InvalidSetChangesNothing) {
+    Factory f = load_factory_structure(std::string_view(structure));
+    ChangeSet changes;
+    changes.add_worker(Worker(4, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)))
+        .link({NodeKind::WORKER, 4}, {NodeKind::WORKER, 2})
+        .remove({NodeKind::WORKER, 2});
+    EXPECT_THROW(f.apply_changes(std::move(changes), 1), std::invalid_argument);
+    EXPECT_EQ(f.worker_collection().end(), f.find_worker_by_id(4));
+    EXPECT_NE(f.worker_collection().end(), f.find_worker_by_id(2));
+
+    ChangeSet unknown;
+    unknown.remove({NodeKind::STOREHOUSE, 7});
+    EXPECT_THROW(f.apply_changes(std::move(unknown), 1), std::invalid_argument);
+    ChangeSet duplicate;
+    duplicate.add_storehouse(Storehouse(1));
+    EXPECT_THROW(f.apply_changes(std::move(duplicate), 1), std::invalid_argument);
+    ChangeSet backwards;
+    backwards.link({NodeKind::STOREHOUSE, 1}, {NodeKind::WORKER, 1});
+    EXPECT_THROW(f.apply_changes(std::move(backwards), 1), std::invalid_argument);
+    EXPECT_TRUE(f.is_consistent());
+}
+
+TEST(ChangeSetTest, RemovedWorkerIsDrainedByPolicy) {
+    for (DrainPolicy policy : {DrainPolicy::DISCARD, DrainPolicy::REROUTE}) {
+        Factory f = load_factory_structure(std::string_view(structure));
+        Worker& doomed = *f.find_worker_by_id(2);
+        for (ElementID id = 100; id < 105; ++id) {
+            doomed.receive_package(Package(id));
+        }
+        doomed.get_sending_buffer().emplace(105);
+
+        ChangeSet changes;
+        changes.remove({NodeKind::WORKER, 2})
+            .remove({NodeKind::WORKER, 3})
+            .link({NodeKind::WORKER, 1}, {NodeKind::STOREHOUSE, 2}, 2.0)
+            .link({NodeKind::RAMP, 2}, {NodeKind::WORKER, 1})
+            .set_drain_policy(policy);
+        f.apply_changes(std::move(changes), 1);
+
+        // Robotnik 3 tez znika, wiec jedynym pozostalym odbiorca jest magazyn 1.
+        std::size_t stored = f.find_storehouse_by_id(1)->get_queue()->size();
+        EXPECT_EQ(policy == DrainPolicy::REROUTE ? 6u : 0u, stored);
+        EXPECT_EQ(policy == DrainPolicy::REROUTE ? 0u : 6u, f.get_discarded_packages());
+        const auto& prefs = f.find_worker_by_id(1)->receiver_preferences_;
+        ASSERT_EQ(1u, prefs.get_preferences().size());
+        EXPECT_DOUBLE_EQ(2.0, prefs.get_weight(&(*f.find_storehouse_by_id(2))));
+        EXPECT_EQ(1u, f.find_ramp_by_id(1)->receiver_preferences_.get_preferences().size());
+        EXPECT_TRUE(f.is_consistent());
+    }
+}
+
+TEST(ChangeSetTest, RerouteRespectsReceiverCapacity) {
+    Factory f = load_factory_structure(std::string_view(
+        "WORKER id=1 processing-time=1\n"
+        "STOREHOUSE id=1 queue-capacity=2\n"
+        "LINK src=worker-1 dest=store-1\n"));
+    Worker& doomed = *f.find_worker_by_id(1);
+    for (ElementID id = 1; id <= 5; ++id) {
+        doomed.receive_package(Package(id));
+    }
+    ChangeSet changes;
+    changes.remove({NodeKind::WORKER, 1}).set_drain_policy(DrainPolicy::REROUTE);
+    f.apply_changes(std::move(changes), 1);
+
+    EXPECT_EQ(2u, f.find_storehouse_by_id(1)->get_queue()->size());
+    EXPECT_EQ(3u, f.get_discarded_packages());
+}
+
+TEST(ChangeSetTest, InvalidPendingSetKeepsLaterOnes) {
+    Factory f = load_factory_structure(std::string_view(structure));
+    ChangeSet first;
+    first.add_storehouse(Storehouse(3));
+    ChangeSet invalid;
+    invalid.remove({NodeKind::WORKER, 9});
+    ChangeSet last;
+    last.link({NodeKind::WORKER, 3}, {NodeKind::STOREHOUSE, 3});
+    f.submit_changes(std::move(first));
+    f.submit_changes(std::move(invalid));
+    f.submit_changes(std::move(last));
+
+    EXPECT_THROW(f.apply_pending_changes(1), std::invalid_argument);
+    EXPECT_NE(f.storehouse_collection().end(), f.find_storehouse_by_id(3));
+    ASSERT_TRUE(f.has_pending_changes());
+    EXPECT_TRUE(f.apply_pending_changes(2));
+    EXPECT_FALSE(f.has_pending_changes());
+    EXPECT_EQ(3u, f.find_worker_by_id(3)->receiver_preferences_.get_preferences().size());
+}
+
+TEST(ChangeSetTest, HotSwapMatchesAcrossEngines) {
+    std::string serial = run_with_hot_swap([](Factory& f, TimeOffset rounds, auto rf) { simulate(f, rounds, rf); });
+    std::string parallel = run_with_hot_swap([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_parallel(f, rounds, rf, 2);
+    });
+    std::string flat = run_with_hot_swap([](Factory& f, TimeOffset rounds, auto rf) { simulate_flat(f, rounds, rf); });
+    std::string events = run_with_hot_swap([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_event_driven(f, rounds, rf);
+    });
+    EXPECT_NE(std::string::npos, serial.find("WORKER #4"));
+    EXPECT_EQ(serial, parallel);
+    EXPECT_EQ(serial, flat);
+    EXPECT_EQ(serial, events);
+
+    Factory f = load_factory_structure(std::string_view(structure));
+    f.enable_counter_rng(3);
+    auto submit = [](Factory& factory, Time t) {
+        if (t == 2) factory.submit_changes(hot_swap());
+    };
+    EXPECT_THROW(simulate_distributed(f, 5, submit, 2), std::logic_error);
+}
@@ -1,5 +1,11 @@
 #include "gtest/gtest.h"
+#include <numeric>
 #include "factory.hxx"
+#include <cstdio>
+#include <fstream>
+#include <memory_resource>
+#include <sstream>
+#include <vector>
 
 TEST(FactoryTest, IsConsistent_SimplePath) {
     Factory f;
@@ -48,4 +54,321 @@ TEST(FactoryTest, IsNotConsistent_CycleLoop) {
     worker->receiver_preferences_.add_receiver(worker);
 
     EXPECT_FALSE(f.is_consistent());
-}
\ No newline at end of file
+}
+TEST(NodeCollectionTest, FindAndRemoveKeepAddressesStable) {
+    NodeCollection<Storehouse> c;
+    for (ElementID id = 1; id <= 1000; ++id) {
+        c.add(Storehouse(id));
+    }
+    Storehouse* s500 = &(*c.find_by_id(500));
+
+    c.remove_by_id(3);
+    for (ElementID id = 1001; id <= 2000; ++id) {
+        c.add(Storehouse(id));
+    }
+
+    EXPECT_EQ(s500, &(*c.find_by_id(500)));
+    EXPECT_EQ(500, s500->get_id());
+    EXPECT_EQ(c.end(), c.find_by_id(3));
+    EXPECT_EQ(1999u, c.size());
+    EXPECT_EQ(1999, std::distance(c.cbegin(), c.cend()));
+}
+
+TEST(NodeCollectionTest, AddKeepsInsertionOrderAndRejectsDuplicates) {
+    NodeCollection<Storehouse> c;
+    for (ElementID id = 1; id <= 5; ++id) {
+        c.add(Storehouse(id));
+    }
+    c.remove_by_id(2);
+    c.add(Storehouse(9));
+    EXPECT_THROW(c.add(Storehouse(4)), std::invalid_argument);
+
+    std::vector<ElementID> order;
+    for (const auto& s : c) {
+        order.push_back(s.get_id());
+    }
+    EXPECT_EQ((std::vector<ElementID>{1, 3, 4, 5, 9}), order);
+    EXPECT_EQ(5u, c.size());
+
+    EXPECT_THROW(load_factory_structure(std::string_view("WORKER id=1\nWORKER id=1\n")), StructureParseError);
+}
+
+TEST(NodeCollectionTest, ReusesFreedSlotsAndKeepsInsertionOrder) {
+    NodeCollection<Storehouse> c;
+    for (ElementID id = 1; id <= 600; ++id) {
+        c.add(Storehouse(id));
+    }
+    Storehouse* kept = &(*c.find_by_id(50));
+    // Wymiana wezlow w srodku kolekcji (jak przy podmianie w trakcie symulacji).
+    for (ElementID id = 601; id <= 5000; ++id) {
+        c.remove_by_id(id - 500);
+        c.add(Storehouse(id));
+    }
+    EXPECT_EQ(600u, c.slot_count());
+    EXPECT_EQ(kept, &(*c.find_by_id(50)));
+
+    std::vector<ElementID> order;
+    for (const auto& s : c) {
+        order.push_back(s.get_id());
+    }
+    std::vector<ElementID> expected(100);
+    std::iota(expected.begin(), expected.end(), 1);
+    for (ElementID id = 4501; id <= 5000; ++id) {
+        expected.push_back(id);
+    }
+    EXPECT_EQ(expected, order);
+    EXPECT_EQ(4600, c.find_by_id(4600)->get_id());
+    EXPECT_EQ(c.end(), c.find_by_id(4000));
+}
+
+namespace {
+
+class CountingResource : public std::pmr::memory_resource {
+public:
+    std::size_t allocations = 0;
+    std::size_t outstanding = 0;
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t align) override {
+        ++allocations;
+        outstanding += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+        outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+}
+
+TEST(FactoryTest, NodesAllocateFromFactoryResource) {
+    CountingResource resource;
+    {
+        Factory f(&resource);
+        f.add_ramp(Ramp(1, 1));
+        f.add_worker(Worker(1, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+        f.add_storehouse(Storehouse(1));
+        f.find_ramp_by_id(1)->receiver_preferences_.add_receiver(&*f.find_worker_by_id(1));
+        f.find_worker_by_id(1)->receiver_preferences_.add_receiver(&*f.find_storehouse_by_id(1));
+
+        std::size_t before = resource.allocations;
+        f.find_worker_by_id(1)->receive_package(Package());
+        EXPECT_GT(resource.allocations, before);
+        EXPECT_EQ(&resource, f.memory_resource());
+    }
+    EXPECT_EQ(0u, resource.outstanding);
+}
+
+TEST(FactoryIOTest, LinkWeightRoundTrip) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "STOREHOUSE id=1\n"
+        "STOREHOUSE id=2\n"
+        "LINK src=ramp-1 dest=store-1\n"
+        "LINK src=ramp-1 dest=store-2 weight=3\n");
+    auto factory = load_factory_structure(iss);
+
+    const auto& prefs = factory.find_ramp_by_id(1)->receiver_preferences_;
+    EXPECT_DOUBLE_EQ(0.75, prefs.get_preferences()[1].second);
+
+    std::ostringstream oss;
+    save_factory_structure(factory, oss);
+    EXPECT_NE(std::string::npos, oss.str().find("LINK src=ramp-1 dest=store-2 weight=3\n"));
+    EXPECT_NE(std::string::npos, oss.str().find("LINK src=ramp-1 dest=store-1\n"));
+}
+
+TEST(FactoryTest, ConsistencyFollowsLinkChanges) {
+    Factory f;
+    f.add_ramp(Ramp(1, 1));
+    f.add_worker(Worker(1, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    f.add_worker(Worker(2, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    f.add_storehouse(Storehouse(1));
+
+    auto* ramp = &(*f.find_ramp_by_id(1));
+    auto* w1 = &(*f.find_worker_by_id(1));
+    auto* w2 = &(*f.find_worker_by_id(2));
+    auto* store = &(*f.find_storehouse_by_id(1));
+
+    ramp->receiver_preferences_.add_receiver(w1);
+    w1->receiver_preferences_.add_receiver(w2);
+    w2->receiver_preferences_.add_receiver(w1);
+    EXPECT_FALSE(f.is_consistent());
+
+    w2->receiver_preferences_.add_receiver(store);
+    EXPECT_TRUE(f.is_consistent());
+
+    f.remove_storehouse(1);
+    EXPECT_FALSE(f.is_consistent());
+    EXPECT_TRUE(w2->receiver_preferences_.get_preferences().size() == 1);
+}
+
+TEST(FactoryTest, InconsistencyNamesOffendingNode) {
+    Factory f;
+    f.add_ramp(Ramp(1, 1));
+    f.add_worker(Worker(7, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    f.find_ramp_by_id(1)->receiver_preferences_.add_receiver(&(*f.find_worker_by_id(7)));
+
+    EXPECT_FALSE(f.is_consistent());
+    EXPECT_EQ("worker #7 has no receivers", f.describe_inconsistency());
+}
+
+TEST(FactoryTest, ConsistencyOfDeepChainDoesNotRecurse) {
+    constexpr ElementID chain = 100000;
+    Factory f;
+    f.add_ramp(Ramp(1, 1));
+    for (ElementID id = 1; id <= chain; ++id) {
+        f.add_worker(Worker(id, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    }
+    f.add_storehouse(Storehouse(1));
+
+    f.find_ramp_by_id(1)->receiver_preferences_.add_receiver(&(*f.find_worker_by_id(1)));
+    for (ElementID id = 1; id < chain; ++id) {
+        f.find_worker_by_id(id)->receiver_preferences_.add_receiver(&(*f.find_worker_by_id(id + 1)));
+    }
+    EXPECT_FALSE(f.is_consistent());
+
+    f.find_worker_by_id(chain)->receiver_preferences_.add_receiver(&(*f.find_storehouse_by_id(1)));
+    EXPECT_TRUE(f.is_consistent());
+
+    f.remove_worker(chain / 2);
+    EXPECT_FALSE(f.is_consistent());
+}
+
+TEST(FactoryIOTest, ReportsUnknownLinkEndpoint) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "; komentarz\n"
+        "LINK src=ramp-1 dest=worker-5\n");
+    try {
+        load_factory_structure(iss);
+        FAIL() << "expected StructureParseError";
+    } catch (const StructureParseError& e) {
+        EXPECT_EQ(3u, e.line());
+        EXPECT_EQ(22u, e.column());
+    }
+}
+
+TEST(FactoryIOTest, LinkWeightRoundTripsExactly) {
+    Factory f;
+    f.add_ramp(Ramp(1, 1));
+    f.add_worker(Worker(1, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    f.add_worker(Worker(2, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    auto& prefs = f.find_ramp_by_id(1)->receiver_preferences_;
+    prefs.add_receiver(&*f.find_worker_by_id(1), 1.0 / 3.0);
+    prefs.add_receiver(&*f.find_worker_by_id(2), 2.5e-7);
+
+    std::ostringstream os;
+    save_factory_structure(f, os);
+    Factory copy = load_factory_structure(std::string_view(os.str()));
+    const auto& loaded = copy.find_ramp_by_id(1)->receiver_preferences_;
+    EXPECT_EQ(1.0 / 3.0, loaded.get_weight(&*copy.find_worker_by_id(1)));
+    EXPECT_EQ(2.5e-7, loaded.get_weight(&*copy.find_worker_by_id(2)));
+    EXPECT_NE(std::string::npos, os.str().find("weight=2.5e-07\n"));
+}
+
+TEST(FactoryIOTest, QueueCapacityRoundTrip) {
+    std::istringstream iss(
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO queue-capacity=3\n"
+        "STOREHOUSE id=1 queue-capacity=100\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=store-1\n");
+    Factory f = load_factory_structure(iss);
+    EXPECT_EQ(3u, f.find_worker_by_id(1)->get_queue()->capacity());
+    EXPECT_EQ(100u, f.find_storehouse_by_id(1)->get_queue()->capacity());
+
+    std::ostringstream os;
+    save_factory_structure(f, os);
+    EXPECT_NE(std::string::npos, os.str().find("queue-type=FIFO queue-capacity=3\n"));
+    EXPECT_NE(std::string::npos, os.str().find("STOREHOUSE id=1 queue-capacity=100\n"));
+
+    EXPECT_THROW(load_factory_structure(std::string_view("WORKER id=1 queue-capacity=0\n")), StructureParseError);
+}
+
+TEST(FactoryIOTest, StorehouseRetentionRoundTrip) {
+    Factory f = load_factory_structure(std::string_view(
+        "STOREHOUSE id=1 retention=window window-size=50\n"
+        "STOREHOUSE id=2 retention=count\n"
+        "STOREHOUSE id=3 retention=full\n"));
+    EXPECT_EQ(StorehouseRetention::WINDOW, f.find_storehouse_by_id(1)->get_retention());
+    EXPECT_EQ(50u, f.find_storehouse_by_id(1)->get_window_size());
+    EXPECT_EQ(StorehouseRetention::COUNT, f.find_storehouse_by_id(2)->get_retention());
+    EXPECT_EQ(StorehouseRetention::FULL, f.find_storehouse_by_id(3)->get_retention());
+
+    std::ostringstream os;
+    save_factory_structure(f, os);
+    EXPECT_NE(std::string::npos, os.str().find("STOREHOUSE id=1 retention=window window-size=50\n"));
+    EXPECT_NE(std::string::npos, os.str().find("STOREHOUSE id=2 retention=count\n"));
+    EXPECT_NE(std::string::npos, os.str().find("STOREHOUSE id=3\n"));
+
+    EXPECT_THROW(load_factory_structure(std::string_view("STOREHOUSE id=1 retention=window\n")), StructureParseError);
+    EXPECT_THROW(load_factory_structure(std::string_view("STOREHOUSE id=1 retention=some\n")), StructureParseError);
+}
+
+TEST(FactoryIOTest, AgeQueueTypeRoundTrip) {
+    Factory f = load_factory_structure(std::string_view("WORKER id=1 processing-time=2 queue-type=AGE\n"));
+    EXPECT_EQ(PackageQueueType::AGE, f.find_worker_by_id(1)->get_queue()->get_queue_type());
+
+    std::ostringstream os;
+    save_factory_structure(f, os);
+    EXPECT_NE(std::string::npos, os.str().find("WORKER id=1 processing-time=2 queue-type=AGE\n"));
+}
+
+TEST(FactoryIOTest, RampBatchSizeRoundTrip) {
+    Factory f = load_factory_structure(std::string_view(
+        "LOADING_RAMP id=1 delivery-interval=3 batch-size=16\n"
+        "LOADING_RAMP id=2 delivery-interval=1\n"));
+    EXPECT_EQ(16u, f.find_ramp_by_id(1)->get_batch_size());
+    EXPECT_EQ(1u, f.find_ramp_by_id(2)->get_batch_size());
+
+    std::ostringstream os;
+    save_factory_structure(f, os);
+    EXPECT_NE(std::string::npos, os.str().find("LOADING_RAMP id=1 delivery-interval=3 batch-size=16\n"));
+    EXPECT_NE(std::string::npos, os.str().find("LOADING_RAMP id=2 delivery-interval=1\n"));
+
+    EXPECT_THROW(load_factory_structure(std::string_view("LOADING_RAMP id=1 batch-size=0\n")), StructureParseError);
+}
+
+TEST(FactoryIOTest, ReportsMalformedNumber) {
+    try {
+        load_factory_structure(std::string_view("WORKER id=1 processing-time=2x\n"));
+        FAIL() << "expected StructureParseError";
+    } catch (const StructureParseError& e) {
+        EXPECT_EQ(1u, e.line());
+        EXPECT_EQ(29u, e.column());
+    }
+}
+
+TEST(FactoryIOTest, ReportsColumnOfInvalidValue) {
+    auto column_of = [](std::string_view text) -> std::size_t {
+        try {
+            load_factory_structure(text);
+        } catch (const StructureParseError& e) {
+            return e.column();
+        }
+        return 0;
+    };
+    EXPECT_EQ(37u, column_of("LOADING_RAMP id=1 delivery-interval=0\n"));
+    EXPECT_EQ(29u, column_of("WORKER id=1 processing-time=-2\n"));
+
+    std::string nodes = "LOADING_RAMP id=1\nWORKER id=1\n";
+    EXPECT_EQ(38u, column_of(nodes + "LINK src=ramp-1 dest=worker-1 weight=inf\n"));
+    EXPECT_EQ(38u, column_of(nodes + "LINK src=ramp-1 dest=worker-1 weight=nan\n"));
+    EXPECT_EQ(1u, column_of(nodes + "LINK src=ramp-1\n"));
+    EXPECT_EQ(17u, column_of(nodes + "LINK src=ramp-1 dest=\n"));
+}
+
+TEST(FactoryIOTest, LoadsMappedFile) {
+    std::string path = testing::TempDir() + "netsim_structure.txt";
+    {
+        std::ofstream out(path);
+        out << "LOADING_RAMP id=1 delivery-interval=2\nSTOREHOUSE id=4\nLINK src=ramp-1 dest=store-4\n";
+    }
+    Factory f = load_factory_structure_file(path);
+    std::remove(path.c_str());
+
+    EXPECT_TRUE(f.is_consistent());
+    EXPECT_EQ(2, f.find_ramp_by_id(1)->get_delivery_interval());
+}
@@ -0,0 +1,70 @@
+#include "gtest/gtest.h"
+#include "helpers.hxx"
+#include "layout.hxx"
+#include "package_id_allocator.hxx"
+#include "reports.hxx"
+#include "simulation.hxx"
+#include "topology_generator.hxx"
+#include <sstream>
+
+namespace {
+
+std::string run_report(const TopologySpec& spec, bool optimize, bool counter_rng = false) {
+    PackageIdAllocator ids;
+    PackageIdAllocator::Scope scope(ids);
+    Factory f = generate_topology(spec);
+    if (counter_rng) {
+        f.enable_counter_rng(42);
+    }
+    rng.seed(42);
+    if (optimize) {
+        optimize_layout(f);
+    }
+    std::ostringstream report;
+    simulate(f, 40, [&report](Factory& factory, Time t) {
+        generate_simulation_turn_report(factory, report, t);
+    });
+    return report.str();
+}
+
+}
+
+TEST(LayoutTest, FollowsFlowAndKeepsDeclarationOrder) {
+    Factory f = generate_topology({TopologyShape::LAYERED, 64, 4, 1, 2, 7});
+    std::ostringstream before;
+    save_factory_structure(f, before);
+
+    std::vector<ElementID> order = locality_order(f);
+    // Warstwy generatora: robotnicy 1-4, potem 5-8, ...
+    ASSERT_EQ(64u, order.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        EXPECT_EQ(i / 4, static_cast<std::size_t>(order[i] - 1) / 4) << i;
+    }
+
+    optimize_layout(f);
+    std::vector<ElementID> processing;
+    for (const auto& worker : f.worker_collection()) {
+        processing.push_back(worker.get_id());
+    }
+    EXPECT_EQ(order, processing);
+    EXPECT_TRUE(f.is_consistent()) << f.describe_inconsistency();
+
+    std::ostringstream after;
+    save_factory_structure(f, after);
+    EXPECT_EQ(before.str(), after.str());
+
+    EXPECT_THROW(f.relayout_workers({1, 2, 3}), std::invalid_argument);
+}
+
+TEST(LayoutTest, ChainSimulatesIdentically) {
+    TopologySpec spec{TopologyShape::CHAIN, 50, 1, 1, 2, 11};
+    EXPECT_EQ(run_report(spec, false), run_report(spec, true));
+}
+
+// Warstwy z rozgalezieniami i przemieszana deklaracja: kazdy nadawca losuje,
+// a uklad w pamieci rozni sie od kolejnosci deklaracji.
+TEST(LayoutTest, LayeredSimulatesIdentically) {
+    TopologySpec spec{TopologyShape::LAYERED, 64, 4, 1, 2, 7};
+    EXPECT_EQ(run_report(spec, false), run_report(spec, true));
+    EXPECT_EQ(run_report(spec, false, true), run_report(spec, true, true));
+}
@@ -0,0 +1,145 @@
+#include "gtest/gtest.h"
+#include "factory.hxx"
+#include "flat_factory.hxx"
+#include "metrics.hxx"
+#include "reports.hxx"
+#include "simulation.hxx"
+#include <sstream>
+
+TEST(MetricsTest, HistogramPercentiles) {
+    LatencyHistogram h;
+    for (std::uint64_t v = 1; v <= 1000; ++v) {
+        h.record(v);
+    }
+    EXPECT_EQ(1000u, h.count());
+    EXPECT_EQ(1u, h.min());
+    EXPECT_EQ(1000u, h.max());
+    EXPECT_DOUBLE_EQ(500.5, h.mean());
+    EXPECT_NEAR(500.0, static_cast<double>(h.percentile(50)), 500 * 0.07);
+    EXPECT_NEAR(990.0, static_cast<double>(h.percentile(99)), 990 * 0.07);
+    EXPECT_EQ(1000u, h.percentile(100));
+}
+
+TEST(MetricsTest, CountersAndExport) {
+    if (!metrics_enabled) {
+        GTEST_SKIP() << "built without NETSIM_METRICS";
+    }
+    Factory f;
+    f.add_ramp(Ramp(1, 1));
+    f.add_worker(Worker(1, 2, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    f.add_storehouse(Storehouse(1));
+    f.find_ramp_by_id(1)->receiver_preferences_.add_receiver(&*f.find_worker_by_id(1));
+    f.find_worker_by_id(1)->receiver_preferences_.add_receiver(&*f.find_storehouse_by_id(1));
+
+    simulate(f, 10, [](Factory&, Time) {});
+
+    const Ramp& r = *f.find_ramp_by_id(1);
+    const Worker& w = *f.find_worker_by_id(1);
+    const Storehouse& s = *f.find_storehouse_by_id(1);
+    EXPECT_EQ(10u, r.get_metrics().delivered);
+    EXPECT_EQ(10u, r.receiver_preferences_.get_traffic(&w));
+    EXPECT_EQ(5u, w.get_metrics().processed);
+    EXPECT_EQ(10u, w.get_metrics().busy_turns);
+    EXPECT_EQ(s.get_queue()->size(), s.get_metrics().received);
+    EXPECT_EQ(f.metrics().latency.count(), s.get_metrics().received);
+    // Tury narodzin pamietane sa tylko dla polproduktow, ktore nie dotarly do magazynu.
+    EXPECT_EQ(r.get_metrics().delivered - s.get_metrics().received, f.metrics().birth_turn.size());
+    EXPECT_EQ(10, f.metrics().last_turn);
+
+    std::ostringstream json;
+    generate_metrics_report(f, json, MetricsFormat::JSON);
+    EXPECT_NE(std::string::npos, json.str().find("\"delivered\": 10"));
+
+    std::ostringstream prom;
+    generate_metrics_report(f, prom, MetricsFormat::PROMETHEUS);
+    EXPECT_NE(std::string::npos, prom.str().find("netsim_link_packages_total{src=\"ramp-1\",dest=\"worker-1\"} 10"));
+}
+
+TEST(MetricsTest, TrafficCountsOnlyAcceptedPackages) {
+    if (!metrics_enabled) {
+        GTEST_SKIP() << "built without NETSIM_METRICS";
+    }
+    // Magazyn na jeden polprodukt i robotnik z kolejka na dwa: nadawcy sa
+    // wiekszosc tur zablokowani, a kazda ponowna proba to nowe losowanie.
+    constexpr std::string_view structure =
+        "LOADING_RAMP id=1 delivery-interval=1 batch-size=4\n"
+        "WORKER id=1 processing-time=1 queue-type=FIFO queue-capacity=2\n"
+        "STOREHOUSE id=1 queue-capacity=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=worker-1 dest=store-1\n";
+    auto check = [](void (*run)(Factory&)) {
+        Factory f = load_factory_structure(structure);
+        run(f);
+        const Ramp& r = *f.find_ramp_by_id(1);
+        const Worker& w = *f.find_worker_by_id(1);
+        const Storehouse& s = *f.find_storehouse_by_id(1);
+        EXPECT_EQ(1u, s.get_metrics().received);
+        EXPECT_LT(0u, w.get_blocked_turns());
+        EXPECT_EQ(s.get_metrics().received, w.receiver_preferences_.get_traffic(&s));
+        // processed obejmuje tez polprodukty z bufora wysylki i magazynu.
+        EXPECT_EQ(w.get_metrics().processed + w.get_queue()->size() + (w.get_processing_buffer() ? 1u : 0u),
+                  r.receiver_preferences_.get_traffic(&w));
+    };
+    check([](Factory& f) { simulate(f, 10, [](Factory&, Time) {}); });
+    check([](Factory& f) { simulate_parallel(f, 10, [](Factory&, Time) {}, 2); });
+    check([](Factory& f) { simulate_event_driven(f, 10, [](Factory&, Time) {}); });
+}
+
+TEST(MetricsTest, FlatEngineMatchesSerial) {
+    if (!metrics_enabled) {
+        GTEST_SKIP() << "built without NETSIM_METRICS";
+    }
+    constexpr std::string_view structure =
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "LOADING_RAMP id=2 delivery-interval=2\n"
+        "WORKER id=1 processing-time=2 queue-type=FIFO queue-capacity=3\n"
+        "WORKER id=2 processing-time=3 queue-type=LIFO\n"
+        "WORKER id=3 processing-time=1 queue-type=AGE queue-capacity=2\n"
+        "STOREHOUSE id=1 queue-capacity=5\n"
+        "STOREHOUSE id=2\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=ramp-1 dest=worker-2 weight=2\n"
+        "LINK src=ramp-2 dest=worker-3\n"
+        "LINK src=worker-1 dest=worker-3\n"
+        "LINK src=worker-1 dest=store-1\n"
+        "LINK src=worker-2 dest=store-2\n"
+        "LINK src=worker-3 dest=store-1\n"
+        "LINK src=worker-3 dest=store-2\n";
+    auto run = [&](bool flat) {
+        Factory f = load_factory_structure(structure);
+        f.enable_counter_rng(5);
+        if (flat) {
+            simulate_flat(f, 30, [](Factory&, Time) {}, [](Time t) { return t % 7 == 0; });
+        } else {
+            simulate(f, 30, [](Factory&, Time) {});
+        }
+        return f;
+    };
+    Factory serial = run(false);
+    Factory flat = run(true);
+
+    for (auto it = serial.ramp_cbegin(); it != serial.ramp_cend(); ++it) {
+        const Ramp& other = *flat.find_ramp_by_id(it->get_id());
+        EXPECT_EQ(it->get_metrics().delivered, other.get_metrics().delivered);
+        for (const auto& [receiver, p] : it->receiver_preferences_) {
+            const IPackageReceiver* peer = &*flat.find_worker_by_id(receiver->get_id());
+            EXPECT_EQ(it->receiver_preferences_.get_traffic(receiver), other.receiver_preferences_.get_traffic(peer));
+        }
+    }
+    for (auto it = serial.worker_cbegin(); it != serial.worker_cend(); ++it) {
+        const Worker& other = *flat.find_worker_by_id(it->get_id());
+        EXPECT_EQ(it->get_metrics().processed, other.get_metrics().processed) << it->get_id();
+        EXPECT_EQ(it->get_metrics().busy_turns, other.get_metrics().busy_turns) << it->get_id();
+        EXPECT_EQ(it->get_metrics().queue_high_water, other.get_metrics().queue_high_water) << it->get_id();
+        for (const auto& [receiver, p] : it->receiver_preferences_) {
+            const IPackageReceiver* peer = receiver->get_receiver_type() == ReceiverType::WORKER
+                                               ? static_cast<const IPackageReceiver*>(&*flat.find_worker_by_id(receiver->get_id()))
+                                               : &*flat.find_storehouse_by_id(receiver->get_id());
+            EXPECT_EQ(it->receiver_preferences_.get_traffic(receiver), other.receiver_preferences_.get_traffic(peer));
+        }
+    }
+    EXPECT_EQ(serial.metrics().latency.count(), flat.metrics().latency.count());
+    EXPECT_EQ(serial.metrics().latency.sum(), flat.metrics().latency.sum());
+    EXPECT_EQ(serial.metrics().birth_turn.size(), flat.metrics().birth_turn.size());
+    EXPECT_EQ(30, flat.metrics().last_turn);
+}
@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "nodes.hxx"
+#include "package_id_allocator.hxx"
 
 TEST(WorkerTest, ProcessingLogic) {
     TimeOffset processing_duration = 2;
@@ -16,4 +17,154 @@ TEST(WorkerTest, ProcessingLogic) {
     EXPECT_FALSE(w.get_processing_buffer().has_value());
     ASSERT_TRUE(w.get_sending_buffer().has_value());
     EXPECT_EQ(w.get_sending_buffer()->get_id(), 1);
-}
\ No newline at end of file
+}
+TEST(ReceiverPreferencesTest, WeightedChoice) {
+    double draw = 0.0;
+    ReceiverPreferences prefs([&draw]() { return draw; });
+    Storehouse s1(1);
+    Storehouse s2(2);
+    prefs.add_receiver(&s1, 1.0);
+    prefs.add_receiver(&s2, 3.0);
+
+    ASSERT_EQ(2u, prefs.get_preferences().size());
+    EXPECT_DOUBLE_EQ(0.25, prefs.get_preferences()[0].second);
+    EXPECT_DOUBLE_EQ(0.75, prefs.get_preferences()[1].second);
+
+    draw = 0.2;
+    EXPECT_EQ(&s1, prefs.choose_receiver());
+    draw = 0.3;
+    EXPECT_EQ(&s2, prefs.choose_receiver());
+
+    prefs.remove_receiver(&s2);
+    EXPECT_EQ(&s1, prefs.choose_receiver());
+}
+
+TEST(WorkerTest, FullReceiverBlocksSender) {
+    Worker upstream(1, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO));
+    Worker downstream(2, 5, std::make_unique<PackageQueue>(PackageQueueType::FIFO, 1));
+    upstream.receiver_preferences_.add_receiver(&downstream);
+
+    downstream.receive_package(Package(10));
+    EXPECT_FALSE(downstream.can_receive_package());
+
+    upstream.get_sending_buffer().emplace(11);
+    EXPECT_EQ(nullptr, upstream.send_package());
+    ASSERT_TRUE(upstream.get_sending_buffer().has_value());
+    EXPECT_EQ(1u, upstream.get_blocked_turns());
+
+    // Zajety bufor wysylkowy wstrzymuje zakonczenie przetwarzania.
+    upstream.receive_package(Package(12));
+    upstream.do_work(1);
+    EXPECT_TRUE(upstream.get_processing_buffer().has_value());
+    EXPECT_EQ(11, upstream.get_sending_buffer()->get_id());
+
+    downstream.do_work(1);
+    EXPECT_EQ(&downstream, upstream.send_package());
+    upstream.do_work(2);
+    EXPECT_EQ(12, upstream.get_sending_buffer()->get_id());
+}
+
+TEST(RampTest, BatchSplitsAcrossReceiversAndKeepsOverflow) {
+    Ramp ramp(1, 2, 6);
+    Worker worker(1, 1, std::make_unique<PackageQueue>(PackageQueueType::FIFO, 2));
+    Storehouse store(1);
+    ramp.receiver_preferences_ = ReceiverPreferences([]() { return 0.5; });
+    ramp.receiver_preferences_.add_receiver(&worker);
+    ramp.receiver_preferences_.add_receiver(&store);
+
+    ramp.deliver_goods(1);
+    ASSERT_EQ(6u, ramp.get_batch().size());
+    EXPECT_EQ(1, ramp.get_batch().back().get_creation_time());
+    EXPECT_FALSE(ramp.get_sending_buffer().has_value());
+
+    // Po 3 polprodukty na odbiorce; robotnik miesci tylko 2.
+    ramp.send_batch(1);
+    EXPECT_EQ(2u, worker.get_queue()->size());
+    EXPECT_EQ(3u, store.get_queue()->size());
+    EXPECT_EQ(1u, ramp.get_batch().size());
+    EXPECT_EQ(1u, ramp.get_blocked_turns());
+
+    // Nowa partia nie powstaje, dopoki stara nie zostanie wyslana.
+    ramp.deliver_goods(3);
+    EXPECT_EQ(1u, ramp.get_batch().size());
+
+    ReceiverPreferences prefs;
+    prefs.add_receiver(&worker, 1.0);
+    prefs.add_receiver(&store, 3.0);
+    std::vector<std::size_t> counts;
+    prefs.choose_receivers(100000, 1, counts);
+    ASSERT_EQ(2u, counts.size());
+    EXPECT_EQ(100000u, counts[0] + counts[1]);
+    EXPECT_NEAR(25000.0, static_cast<double>(counts[0]), 1000.0);
+
+    EXPECT_THROW(Ramp(2, 1, 0), std::invalid_argument);
+
+    Ramp single(3, 2);
+    single.deliver_goods(5);
+    ASSERT_TRUE(single.get_sending_buffer().has_value());
+    EXPECT_EQ(5, single.get_sending_buffer()->get_creation_time());
+}
+
+TEST(ReceiverPreferencesTest, CounterRngDependsOnlyOnTurnAndStream) {
+    std::vector<Storehouse> stores;
+    for (ElementID id = 1; id <= 8; ++id) {
+        stores.emplace_back(id);
+    }
+    auto make = [&](std::uint64_t stream) {
+        ReceiverPreferences prefs([]() -> double { throw std::logic_error("shared generator used"); });
+        for (auto& s : stores) prefs.add_receiver(&s);
+        prefs.set_counter_rng(CounterRng(42), stream);
+        return prefs;
+    };
+
+    ReceiverPreferences a = make(7);
+    ReceiverPreferences b = make(7);
+    ReceiverPreferences other = make(8);
+    std::vector<IPackageReceiver*> forward;
+    std::vector<IPackageReceiver*> backward(64);
+    bool differs = false;
+    for (Time t = 1; t <= 64; ++t) {
+        forward.push_back(a.choose_receiver(t));
+        differs |= other.choose_receiver(t) != forward.back();
+    }
+    for (Time t = 64; t >= 1; --t) {
+        backward[static_cast<std::size_t>(t - 1)] = b.choose_receiver(t);
+    }
+    EXPECT_EQ(forward, backward);
+    EXPECT_TRUE(differs);
+
+    // Kolejne losowanie w tej samej turze ma nowy numer.
+    ReceiverPreferences c = make(7);
+    EXPECT_EQ(forward[4], c.choose_receiver(5));
+    auto second = static_cast<std::size_t>(CounterRng(42).canonical(5, 7, 1) * 8);
+    EXPECT_EQ(&stores[second], c.choose_receiver(5));
+}
+
+TEST(StorehouseTest, RetentionModes) {
+    PackageIdAllocator ids;
+    PackageIdAllocator::Scope scope(ids);
+
+    Storehouse window(1);
+    window.set_retention(StorehouseRetention::WINDOW, 2);
+    for (Time t = 1; t <= 3; ++t) {
+        window.receive_package(Package(), t);
+    }
+    ASSERT_EQ(2u, window.get_queue()->size());
+    EXPECT_EQ(2, window.get_queue()->begin()->get_id());
+    // ID najstarszego polproduktu wrocilo do puli.
+    EXPECT_EQ(1, Package().get_id());
+
+    Storehouse counter(2);
+    counter.set_retention(StorehouseRetention::COUNT);
+    counter.receive_package(Package(), 4);
+    counter.receive_package(Package(), 4);
+    counter.receive_package(Package(), 9);
+    EXPECT_TRUE(counter.get_queue()->empty());
+    const StorehouseStats& stats = counter.get_stats();
+    EXPECT_EQ(3u, stats.received);
+    EXPECT_EQ(4, stats.first_arrival);
+    EXPECT_EQ(9, stats.last_arrival);
+    EXPECT_EQ(2u, stats.arrival_turns);
+
+    EXPECT_THROW(counter.set_retention(StorehouseRetention::WINDOW), std::invalid_argument);
+}
@@ -1,6 +1,10 @@
 #include "gtest/gtest.h"
 #include "package.hxx"
 #include "storage_types.hxx"
+#include "package_id_allocator.hxx"
+#include <set>
+#include <thread>
+#include <vector>
 
 TEST(PackageTest, IsIdUnique) {
     Package p1;
@@ -30,4 +34,101 @@ TEST(PackageQueueTest, LifoOrder) {
 
     auto p2 = queue.pop();
     EXPECT_EQ(p2->get_id(), 1);
-}
\ No newline at end of file
+}
+TEST(PackageQueueTest, AgePriorityPopsOldestFirst) {
+    PackageQueue queue(PackageQueueType::AGE);
+    // Wiek to tura powstania, nie ID - ID moga byc ponownie wydawane.
+    const std::pair<ElementID, Time> packages[] = {{1, 5}, {2, 2}, {3, 9}, {4, 2}, {5, 7}};
+    for (const auto& [id, created] : packages) {
+        queue.push(Package(id, created));
+    }
+    // Iteracja tez idzie od najstarszego; rowne tury w kolejnosci przybycia.
+    std::vector<ElementID> ids;
+    for (const auto& p : queue) {
+        ids.push_back(p.get_id());
+    }
+    EXPECT_EQ((std::vector<ElementID>{2, 4, 1, 5, 3}), ids);
+
+    EXPECT_EQ(2, queue.pop()->get_id());
+    queue.push(Package(6, 3));
+    EXPECT_EQ(4, queue.pop()->get_id());
+    EXPECT_EQ(6, queue.pop()->get_id());
+    EXPECT_EQ(PackageQueueType::AGE, queue.get_queue_type());
+
+    AgePriorityQueue basic(2);
+    basic.push(Package(10, 4));
+    basic.push(Package(11, 3));
+    EXPECT_TRUE(basic.full());
+    EXPECT_EQ(11, basic.pop()->get_id());
+}
+
+TEST(PackageIdAllocatorTest, SmallestFreeReusesLowestId) {
+    PackageIdAllocator a(IdAllocationMode::SMALLEST_FREE);
+    EXPECT_EQ(1, a.allocate());
+    EXPECT_EQ(2, a.allocate());
+    EXPECT_EQ(3, a.allocate());
+    a.release(3);
+    a.release(2);
+    EXPECT_EQ(2, a.allocate());
+    EXPECT_EQ(3, a.allocate());
+    EXPECT_EQ(4, a.allocate());
+}
+
+TEST(PackageIdAllocatorTest, MonotonicNeverReuses) {
+    PackageIdAllocator a(IdAllocationMode::MONOTONIC);
+    a.reserve(10);
+    ElementID id = a.allocate();
+    EXPECT_EQ(11, id);
+    a.release(id);
+    EXPECT_EQ(12, a.allocate());
+}
+
+TEST(PackageIdAllocatorTest, PooledIdsStayUniqueAcrossThreads) {
+    PackageIdAllocator a(IdAllocationMode::POOLED);
+    constexpr int per_thread = 5000;
+    std::vector<std::vector<ElementID>> held(4);
+    std::vector<std::thread> threads;
+    for (auto& ids : held) {
+        threads.emplace_back([&a, &ids] {
+            for (int i = 0; i < per_thread; ++i) {
+                ids.push_back(a.allocate());
+                if (i % 3 == 0) {
+                    a.release(ids.back());
+                    ids.pop_back();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::set<ElementID> unique;
+    std::size_t total = 0;
+    for (const auto& ids : held) {
+        unique.insert(ids.begin(), ids.end());
+        total += ids.size();
+    }
+    EXPECT_EQ(total, unique.size());
+}
+
+TEST(PackageQueueTest, FifoWrapsAroundRing) {
+    PackageQueue queue(PackageQueueType::FIFO);
+    ElementID next_in = 100;
+    ElementID next_out = 100;
+    for (int round = 0; round < 50; ++round) {
+        for (int i = 0; i < 5; ++i) {
+            queue.push(Package(next_in++));
+        }
+        for (int i = 0; i < 3; ++i) {
+            EXPECT_EQ(next_out++, queue.pop()->get_id());
+        }
+    }
+
+    ASSERT_EQ(100u, queue.size());
+    ElementID expected = next_out;
+    for (const auto& p : queue) {
+        EXPECT_EQ(expected++, p.get_id());
+    }
+    EXPECT_EQ(100, queue.cend() - queue.cbegin());
+}
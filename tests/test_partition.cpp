@@ -0,0 +1,29 @@
+#include "gtest/gtest.h"
+#include "partition.hxx"
+#include "topology_generator.hxx"
+#include <algorithm>
+
+TEST(PartitionTest, ChainIsCutIntoContiguousParts) {
+    Factory f = generate_topology({TopologyShape::CHAIN, 40, 1});
+    FactoryPartition partition = partition_factory(f, 4);
+
+    ASSERT_EQ(40u, partition.worker_part.size());
+    std::vector<std::size_t> sizes(4, 0);
+    for (std::size_t part : partition.worker_part) {
+        ASSERT_LT(part, 4u);
+        ++sizes[part];
+    }
+    for (std::size_t part : partition.storehouse_part) ++sizes[part];
+    EXPECT_LE(*std::max_element(sizes.begin(), sizes.end()) - *std::min_element(sizes.begin(), sizes.end()), 2u);
+    EXPECT_EQ(3u, partition.cut);
+    ASSERT_EQ(1u, partition.ramp_part.size());
+    EXPECT_EQ(partition.worker_part[0], partition.ramp_part[0]);
+}
+
+TEST(PartitionTest, SinglePartHasNoCut) {
+    Factory f = generate_topology({TopologyShape::LAYERED, 200, 10});
+    FactoryPartition partition = partition_factory(f, 1);
+    EXPECT_EQ(0u, partition.cut);
+    EXPECT_TRUE(std::all_of(partition.worker_part.begin(), partition.worker_part.end(),
+                            [](std::size_t part) { return part == 0; }));
+}
@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+#include "replication.hxx"
+#include "package.hxx"
+#include "package_id_allocator.hxx"
+#include "topology_generator.hxx"
+#include <optional>
+
+TEST(ReplicationTest, EstimateMean) {
+    Estimate e = estimate_mean({1.0, 2.0, 3.0, 4.0});
+    EXPECT_DOUBLE_EQ(2.5, e.mean);
+    EXPECT_NEAR(1.290994, e.stddev, 1e-6);
+    EXPECT_NEAR(2.5 - 3.182 * e.stddev / 2.0, e.ci_low, 1e-9);
+    EXPECT_NEAR(2.5 + 3.182 * e.stddev / 2.0, e.ci_high, 1e-9);
+}
+
+TEST(ReplicationTest, IndependentOfThreadCount) {
+    Factory f = generate_topology({TopologyShape::LAYERED, 40, 4, 1, 2});
+    ReplicationOptions options;
+    options.replicas = 16;
+    options.rounds = 50;
+    options.threads = 1;
+    ReplicationSummary serial = run_replications(f, options);
+    options.threads = 4;
+    ReplicationSummary parallel = run_replications(f, options);
+
+    ASSERT_EQ(16u, serial.replicas.size());
+    bool varied = false;
+    for (std::size_t i = 0; i < serial.replicas.size(); ++i) {
+        EXPECT_EQ(serial.replicas[i].seed, parallel.replicas[i].seed);
+        EXPECT_EQ(serial.replicas[i].stored, parallel.replicas[i].stored);
+        EXPECT_DOUBLE_EQ(serial.replicas[i].mean_queue_length, parallel.replicas[i].mean_queue_length);
+        varied = varied || serial.replicas[i].mean_queue_length != serial.replicas[0].mean_queue_length;
+    }
+    EXPECT_TRUE(varied);
+    EXPECT_LE(serial.mean_queue_length.ci_low, serial.mean_queue_length.mean);
+    EXPECT_GE(serial.mean_queue_length.ci_high, serial.mean_queue_length.mean);
+
+    // Replikacje przejmuja generator licznikowy zrodla.
+    f.enable_counter_rng(7);
+    ReplicationSummary counter = run_replications(f, options);
+    options.threads = 1;
+    ReplicationSummary counter_serial = run_replications(f, options);
+    bool differs = false;
+    for (std::size_t i = 0; i < counter.replicas.size(); ++i) {
+        EXPECT_EQ(counter_serial.replicas[i].stored, counter.replicas[i].stored);
+        EXPECT_DOUBLE_EQ(counter_serial.replicas[i].mean_queue_length, counter.replicas[i].mean_queue_length);
+        differs = differs || counter.replicas[i].mean_queue_length != serial.replicas[i].mean_queue_length;
+    }
+    EXPECT_TRUE(differs);
+}
+
+TEST(ReplicationTest, CountsStoredPackagesForEveryRetention) {
+    auto run = [](const char* retention) {
+        std::string structure = std::string(
+            "LOADING_RAMP id=1 delivery-interval=1\n"
+            "WORKER id=1 processing-time=1\n"
+            "WORKER id=2 processing-time=2\n"
+            "STOREHOUSE id=1 ") + retention + "\n"
+            "LINK src=ramp-1 dest=worker-1\n"
+            "LINK src=ramp-1 dest=worker-2\n"
+            "LINK src=worker-1 dest=store-1\n"
+            "LINK src=worker-2 dest=store-1\n";
+        ReplicationOptions options;
+        options.replicas = 4;
+        options.rounds = 40;
+        options.threads = 2;
+        return run_replications(load_factory_structure(std::string_view(structure)), options);
+    };
+    ReplicationSummary full = run("retention=full");
+    ReplicationSummary count = run("retention=count");
+    ReplicationSummary window = run("retention=window window-size=2");
+    for (std::size_t i = 0; i < full.replicas.size(); ++i) {
+        EXPECT_GT(full.replicas[i].stored, 2u);
+        EXPECT_EQ(full.replicas[i].stored, count.replicas[i].stored);
+        EXPECT_EQ(full.replicas[i].stored, window.replicas[i].stored);
+    }
+    EXPECT_DOUBLE_EQ(full.throughput.mean, count.throughput.mean);
+}
+
+TEST(ReplicationTest, AllocatorScopeIsolatesIds) {
+    PackageIdAllocator local;
+    ElementID outer = PackageIdAllocator::current().allocate();
+    {
+        PackageIdAllocator::Scope scope(local);
+        Package p;
+        EXPECT_EQ(1, p.get_id());
+    }
+    EXPECT_EQ(&PackageIdAllocator::global(), &PackageIdAllocator::current());
+    PackageIdAllocator::current().release(outer);
+}
+
+TEST(ReplicationTest, PackageReturnsIdToIssuingAllocator) {
+    PackageIdAllocator local;
+    std::optional<Package> p;
+    {
+        PackageIdAllocator::Scope scope(local);
+        p.emplace();
+    }
+    EXPECT_EQ(1, p->get_id());
+    p.reset();
+    // ID wrocilo do puli lokalnej, choc polprodukt zginal poza jej zasiegiem.
+    EXPECT_EQ(1, local.allocate());
+}
@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+#include "factory.hxx"
+#include "reports.hxx"
+#include "async_reports.hxx"
+#include <sstream>
+
+namespace {
+
+Factory small_factory() {
+    Factory f;
+    f.add_worker(Worker(1, 3, std::make_unique<PackageQueue>(PackageQueueType::FIFO)));
+    f.add_storehouse(Storehouse(1));
+    f.add_storehouse(Storehouse(2));
+
+    Worker& w = *f.find_worker_by_id(1);
+    w.receive_package(Package(11));
+    w.receive_package(Package(12));
+    w.do_work(1);
+    f.find_storehouse_by_id(1)->receive_package(Package(21));
+    return f;
+}
+
+}
+
+TEST(ReportsTest, TextTurnReport) {
+    Factory f = small_factory();
+    std::ostringstream os;
+    generate_simulation_turn_report(f, os, 2);
+
+    EXPECT_EQ("=== [ Turn: 2 ] ===\n"
+              "WORKERS_BLUEPRINT\n"
+              "WORKER #1\n"
+              "  PBuffer: #11 (pt = 2)\n"
+              "  Queue: #12 \n"
+              "STOREHOUSES_BLUEPRINT\n"
+              "STOREHOUSE #1\n"
+              "  Stock: #21 \n"
+              "STOREHOUSE #2\n"
+              "  Stock: (empty)\n"
+              "\n", os.str());
+}
+
+TEST(ReportsTest, CsvDeltaEmitsOnlyChanges) {
+    Factory f = small_factory();
+    std::ostringstream os;
+    {
+        TurnReportWriter writer(os, ReportFormat::CSV, true);
+        writer.write(f, 1);
+        f.find_storehouse_by_id(1)->receive_package(Package(22));
+        writer.write(f, 1);
+    }
+
+    EXPECT_EQ("turn,kind,id,pbuffer,pt,packages\n"
+              "1,worker,1,11,1,12\n"
+              "1,storehouse,1,,,21\n"
+              "1,storehouse,2,,,\n"
+              "1,storehouse+,1,,,22\n", os.str());
+}
+
+TEST(ReportsTest, CaptureWithCursorRecordsOnlyStockChanges) {
+    Factory f = small_factory();
+    Storehouse& store = *f.find_storehouse_by_id(1);
+    store.set_retention(StorehouseRetention::WINDOW, 2);
+    StockCursor cursor;
+    TurnState state;
+    state.capture(f, 1, cursor);
+    ASSERT_EQ(2u, state.storehouses.size());
+    EXPECT_TRUE(state.storehouses[0].complete);
+
+    store.receive_package(Package(22));
+    store.receive_package(Package(23));
+    state.capture(f, 2, cursor);
+    const auto& s = state.storehouses[0];
+    EXPECT_FALSE(s.complete);
+    EXPECT_EQ(1u, s.dropped);
+    EXPECT_EQ((std::vector<ElementID>{22, 23}),
+              std::vector<ElementID>(state.packages.begin() + s.stock_begin, state.packages.begin() + s.stock_end));
+    EXPECT_EQ(state.storehouses[1].stock_begin, state.storehouses[1].stock_end);
+
+    // Ubytek z poczatku kolejki bez nowych przyjec to tez przyrost.
+    store.get_queue()->pop();
+    state.capture(f, 3, cursor);
+    EXPECT_FALSE(state.storehouses[0].complete);
+    EXPECT_EQ(1u, state.storehouses[0].dropped);
+    EXPECT_EQ(state.storehouses[0].stock_begin, state.storehouses[0].stock_end);
+
+    // Nowy kursor nie zna poprzedniej tury - caly zapas.
+    StockCursor fresh;
+    state.capture(f, 4, fresh);
+    EXPECT_TRUE(state.storehouses[0].complete);
+    EXPECT_EQ(1u, state.storehouses[0].stock_end - state.storehouses[0].stock_begin);
+}
+
+TEST(ReportsTest, AsyncReporterMatchesSynchronousReports) {
+    Factory f = small_factory();
+    std::ostringstream expected;
+    for (Time t = 1; t <= 20; t += 3) {
+        generate_simulation_turn_report(f, expected, t);
+    }
+
+    std::ostringstream os;
+    {
+        AsyncTurnReporter reporter(os);
+        IntervalReportNotifier notifier(3);
+        auto rf = reporter.callback(notifier);
+        for (Time t = 1; t <= 20; ++t) {
+            rf(f, t);
+        }
+        reporter.flush();
+        EXPECT_EQ(expected.str(), os.str());
+    }
+}
@@ -0,0 +1,415 @@
+#include "gtest/gtest.h"
+#include "factory.hxx"
+#include "helpers.hxx"
+#include "reports.hxx"
+#include "simulation.hxx"
+#include "flat_factory.hxx"
+#include "distributed.hxx"
+#include "package_id_allocator.hxx"
+#include <sstream>
+
+namespace {
+
+constexpr int workers = 1200;
+
+std::string layered_structure(int delivery_interval = 1, int capacity = 0) {
+    std::ostringstream os;
+    os << "LOADING_RAMP id=1 delivery-interval=" << delivery_interval << "\n";
+    os << "LOADING_RAMP id=2 delivery-interval=" << 2 * delivery_interval << "\n";
+    for (int id = 1; id <= workers; ++id) {
+        os << "WORKER id=" << id << " processing-time=" << (id % 3 + 1)
+           << " queue-type=" << (id % 2 ? "FIFO" : "LIFO");
+        if (capacity > 0) {
+            os << " queue-capacity=" << capacity;
+        }
+        os << "\n";
+    }
+    os << "STOREHOUSE id=1\nSTOREHOUSE id=2\n";
+    for (int r = 1; r <= 2; ++r) {
+        for (int id = 1; id <= 4; ++id) {
+            os << "LINK src=ramp-" << r << " dest=worker-" << id << "\n";
+        }
+    }
+    for (int id = 1; id <= workers; ++id) {
+        if (id > workers - 4) {
+            os << "LINK src=worker-" << id << " dest=store-" << (id % 2 + 1) << "\n";
+        } else {
+            os << "LINK src=worker-" << id << " dest=worker-" << (id + 4) << "\n";
+            os << "LINK src=worker-" << id << " dest=worker-" << ((id + 2) % (workers - 4) + 5) << "\n";
+        }
+    }
+    return os.str();
+}
+
+template <typename Simulate>
+std::string run_and_report(Simulate simulate_fn, int delivery_interval = 1, int capacity = 0) {
+    std::istringstream iss(layered_structure(delivery_interval, capacity));
+    Factory f = load_factory_structure(iss);
+    std::ostringstream report;
+    rng.seed(2024);
+    simulate_fn(f, 30, [&report](Factory& factory, Time t) {
+        generate_simulation_turn_report(factory, report, t);
+    });
+    return report.str();
+}
+
+}
+
+TEST(SimulationTest, ParallelMatchesSerial) {
+    std::string serial = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate(f, rounds, rf);
+    });
+    std::string parallel = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_parallel(f, rounds, rf, 4);
+    });
+
+    EXPECT_EQ(serial, parallel);
+}
+
+TEST(SimulationTest, FlatMatchesSerial) {
+    std::string serial = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate(f, rounds, rf);
+    });
+    std::string flat = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_flat(f, rounds, rf);
+    });
+
+    EXPECT_EQ(serial, flat);
+}
+
+TEST(SimulationTest, FlatCompletionKernelsMatchSerial) {
+    std::string serial = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate(f, rounds, rf);
+    });
+
+    using Kernel = FlatFactory::CompletionKernel;
+    for (Kernel kernel : {Kernel::SCALAR, Kernel::SSE2, Kernel::AVX2}) {
+        if (!FlatFactory::kernel_supported(kernel)) {
+            continue;
+        }
+        std::string flat = run_and_report([kernel](Factory& f, TimeOffset rounds, auto rf) {
+            FlatFactory flat_factory(f);
+            flat_factory.set_kernel(kernel);
+            for (Time t = 1; t <= rounds; ++t) {
+                flat_factory.do_deliveries(t);
+                flat_factory.do_package_passing(t);
+                flat_factory.do_work(t);
+                flat_factory.sync_to_factory();
+                rf(f, t);
+            }
+        });
+        EXPECT_EQ(serial, flat) << "kernel " << static_cast<int>(kernel);
+    }
+}
+
+TEST(SimulationTest, FlatReportsOnlyRequestedTurns) {
+    IntervalReportNotifier serial_notifier(7);
+    std::string serial = run_and_report([&](Factory& f, TimeOffset rounds, auto rf) {
+        simulate(f, rounds, [&](Factory& factory, Time t) {
+            if (serial_notifier.should_generate_report(t)) rf(factory, t);
+        });
+    });
+
+    IntervalReportNotifier flat_notifier(7);
+    std::vector<Time> turns;
+    std::string flat = run_and_report([&](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_flat(f, rounds, [&](Factory& factory, Time t) {
+            turns.push_back(t);
+            rf(factory, t);
+        }, [&](Time t) { return flat_notifier.should_generate_report(t); });
+    });
+
+    EXPECT_EQ(serial, flat);
+    EXPECT_EQ((std::vector<Time>{1, 8, 15, 22, 29}), turns);
+}
+
+TEST(SimulationTest, DistributedMatchesSerial) {
+    for (int capacity : {0, 1}) {
+        std::string serial = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+            f.enable_counter_rng(7);
+            simulate(f, rounds, rf);
+        }, 1, capacity);
+        for (std::size_t shards : {1, 3}) {
+            std::string distributed = run_and_report([shards](Factory& f, TimeOffset rounds, auto rf) {
+                f.enable_counter_rng(7);
+                simulate_distributed(f, rounds, rf, shards);
+            }, 1, capacity);
+            EXPECT_EQ(serial, distributed) << "capacity " << capacity << ", shards " << shards;
+        }
+    }
+
+    IntervalReportNotifier serial_notifier(7);
+    std::string serial = run_and_report([&](Factory& f, TimeOffset rounds, auto rf) {
+        f.enable_counter_rng(7);
+        simulate(f, rounds, [&](Factory& factory, Time t) {
+            if (serial_notifier.should_generate_report(t)) rf(factory, t);
+        });
+    });
+    IntervalReportNotifier distributed_notifier(7);
+    std::string distributed = run_and_report([&](Factory& f, TimeOffset rounds, auto rf) {
+        f.enable_counter_rng(7);
+        simulate_distributed(f, rounds, rf, 2, [&](Time t) { return distributed_notifier.should_generate_report(t); });
+    });
+    EXPECT_EQ(serial, distributed);
+
+    std::istringstream iss(layered_structure());
+    Factory f = load_factory_structure(iss);
+    EXPECT_THROW(simulate_distributed(f, 1, [](Factory&, Time) {}, 2), std::invalid_argument);
+}
+
+TEST(SimulationTest, CounterRngIsReproducibleAcrossEngines) {
+    auto serial_run = [] {
+        return run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+            f.enable_counter_rng(2024);
+            simulate(f, rounds, rf);
+        }, 1, 1);
+    };
+    std::string serial = serial_run();
+    rng.discard(12345);
+    EXPECT_EQ(serial, serial_run());
+
+    std::string parallel = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        f.enable_counter_rng(2024);
+        simulate_parallel(f, rounds, rf, 4);
+    }, 1, 1);
+    std::string flat = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        f.enable_counter_rng(2024);
+        simulate_flat(f, rounds, rf);
+    }, 1, 1);
+    std::string distributed = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        f.enable_counter_rng(2024);
+        simulate_distributed(f, rounds, rf, 2);
+    }, 1, 1);
+    EXPECT_EQ(serial, parallel);
+    EXPECT_EQ(serial, flat);
+    EXPECT_EQ(serial, distributed);
+}
+
+TEST(SimulationTest, StorehouseRetentionMatchesAcrossEngines) {
+    std::ostringstream structure;
+    structure << "LOADING_RAMP id=1 delivery-interval=1\nLOADING_RAMP id=2 delivery-interval=2\n"
+              << "STOREHOUSE id=1 retention=window window-size=3\nSTOREHOUSE id=2 retention=count\n";
+    for (int id = 1; id <= 8; ++id) {
+        structure << "WORKER id=" << id << " processing-time=" << (id % 3 + 1)
+                  << (id % 3 == 0 ? " queue-type=AGE" : "") << "\n";
+    }
+    for (int id = 1; id <= 8; ++id) {
+        if (id <= 4) {
+            structure << "LINK src=ramp-" << (id % 2 + 1) << " dest=worker-" << id << "\n"
+                      << "LINK src=worker-" << id << " dest=worker-" << (id + 4) << "\n"
+                      << "LINK src=worker-" << id << " dest=worker-" << (9 - id) << "\n";
+        } else {
+            structure << "LINK src=worker-" << id << " dest=store-1\n"
+                      << "LINK src=worker-" << id << " dest=store-2\n";
+        }
+    }
+
+    auto run = [&](auto simulate_fn) {
+        Factory f = load_factory_structure(structure.str());
+        std::ostringstream report;
+        rng.seed(2024);
+        simulate_fn(f, 60, [&report](Factory& factory, Time t) {
+            generate_simulation_turn_report(factory, report, t);
+        });
+        EXPECT_EQ(3u, f.find_storehouse_by_id(1)->get_queue()->size());
+        EXPECT_TRUE(f.find_storehouse_by_id(2)->get_queue()->empty());
+        const StorehouseStats& stats = f.find_storehouse_by_id(2)->get_stats();
+        EXPECT_GT(stats.received, 0u);
+        report << stats.received << " " << stats.first_arrival << " " << stats.last_arrival << " " << stats.arrival_turns;
+        return report.str();
+    };
+    std::string serial = run([](Factory& f, TimeOffset rounds, auto rf) { simulate(f, rounds, rf); });
+    std::string parallel = run([](Factory& f, TimeOffset rounds, auto rf) { simulate_parallel(f, rounds, rf, 4); });
+    std::string flat = run([](Factory& f, TimeOffset rounds, auto rf) { simulate_flat(f, rounds, rf); });
+    // Czesci zwalniaja ID w swoich magazynach, a rampy biora je z puli procesu wywolujacego.
+    std::string serial_counter = run([](Factory& f, TimeOffset rounds, auto rf) {
+        f.enable_counter_rng(5);
+        simulate(f, rounds, rf);
+    });
+    std::string distributed = run([](Factory& f, TimeOffset rounds, auto rf) {
+        f.enable_counter_rng(5);
+        simulate_distributed(f, rounds, rf, 3);
+    });
+
+    EXPECT_EQ(serial, parallel);
+    EXPECT_EQ(serial, flat);
+    EXPECT_EQ(serial_counter, distributed);
+}
+
+TEST(SimulationTest, BatchedRampsMatchAcrossEngines) {
+    std::ostringstream structure;
+    structure << "LOADING_RAMP id=1 delivery-interval=3 batch-size=12\nLOADING_RAMP id=2 delivery-interval=1\n"
+              << "STOREHOUSE id=1\n";
+    for (int id = 1; id <= 6; ++id) {
+        structure << "WORKER id=" << id << " processing-time=" << (id % 2 + 1) << " queue-capacity=4\n";
+    }
+    for (int id = 1; id <= 6; ++id) {
+        structure << "LINK src=ramp-" << (id % 2 + 1) << " dest=worker-" << id << "\n"
+                  << "LINK src=worker-" << id << " dest=store-1\n";
+    }
+
+    auto run = [&](auto simulate_fn) {
+        Factory f = load_factory_structure(structure.str());
+        std::ostringstream report;
+        rng.seed(7);
+        simulate_fn(f, 40, [&report](Factory& factory, Time t) {
+            generate_simulation_turn_report(factory, report, t);
+        });
+        const Ramp& ramp = *f.find_ramp_by_id(1);
+        EXPECT_GT(ramp.get_blocked_turns(), 0u);
+        report << ramp.get_blocked_turns() << " " << ramp.get_batch().size();
+        return report.str();
+    };
+    std::string serial = run([](Factory& f, TimeOffset rounds, auto rf) { simulate(f, rounds, rf); });
+    std::string parallel = run([](Factory& f, TimeOffset rounds, auto rf) { simulate_parallel(f, rounds, rf, 4); });
+    std::string events = run([](Factory& f, TimeOffset rounds, auto rf) { simulate_event_driven(f, rounds, rf); });
+
+    EXPECT_EQ(serial, parallel);
+    EXPECT_EQ(serial, events);
+
+    Factory f = load_factory_structure(structure.str());
+    EXPECT_THROW(simulate_flat(f, 1, [](Factory&, Time) {}), std::invalid_argument);
+}
+
+TEST(SimulationTest, BatchedAndSingleRampsShareBoundedWorker) {
+    constexpr const char* structure =
+        "LOADING_RAMP id=1 delivery-interval=1\n"
+        "LOADING_RAMP id=2 delivery-interval=1 batch-size=3\n"
+        "WORKER id=1 processing-time=2 queue-capacity=3\n"
+        "STOREHOUSE id=1\n"
+        "LINK src=ramp-1 dest=worker-1\n"
+        "LINK src=ramp-2 dest=worker-1\n"
+        "LINK src=worker-1 dest=store-1\n";
+    auto run = [&](auto simulate_fn) {
+        PackageIdAllocator ids;
+        PackageIdAllocator::Scope scope(ids);
+        Factory f = load_factory_structure(std::string_view(structure));
+        std::ostringstream report;
+        simulate_fn(f, 12, [&report](Factory& factory, Time t) {
+            EXPECT_LE(factory.find_worker_by_id(1)->get_queue()->size(), 3u);
+            generate_simulation_turn_report(factory, report, t);
+        });
+        return report.str();
+    };
+    std::string serial = run([](Factory& f, TimeOffset rounds, auto rf) { simulate(f, rounds, rf); });
+    std::string parallel = run([](Factory& f, TimeOffset rounds, auto rf) { simulate_parallel(f, rounds, rf, 2); });
+
+    EXPECT_NE(std::string::npos, serial.find("PBuffer: #1 (pt = 1)\n  Queue: #2 #3 \n"));
+    EXPECT_EQ(serial, parallel);
+}
+
+TEST(SimulationTest, EventDrivenMatchesSerialOnSparseFactory) {
+    SpecificTurnsReportNotifier serial_notifier({3, 17, 18, 30});
+    std::string serial = run_and_report([&](Factory& f, TimeOffset rounds, auto rf) {
+        simulate(f, rounds, [&](Factory& factory, Time t) {
+            if (serial_notifier.should_generate_report(t)) rf(factory, t);
+        });
+    }, 11);
+
+    SpecificTurnsReportNotifier event_notifier({3, 17, 18, 30});
+    std::string event_driven = run_and_report([&](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_event_driven(f, rounds, rf, [&](Time t) { return event_notifier.should_generate_report(t); });
+    }, 11);
+
+    EXPECT_EQ(serial, event_driven);
+}
+
+TEST(SimulationTest, BoundedQueuesMatchAcrossEngines) {
+    std::uint64_t blocked = 0;
+    std::string serial = run_and_report([&](Factory& f, TimeOffset rounds, auto rf) {
+        simulate(f, rounds, rf);
+        for (const auto& worker : f.worker_collection()) {
+            EXPECT_LE(worker.get_queue()->size(), 1u);
+            blocked += worker.get_blocked_turns();
+        }
+        for (const auto& ramp : f.ramp_collection()) {
+            blocked += ramp.get_blocked_turns();
+        }
+    }, 1, 1);
+    EXPECT_GT(blocked, 0u);
+
+    std::string parallel = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_parallel(f, rounds, rf, 4);
+    }, 1, 1);
+    std::string flat = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_flat(f, rounds, rf);
+    }, 1, 1);
+    std::string event_driven = run_and_report([](Factory& f, TimeOffset rounds, auto rf) {
+        simulate_event_driven(f, rounds, rf);
+    }, 1, 1);
+
+    EXPECT_EQ(serial, parallel);
+    EXPECT_EQ(serial, flat);
+    EXPECT_EQ(serial, event_driven);
+}
+
+TEST(SimulationTest, EventDrivenMatchesSerialWithBatchesAndMixedQueues) {
+    auto run = [](auto simulate_fn) {
+        std::istringstream iss(
+            "LOADING_RAMP id=1 delivery-interval=1\n"
+            "LOADING_RAMP id=2 delivery-interval=3 batch-size=4\n"
+            "LOADING_RAMP id=3 delivery-interval=5\n"
+            "WORKER id=1 processing-time=2 queue-capacity=2\n"
+            "WORKER id=2 processing-time=3 queue-type=LIFO queue-capacity=3\n"
+            "WORKER id=3 processing-time=1 queue-type=AGE\n"
+            "WORKER id=4 processing-time=4 queue-capacity=1\n"
+            "STOREHOUSE id=1 queue-capacity=40\n"
+            "STOREHOUSE id=2\n"
+            "LINK src=ramp-1 dest=worker-1\n"
+            "LINK src=ramp-1 dest=worker-2\n"
+            "LINK src=ramp-2 dest=worker-3\n"
+            "LINK src=ramp-2 dest=worker-2\n"
+            "LINK src=ramp-3 dest=worker-4\n"
+            "LINK src=worker-1 dest=worker-3\n"
+            "LINK src=worker-1 dest=worker-4\n"
+            "LINK src=worker-2 dest=worker-3\n"
+            "LINK src=worker-2 dest=store-1\n"
+            "LINK src=worker-3 dest=store-1\n"
+            "LINK src=worker-3 dest=worker-4\n"
+            "LINK src=worker-4 dest=store-2\n");
+        PackageIdAllocator ids;
+        PackageIdAllocator::Scope scope(ids);
+        Factory f = load_factory_structure(iss);
+        rng.seed(5);
+        std::ostringstream report;
+        simulate_fn(f, 120, [&report](Factory& factory, Time t) {
+            generate_simulation_turn_report(factory, report, t);
+        });
+        return report.str();
+    };
+
+    std::string serial = run([](Factory& f, TimeOffset rounds, auto rf) { simulate(f, rounds, rf); });
+    std::string event_driven = run([](Factory& f, TimeOffset rounds, auto rf) { simulate_event_driven(f, rounds, rf); });
+
+    EXPECT_EQ(serial, event_driven);
+}
+
+TEST(SimulationTest, EventDrivenSkipsIdleTurnsOfChain) {
+    auto run = [](auto simulate_fn) {
+        std::istringstream iss(
+            "LOADING_RAMP id=1 delivery-interval=10\n"
+            "WORKER id=1 processing-time=3 queue-type=FIFO\n"
+            "WORKER id=2 processing-time=4 queue-type=FIFO\n"
+            "STOREHOUSE id=1\n"
+            "LINK src=ramp-1 dest=worker-1\n"
+            "LINK src=worker-1 dest=worker-2\n"
+            "LINK src=worker-2 dest=store-1\n");
+        Factory f = load_factory_structure(iss);
+        std::ostringstream report;
+        simulate_fn(f, 45, [&report](Factory& factory, Time t) {
+            generate_simulation_turn_report(factory, report, t);
+        });
+        return report.str();
+    };
+
+    std::size_t processed = 0;
+    std::string serial = run([](Factory& f, TimeOffset rounds, auto rf) { simulate(f, rounds, rf); });
+    std::string event_driven = run([&processed](Factory& f, TimeOffset rounds, auto rf) {
+        processed = simulate_event_driven(f, rounds, rf);
+    });
+
+    EXPECT_EQ(serial, event_driven);
+    // Dostawa w turze d ma zdarzenia w d, d+2, d+3, d+6 i d+7; dostawy w 1, 11, 21, 31 i 41
+    // (ostatnia tylko 41, 43, 44) - 23 z 45 tur.
+    EXPECT_EQ(23u, processed);
+}
@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+#include "factory.hxx"
+#include "helpers.hxx"
+#include "package_id_allocator.hxx"
+#include "reports.hxx"
+#include "simulation.hxx"
+#include "snapshot.hxx"
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const char* structure =
+    "LOADING_RAMP id=1 delivery-interval=1\n"
+    "LOADING_RAMP id=2 delivery-interval=3\n"
+    "WORKER id=1 processing-time=2 queue-type=FIFO\n"
+    "WORKER id=2 processing-time=3 queue-type=LIFO\n"
+    "WORKER id=3 processing-time=2 queue-type=AGE\n"
+    "STOREHOUSE id=1\n"
+    "LINK src=ramp-1 dest=worker-1\n"
+    "LINK src=ramp-2 dest=worker-2 weight=2\n"
+    "LINK src=ramp-2 dest=worker-1\n"
+    "LINK src=worker-1 dest=worker-2\n"
+    "LINK src=worker-1 dest=worker-3\n"
+    "LINK src=worker-2 dest=worker-3\n"
+    "LINK src=worker-2 dest=store-1\n"
+    "LINK src=worker-3 dest=store-1\n";
+
+}
+
+TEST(SnapshotTest, ResumeMatchesUninterruptedRun) {
+    std::ostringstream uninterrupted;
+    {
+        Factory f = load_factory_structure(std::string_view(structure));
+        rng.seed(99);
+        simulate(f, 40, [&uninterrupted](Factory& factory, Time t) {
+            if (t > 20) generate_simulation_turn_report(factory, uninterrupted, t);
+        });
+    }
+
+    std::string checkpoint;
+    {
+        Factory f = load_factory_structure(std::string_view(structure));
+        rng.seed(99);
+        simulate(f, 20, [](Factory&, Time) {});
+        std::ostringstream os;
+        save_snapshot(f, 20, os);
+        checkpoint = os.str();
+    }
+
+    rng.seed(1);
+    std::ostringstream resumed;
+    Snapshot s = load_snapshot(checkpoint);
+    EXPECT_EQ(20, s.turn);
+    simulate(s.factory, 40, [&resumed](Factory& factory, Time t) {
+        generate_simulation_turn_report(factory, resumed, t);
+    }, s.turn + 1);
+
+    EXPECT_FALSE(resumed.str().empty());
+    EXPECT_EQ(uninterrupted.str(), resumed.str());
+}
+
+TEST(SnapshotTest, KeepsCounterRngSeed) {
+    Factory f = load_factory_structure(std::string_view(structure));
+    f.enable_counter_rng(0x123456789abcULL);
+    std::ostringstream os;
+    save_snapshot(f, 0, os);
+
+    Snapshot s = load_snapshot(os.str());
+    ASSERT_TRUE(s.factory.counter_rng().has_value());
+    EXPECT_EQ(0x123456789abcULL, s.factory.counter_rng()->seed());
+    EXPECT_TRUE(s.factory.find_worker_by_id(3)->receiver_preferences_.get_counter_rng().has_value());
+
+    std::ostringstream plain;
+    save_snapshot(load_factory_structure(std::string_view(structure)), 0, plain);
+    EXPECT_FALSE(load_snapshot(plain.str()).factory.counter_rng().has_value());
+}
+
+TEST(SnapshotTest, RejectsTruncatedData) {
+    Factory f = load_factory_structure(std::string_view(structure));
+    std::ostringstream os;
+    save_snapshot(f, 0, os);
+    std::string data = os.str();
+
+    EXPECT_THROW(load_snapshot(std::string_view(data).substr(0, data.size() / 2)), std::runtime_error);
+    EXPECT_THROW(load_snapshot("garbage"), std::runtime_error);
+}
+
+TEST(SnapshotTest, FailedLoadLeavesCallerStateIntact) {
+    std::string data;
+    {
+        PackageIdAllocator ids;
+        PackageIdAllocator::Scope scope(ids);
+        Factory f = load_factory_structure(std::string_view(structure));
+        simulate(f, 10, [](Factory&, Time) {});
+        std::ostringstream os;
+        save_snapshot(f, 10, os);
+        data = os.str();
+    }
+
+    PackageIdAllocator ids;
+    PackageIdAllocator::Scope scope(ids);
+    std::vector<Package> live(3);
+    EXPECT_THROW(load_snapshot(std::string_view(data).substr(0, data.size() - 4)), std::runtime_error);
+
+    // Bajt flagi generatora licznikowego lezy zaraz za stanem rng.
+    std::uint64_t rng_size;
+    std::memcpy(&rng_size, data.data() + 16, sizeof(rng_size));
+    std::string corrupted = data;
+    corrupted[24 + rng_size] = 7;
+    EXPECT_THROW(load_snapshot(corrupted), std::runtime_error);
+
+    EXPECT_EQ(4, Package().get_id());
+}
@@ -0,0 +1,19 @@
+#include "gtest/gtest.h"
+#include "topology_generator.hxx"
+#include "simulation.hxx"
+
+TEST(TopologyGeneratorTest, ShapesAreConsistent) {
+    for (auto shape : {TopologyShape::CHAIN, TopologyShape::FAN_OUT, TopologyShape::LAYERED}) {
+        for (std::size_t workers : {1, 7, 1000}) {
+            Factory f = generate_topology({shape, workers, 4});
+            EXPECT_EQ(workers, f.worker_collection().size());
+            EXPECT_TRUE(f.is_consistent()) << f.describe_inconsistency();
+        }
+    }
+}
+
+TEST(TopologyGeneratorTest, ChainDeliversToStorehouse) {
+    Factory f = generate_topology({TopologyShape::CHAIN, 5, 1, 1, 1});
+    simulate(f, 20, [](Factory&, Time) {});
+    EXPECT_FALSE(f.find_storehouse_by_id(1)->get_queue()->empty());
+}